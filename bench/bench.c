@@ -0,0 +1,89 @@
+/* CDict side of `make bench`, see bench.h for the workloads and output. */
+#include "../src/cdict.h"
+#include "bench.h"
+
+/* One run function per key/value type pair. The table is reserved up front
+ * for `cap` buckets so that the load factor is the one asked for. */
+#define BENCH_CDICT(K, V)                                                      \
+  static void bench_cdict_##K##_##V(const bench_Config *cfg,                   \
+                                    bench_Result *result) {                    \
+    CDict(K, V) dict_t;                                                        \
+    CDict_iterator(dict_t) iterator_t;                                         \
+    dict_t dict;                                                               \
+    cdict_Hugepage hugepage;                                                   \
+    cdict_hugepage__init(&hugepage, 0, false);                                 \
+    cdict__init_with_allocator(                                                \
+        &dict, cfg->hugepage ? cdict_hugepage__allocator(&hugepage) : NULL);   \
+    cdict__reserve(&dict,                                                      \
+                   (size_t)(cfg->cap * cdict__max_load_factor(&dict)) - 1);    \
+                                                                               \
+    K key;                                                                     \
+    V val;                                                                     \
+    memset(&key, 0, sizeof(key));                                              \
+    memset(&val, 0, sizeof(val));                                              \
+    size_t n = cfg->n, found = 0;                                              \
+    uint64_t rng = 0x2545F4914F6CDD1Dull;                                      \
+                                                                               \
+    BENCH_TIMED(&result->ops[BENCH_INSERT], n, j, {                            \
+      bench_key_set(&key, sizeof(key), j);                                     \
+      cdict__add(&dict, key, val);                                             \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_HIT], cfg->lookups, j, {                    \
+      bench_key_set(&key, sizeof(key), bench_rand(&rng) % n);                  \
+      found += cdict__get(&dict, key, &val);                                   \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_MISS], cfg->lookups, j, {                   \
+      bench_key_set(&key, sizeof(key), n + bench_rand(&rng) % n);              \
+      found += cdict__contains(&dict, key);                                    \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_CHURN], cfg->lookups, j, {                  \
+      bench_key_set(&key, sizeof(key), j);                                     \
+      cdict__remove(&dict, key);                                               \
+      bench_key_set(&key, sizeof(key), n + j);                                 \
+      cdict__add(&dict, key, val);                                             \
+    });                                                                        \
+    iterator_t iterator;                                                       \
+    cdict_iterator__init(&iterator, &dict);                                    \
+    BENCH_TIMED(&result->ops[BENCH_ITERATE], cdict__size(&dict), j, {          \
+      key = cdict_iterator__next_keyval(&iterator, &val);                      \
+      found += *(unsigned char *)&key;                                         \
+    });                                                                        \
+    bench_sink = found;                                                        \
+    cdict__free(&dict);                                                        \
+  }
+
+BENCH_CDICT(bench_Key4, bench_Val8)
+BENCH_CDICT(bench_Key8, bench_Val8)
+BENCH_CDICT(bench_Key32, bench_Val8)
+BENCH_CDICT(bench_Key128, bench_Val8)
+BENCH_CDICT(bench_Key8, bench_Val64)
+BENCH_CDICT(bench_Key32, bench_Val64)
+
+int main(int argc, char **argv) {
+  bench_Variant variants[] = {
+      {4, 8, bench_cdict_bench_Key4_bench_Val8},
+      {8, 8, bench_cdict_bench_Key8_bench_Val8},
+      {32, 8, bench_cdict_bench_Key32_bench_Val8},
+      {128, 8, bench_cdict_bench_Key128_bench_Val8},
+      {8, 64, bench_cdict_bench_Key8_bench_Val64},
+      {32, 64, bench_cdict_bench_Key32_bench_Val64},
+  };
+  bench_Sweep sweep = bench_sweep(argc, argv);
+  bench_header();
+  bench_main("cdict", variants, sizeof(variants) / sizeof(variants[0]),
+             &sweep);
+
+  /* the same 8/8 tables with buckets from cdict_Hugepage instead of malloc,
+   * mostly relevant from LLC size up where TLB misses dominate lookups */
+  for (int l = 0; l < 4; l++) {
+    for (int i = 0; i < 3; i++) {
+      bench_Config cfg;
+      if (bench_config(&sweep, &variants[1], &sweep.levels[l], sweep.loads[i],
+                       &cfg)) {
+        cfg.hugepage = true;
+        bench_run_config("cdict+hugepage", variants[1].run, &cfg);
+      }
+    }
+  }
+  return 0;
+}
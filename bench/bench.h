@@ -0,0 +1,281 @@
+/* Shared harness for `make bench`: workload shapes, timing, percentiles and
+ * the config sweep. Each backend (bench.c, bench_std.cpp, bench_khash.c,
+ * bench_uthash.c) only provides one run function per key/value size;
+ * everything else lives here so that the numbers of different backends are
+ * measured the same way. */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ops are timed in batches, one percentile sample per batch: the batch_p50,
+ * batch_p90 and batch_p99 columns are percentiles of batch means, which
+ * smooth out single slow ops such as the insert that triggers a resize */
+#define BENCH_BATCH 256
+
+typedef uint32_t bench_Key4;
+typedef uint64_t bench_Key8;
+typedef struct {
+  unsigned char bytes[32];
+} bench_Key32;
+typedef struct {
+  unsigned char bytes[128];
+} bench_Key128;
+
+typedef uint64_t bench_Val8;
+typedef struct {
+  uint64_t words[8];
+} bench_Val64;
+
+enum {
+  BENCH_INSERT,
+  BENCH_HIT,
+  BENCH_MISS,
+  BENCH_CHURN,
+  BENCH_ITERATE,
+  BENCH_OPS
+};
+
+static const char *bench_op_names[BENCH_OPS] = {"insert", "hit", "miss",
+                                                "churn", "iterate"};
+
+typedef struct {
+  double *samples;
+  size_t count;
+  uint64_t ns;
+  uint64_t ops;
+} bench_Op;
+
+typedef struct {
+  bench_Op ops[BENCH_OPS];
+} bench_Result;
+
+typedef struct {
+  size_t key_size;
+  size_t val_size;
+  /* buckets the table is reserved for, a power of 2 */
+  size_t cap;
+  /* entries inserted, `load` of `cap` */
+  size_t n;
+  /* hit, miss and churn ops, at most `n` */
+  size_t lookups;
+  double load;
+  const char *level;
+  bool hugepage;
+} bench_Config;
+
+typedef void (*bench_Run)(const bench_Config *, bench_Result *);
+
+typedef struct {
+  size_t key_size;
+  size_t val_size;
+  bench_Run run;
+} bench_Variant;
+
+/* keeps the compiler from dropping lookups whose result is unused */
+static volatile uint64_t bench_sink;
+
+static uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* i-th distinct key: the multiplier is odd, so truncating to 4 bytes keeps
+ * keys distinct; wider keys vary in their first 8 bytes only */
+static void bench_key_set(void *key, size_t size, uint64_t i) {
+  uint64_t x = i * 0x9E3779B97F4A7C15ull;
+  memcpy(key, &x, size < sizeof(x) ? size : sizeof(x));
+}
+
+static uint64_t bench_rand(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void bench_op_begin(bench_Op *op, size_t ops) {
+  op->samples = (double *)malloc((ops / BENCH_BATCH + 1) * sizeof(double));
+  op->count = 0;
+  op->ns = 0;
+  op->ops = 0;
+}
+
+static void bench_op_record(bench_Op *op, uint64_t start, size_t ops) {
+  uint64_t ns = bench_now_ns() - start;
+  op->samples[op->count++] = (double)ns / (double)ops;
+  op->ns += ns;
+  op->ops += ops;
+}
+
+/* runs `body` for j in [0, total), timing every BENCH_BATCH iterations */
+#define BENCH_TIMED(op, total, j, ...)                                         \
+  do {                                                                         \
+    bench_op_begin((op), (total));                                             \
+    for (size_t bench_i_ = 0; bench_i_ < (total); bench_i_ += BENCH_BATCH) {   \
+      size_t bench_end_ = bench_i_ + BENCH_BATCH < (total)                     \
+                              ? bench_i_ + BENCH_BATCH                         \
+                              : (total);                                       \
+      uint64_t bench_start_ = bench_now_ns();                                  \
+      for (size_t j = bench_i_; j < bench_end_; j++) {                         \
+        __VA_ARGS__                                                            \
+      }                                                                        \
+      bench_op_record((op), bench_start_, bench_end_ - bench_i_);              \
+    }                                                                          \
+  } while (0)
+
+static int bench_compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double bench_percentile(const bench_Op *op, double p) {
+  if (op->count == 0) {
+    return 0;
+  }
+  return op->samples[(size_t)(p * (double)(op->count - 1))];
+}
+
+static long bench_peak_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static void bench_report(const char *backend, const bench_Config *cfg,
+                         bench_Result *result) {
+  long rss = bench_peak_rss_kb();
+  for (int i = 0; i < BENCH_OPS; i++) {
+    bench_Op *op = &result->ops[i];
+    qsort(op->samples, op->count, sizeof(double), bench_compare_doubles);
+    printf("%-20s %4zu %4zu %-5s %5.2f %10zu %-8s %8.2f %9.2f %9.2f %9.2f "
+           "%10ld\n",
+           backend, cfg->key_size, cfg->val_size, cfg->level, cfg->load,
+           cfg->n, bench_op_names[i],
+           op->ops ? (double)op->ns / (double)op->ops : 0.0,
+           bench_percentile(op, 0.5), bench_percentile(op, 0.9),
+           bench_percentile(op, 0.99), rss);
+    free(op->samples);
+  }
+  fflush(stdout);
+}
+
+static void bench_header(void) {
+  printf("%-20s %4s %4s %-5s %5s %10s %-8s %8s %9s %9s %9s %10s\n", "backend",
+         "key", "val", "table", "load", "n", "op", "ns/op", "batch_p50",
+         "batch_p90", "batch_p99", "rss_kb");
+}
+
+/* each config runs in its own process so that peak RSS is per config */
+static void bench_run_config(const char *backend, bench_Run run,
+                             const bench_Config *cfg) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    bench_Result result;
+    run(cfg, &result);
+    bench_report(backend, cfg, &result);
+    _exit(0);
+  }
+  if (pid > 0) {
+    waitpid(pid, NULL, 0);
+  }
+}
+
+static size_t bench_cache_size(int level) {
+  long size = -1;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+  static const int names[] = {_SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE,
+                              _SC_LEVEL3_CACHE_SIZE};
+  size = sysconf(names[level - 1]);
+#endif
+  if (size <= 0) {
+    static const size_t defaults[] = {32 << 10, 1 << 20, 8 << 20};
+    return defaults[level - 1];
+  }
+  return (size_t)size;
+}
+
+typedef struct {
+  const char *name;
+  size_t bytes;
+} bench_Level;
+
+typedef struct {
+  size_t max_bytes;
+  size_t max_lookups;
+  bench_Level levels[4];
+  double loads[3];
+} bench_Sweep;
+
+/* `--max-mb N` skips tables above N MB (0 = no limit), `--ops N` caps the
+ * hit, miss and churn ops per config */
+static bench_Sweep bench_sweep(int argc, char **argv) {
+  size_t llc = bench_cache_size(3);
+  bench_Sweep sweep = {512u << 20,
+                       1u << 20,
+                       {{"L1", bench_cache_size(1)},
+                        {"L2", bench_cache_size(2)},
+                        {"LLC", llc},
+                        {"10LLC", llc * 10}},
+                       {0.25, 0.5, 0.65}};
+  for (int i = 1; i + 1 < argc; i += 2) {
+    size_t value = strtoull(argv[i + 1], NULL, 10);
+    if (strcmp(argv[i], "--max-mb") == 0) {
+      sweep.max_bytes = value ? value << 20 : SIZE_MAX;
+    } else if (strcmp(argv[i], "--ops") == 0) {
+      sweep.max_lookups = value;
+    }
+  }
+  return sweep;
+}
+
+/* sizes the table for a cache level: the largest power of 2 bucket count
+ * whose nominal footprint (psl + key + value) fits the level */
+static bool bench_config(const bench_Sweep *sweep, const bench_Variant *variant,
+                         const bench_Level *level, double load,
+                         bench_Config *cfg) {
+  size_t nominal = sizeof(int) + variant->key_size + variant->val_size;
+  size_t cap = 64;
+  while (cap * 2 * nominal <= level->bytes) {
+    cap *= 2;
+  }
+  if (cap * nominal > sweep->max_bytes) {
+    return false;
+  }
+  cfg->key_size = variant->key_size;
+  cfg->val_size = variant->val_size;
+  cfg->cap = cap;
+  cfg->n = (size_t)(load * (double)cap);
+  cfg->lookups = cfg->n < sweep->max_lookups ? cfg->n : sweep->max_lookups;
+  cfg->load = load;
+  cfg->level = level->name;
+  cfg->hugepage = false;
+  return true;
+}
+
+static void bench_main(const char *backend, const bench_Variant *variants,
+                       size_t count, const bench_Sweep *sweep) {
+  for (size_t v = 0; v < count; v++) {
+    for (int l = 0; l < 4; l++) {
+      for (int i = 0; i < 3; i++) {
+        bench_Config cfg;
+        if (bench_config(sweep, &variants[v], &sweep->levels[l],
+                         sweep->loads[i], &cfg)) {
+          bench_run_config(backend, variants[v].run, &cfg);
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,99 @@
+/* khash side of `make bench` (deps/khash), same workloads and output as
+ * bench.c, see bench.h. */
+#include "../deps/khash/khash.h"
+#include "bench.h"
+
+/* 4 and 8 byte keys use khash's own integer hashes, struct keys hash and
+ * compare their bytes (FNV-1a), like CDict's defaults */
+static kh_inline khint_t bench_khash_fnv(const void *key, size_t size) {
+  const unsigned char *bytes = (const unsigned char *)key;
+  khint_t h = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ bytes[i]) * 16777619u;
+  }
+  return h;
+}
+
+#define bench_khash_bytes_hash(key) bench_khash_fnv(&(key), sizeof(key))
+#define bench_khash_bytes_equal(a, b) (memcmp(&(a), &(b), sizeof(a)) == 0)
+
+/* One run function per key/value type pair. The table is resized up front
+ * to `cap` buckets, below khash's own 0.77 load factor for every `load`. */
+#define BENCH_KHASH(name, K, V, hash, equal)                                   \
+  KHASH_INIT(name, K, V, 1, hash, equal)                                       \
+  static void bench_khash_##name(const bench_Config *cfg,                      \
+                                 bench_Result *result) {                       \
+    khash_t(name) *h = kh_init(name);                                          \
+    kh_resize(name, h, (khint_t)cfg->cap);                                     \
+                                                                               \
+    K key;                                                                     \
+    V val;                                                                     \
+    memset(&key, 0, sizeof(key));                                              \
+    memset(&val, 0, sizeof(val));                                              \
+    size_t n = cfg->n, found = 0;                                              \
+    uint64_t rng = 0x2545F4914F6CDD1Dull;                                      \
+    int ret;                                                                   \
+    khint_t k;                                                                 \
+                                                                               \
+    BENCH_TIMED(&result->ops[BENCH_INSERT], n, j, {                            \
+      bench_key_set(&key, sizeof(key), j);                                     \
+      k = kh_put(name, h, key, &ret);                                          \
+      kh_value(h, k) = val;                                                    \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_HIT], cfg->lookups, j, {                    \
+      bench_key_set(&key, sizeof(key), bench_rand(&rng) % n);                  \
+      k = kh_get(name, h, key);                                                \
+      if (k != kh_end(h)) {                                                    \
+        val = kh_value(h, k);                                                  \
+        found++;                                                               \
+      }                                                                        \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_MISS], cfg->lookups, j, {                   \
+      bench_key_set(&key, sizeof(key), n + bench_rand(&rng) % n);              \
+      found += kh_get(name, h, key) != kh_end(h);                              \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_CHURN], cfg->lookups, j, {                  \
+      bench_key_set(&key, sizeof(key), j);                                     \
+      kh_del(name, h, kh_get(name, h, key));                                   \
+      bench_key_set(&key, sizeof(key), n + j);                                 \
+      k = kh_put(name, h, key, &ret);                                          \
+      kh_value(h, k) = val;                                                    \
+    });                                                                        \
+    khint_t it = kh_begin(h);                                                  \
+    BENCH_TIMED(&result->ops[BENCH_ITERATE], kh_size(h), j, {                  \
+      while (!kh_exist(h, it)) {                                               \
+        it++;                                                                  \
+      }                                                                        \
+      key = kh_key(h, it);                                                     \
+      val = kh_value(h, it);                                                   \
+      found += *(unsigned char *)&key;                                         \
+      it++;                                                                    \
+    });                                                                        \
+    bench_sink = found;                                                        \
+    kh_destroy(name, h);                                                       \
+  }
+
+BENCH_KHASH(k4_v8, bench_Key4, bench_Val8, kh_int_hash_func, kh_int_hash_equal)
+BENCH_KHASH(k8_v8, bench_Key8, bench_Val8, kh_int64_hash_func,
+            kh_int64_hash_equal)
+BENCH_KHASH(k32_v8, bench_Key32, bench_Val8, bench_khash_bytes_hash,
+            bench_khash_bytes_equal)
+BENCH_KHASH(k128_v8, bench_Key128, bench_Val8, bench_khash_bytes_hash,
+            bench_khash_bytes_equal)
+BENCH_KHASH(k8_v64, bench_Key8, bench_Val64, kh_int64_hash_func,
+            kh_int64_hash_equal)
+BENCH_KHASH(k32_v64, bench_Key32, bench_Val64, bench_khash_bytes_hash,
+            bench_khash_bytes_equal)
+
+int main(int argc, char **argv) {
+  bench_Variant variants[] = {
+      {4, 8, bench_khash_k4_v8},     {8, 8, bench_khash_k8_v8},
+      {32, 8, bench_khash_k32_v8},   {128, 8, bench_khash_k128_v8},
+      {8, 64, bench_khash_k8_v64},   {32, 64, bench_khash_k32_v64},
+  };
+  bench_Sweep sweep = bench_sweep(argc, argv);
+  bench_header();
+  bench_main("khash", variants, sizeof(variants) / sizeof(variants[0]),
+             &sweep);
+  return 0;
+}
@@ -0,0 +1,143 @@
+/* std::unordered_map reference and the cdict::map C++ front end for
+ * `make bench`, same workloads and output as bench.c (see bench.h). */
+#include "bench.h"
+
+#include <string_view>
+#include <unordered_map>
+
+#include "../src/cdict.hpp"
+
+/* struct keys hash and compare as raw bytes, like CDict's defaults */
+template <typename K> struct BenchHash {
+  size_t operator()(const K &key) const {
+    return std::hash<std::string_view>()(
+        std::string_view((const char *)&key, sizeof(key)));
+  }
+};
+
+template <typename K> struct BenchEqual {
+  bool operator()(const K &a, const K &b) const {
+    return memcmp(&a, &b, sizeof(K)) == 0;
+  }
+};
+
+template <typename K, typename V, typename Hash = BenchHash<K>,
+          typename Equal = BenchEqual<K>>
+static void bench_std(const bench_Config *cfg, bench_Result *result) {
+  std::unordered_map<K, V, Hash, Equal> map;
+  map.reserve(cfg->n);
+
+  K key;
+  V val;
+  memset(&key, 0, sizeof(key));
+  memset(&val, 0, sizeof(val));
+  size_t n = cfg->n, found = 0;
+  uint64_t rng = 0x2545F4914F6CDD1Dull;
+
+  BENCH_TIMED(&result->ops[BENCH_INSERT], n, j, {
+    bench_key_set(&key, sizeof(key), j);
+    map[key] = val;
+  });
+  BENCH_TIMED(&result->ops[BENCH_HIT], cfg->lookups, j, {
+    bench_key_set(&key, sizeof(key), bench_rand(&rng) % n);
+    auto it = map.find(key);
+    if (it != map.end()) {
+      val = it->second;
+      found++;
+    }
+  });
+  BENCH_TIMED(&result->ops[BENCH_MISS], cfg->lookups, j, {
+    bench_key_set(&key, sizeof(key), n + bench_rand(&rng) % n);
+    found += map.count(key);
+  });
+  BENCH_TIMED(&result->ops[BENCH_CHURN], cfg->lookups, j, {
+    bench_key_set(&key, sizeof(key), j);
+    map.erase(key);
+    bench_key_set(&key, sizeof(key), n + j);
+    map[key] = val;
+  });
+  auto it = map.begin();
+  BENCH_TIMED(&result->ops[BENCH_ITERATE], map.size(), j, {
+    found += *(const unsigned char *)&it->first;
+    ++it;
+  });
+  bench_sink = found;
+}
+
+template <typename K> struct BenchMapEqual {
+  bool operator()(const K &a, const K &b) const {
+    return memcmp(&a, &b, sizeof(K)) == 0;
+  }
+};
+
+template <typename K, typename V>
+static void bench_cdict_map(const bench_Config *cfg, bench_Result *result) {
+  cdict::map<K, V, cdict::hash<K>, BenchMapEqual<K>> map;
+  map.reserve(cfg->n);
+
+  K key;
+  V val;
+  memset(&key, 0, sizeof(key));
+  memset(&val, 0, sizeof(val));
+  size_t n = cfg->n, found = 0;
+  uint64_t rng = 0x2545F4914F6CDD1Dull;
+
+  BENCH_TIMED(&result->ops[BENCH_INSERT], n, j, {
+    bench_key_set(&key, sizeof(key), j);
+    map[key] = val;
+  });
+  BENCH_TIMED(&result->ops[BENCH_HIT], cfg->lookups, j, {
+    bench_key_set(&key, sizeof(key), bench_rand(&rng) % n);
+    V *hit = map.get(key);
+    if (hit) {
+      val = *hit;
+      found++;
+    }
+  });
+  BENCH_TIMED(&result->ops[BENCH_MISS], cfg->lookups, j, {
+    bench_key_set(&key, sizeof(key), n + bench_rand(&rng) % n);
+    found += map.contains(key);
+  });
+  BENCH_TIMED(&result->ops[BENCH_CHURN], cfg->lookups, j, {
+    bench_key_set(&key, sizeof(key), j);
+    map.erase(key);
+    bench_key_set(&key, sizeof(key), n + j);
+    map[key] = val;
+  });
+  auto it = map.begin();
+  BENCH_TIMED(&result->ops[BENCH_ITERATE], map.size(), j, {
+    found += *(const unsigned char *)&it.key();
+    ++it;
+  });
+  bench_sink = found;
+}
+
+int main(int argc, char **argv) {
+  bench_Variant variants[] = {
+      {4, 8, bench_std<bench_Key4, bench_Val8, std::hash<bench_Key4>,
+                       std::equal_to<bench_Key4>>},
+      {8, 8, bench_std<bench_Key8, bench_Val8, std::hash<bench_Key8>,
+                       std::equal_to<bench_Key8>>},
+      {32, 8, bench_std<bench_Key32, bench_Val8>},
+      {128, 8, bench_std<bench_Key128, bench_Val8>},
+      {8, 64, bench_std<bench_Key8, bench_Val64, std::hash<bench_Key8>,
+                        std::equal_to<bench_Key8>>},
+      {32, 64, bench_std<bench_Key32, bench_Val64>},
+  };
+  bench_Sweep sweep = bench_sweep(argc, argv);
+  bench_header();
+  bench_main("std::unordered_map", variants,
+             sizeof(variants) / sizeof(variants[0]), &sweep);
+
+  bench_Variant map_variants[] = {
+      {4, 8, bench_cdict_map<bench_Key4, bench_Val8>},
+      {8, 8, bench_cdict_map<bench_Key8, bench_Val8>},
+      {32, 8, bench_cdict_map<bench_Key32, bench_Val8>},
+      {128, 8, bench_cdict_map<bench_Key128, bench_Val8>},
+      {8, 64, bench_cdict_map<bench_Key8, bench_Val64>},
+      {32, 64, bench_cdict_map<bench_Key32, bench_Val64>},
+  };
+  bench_main("cdict::map", map_variants,
+             sizeof(map_variants) / sizeof(map_variants[0]), &sweep);
+  return 0;
+}
@@ -0,0 +1,94 @@
+/* uthash side of `make bench` (deps/uthash), same workloads and output as
+ * bench.c, see bench.h. */
+#include "../deps/uthash/uthash.h"
+#include "bench.h"
+
+/* One run function per key/value type pair. uthash is intrusive: every
+ * entry is its own allocation holding the hash handle, allocated on insert
+ * and freed on remove the way uthash tables are normally used. Keys hash
+ * with uthash's default (Jenkins) over their bytes. There is no reserve, so
+ * the bucket array doubles while inserting. */
+#define BENCH_UTHASH(K, V)                                                     \
+  typedef struct bench_uthash_##K##_##V {                                      \
+    K key;                                                                     \
+    V val;                                                                     \
+    UT_hash_handle hh;                                                         \
+  } bench_uthash_##K##_##V;                                                    \
+                                                                               \
+  static void bench_uthash_run_##K##_##V(const bench_Config *cfg,              \
+                                         bench_Result *result) {               \
+    bench_uthash_##K##_##V *table = NULL, *item, *next;                        \
+                                                                               \
+    K key;                                                                     \
+    V val;                                                                     \
+    memset(&key, 0, sizeof(key));                                              \
+    memset(&val, 0, sizeof(val));                                              \
+    size_t n = cfg->n, found = 0;                                              \
+    uint64_t rng = 0x2545F4914F6CDD1Dull;                                      \
+                                                                               \
+    BENCH_TIMED(&result->ops[BENCH_INSERT], n, j, {                            \
+      item = (bench_uthash_##K##_##V *)calloc(1, sizeof(*item));               \
+      bench_key_set(&item->key, sizeof(item->key), j);                         \
+      item->val = val;                                                         \
+      HASH_ADD(hh, table, key, sizeof(K), item);                               \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_HIT], cfg->lookups, j, {                    \
+      bench_key_set(&key, sizeof(key), bench_rand(&rng) % n);                  \
+      HASH_FIND(hh, table, &key, sizeof(K), item);                             \
+      if (item) {                                                              \
+        val = item->val;                                                       \
+        found++;                                                               \
+      }                                                                        \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_MISS], cfg->lookups, j, {                   \
+      bench_key_set(&key, sizeof(key), n + bench_rand(&rng) % n);              \
+      HASH_FIND(hh, table, &key, sizeof(K), item);                             \
+      found += item != NULL;                                                   \
+    });                                                                        \
+    BENCH_TIMED(&result->ops[BENCH_CHURN], cfg->lookups, j, {                  \
+      bench_key_set(&key, sizeof(key), j);                                     \
+      HASH_FIND(hh, table, &key, sizeof(K), item);                             \
+      if (item) {                                                              \
+        HASH_DEL(table, item);                                                 \
+        free(item);                                                            \
+      }                                                                        \
+      item = (bench_uthash_##K##_##V *)calloc(1, sizeof(*item));               \
+      bench_key_set(&item->key, sizeof(item->key), n + j);                     \
+      item->val = val;                                                         \
+      HASH_ADD(hh, table, key, sizeof(K), item);                               \
+    });                                                                        \
+    item = table;                                                              \
+    BENCH_TIMED(&result->ops[BENCH_ITERATE], HASH_COUNT(table), j, {           \
+      val = item->val;                                                         \
+      found += *(unsigned char *)&item->key;                                   \
+      item = (bench_uthash_##K##_##V *)item->hh.next;                          \
+    });                                                                        \
+    bench_sink = found;                                                        \
+    HASH_ITER(hh, table, item, next) {                                         \
+      HASH_DEL(table, item);                                                   \
+      free(item);                                                              \
+    }                                                                          \
+  }
+
+BENCH_UTHASH(bench_Key4, bench_Val8)
+BENCH_UTHASH(bench_Key8, bench_Val8)
+BENCH_UTHASH(bench_Key32, bench_Val8)
+BENCH_UTHASH(bench_Key128, bench_Val8)
+BENCH_UTHASH(bench_Key8, bench_Val64)
+BENCH_UTHASH(bench_Key32, bench_Val64)
+
+int main(int argc, char **argv) {
+  bench_Variant variants[] = {
+      {4, 8, bench_uthash_run_bench_Key4_bench_Val8},
+      {8, 8, bench_uthash_run_bench_Key8_bench_Val8},
+      {32, 8, bench_uthash_run_bench_Key32_bench_Val8},
+      {128, 8, bench_uthash_run_bench_Key128_bench_Val8},
+      {8, 64, bench_uthash_run_bench_Key8_bench_Val64},
+      {32, 64, bench_uthash_run_bench_Key32_bench_Val64},
+  };
+  bench_Sweep sweep = bench_sweep(argc, argv);
+  bench_header();
+  bench_main("uthash", variants, sizeof(variants) / sizeof(variants[0]),
+             &sweep);
+  return 0;
+}
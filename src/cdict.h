@@ -2,11 +2,36 @@
 #define CDICT_H
 
 #include <math.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CDICT__HAS_MMAP 1
+#define CDICT__HAS_THREADS 1
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/random.h>)
+#include <sys/random.h>
+#define CDICT__HAS_GETRANDOM 1
+#endif
+#endif
+#else
+#define CDICT__HAS_MMAP 0
+#define CDICT__HAS_THREADS 0
+#endif
+
+#ifndef CDICT__HAS_GETRANDOM
+#define CDICT__HAS_GETRANDOM 0
+#endif
 
 /* xxhash algorithm */
 
@@ -245,10 +270,6 @@ static cdict__XXH64_hash_t cdict__XXH64_h(const void *input, size_t len,
   return cdict__XXH64_endian_align_h((const cdict__xxh_u8 *)input, len, seed);
 }
 
-#ifndef CDICT__FORCE_INITIALIZE
-#define CDICT__FORCE_INITIALIZE 1
-#endif
-
 #ifndef CDICT__INITIAL_CAP
 #define CDICT__INITIAL_CAP 16
 #endif
@@ -257,6 +278,54 @@ static cdict__XXH64_hash_t cdict__XXH64_h(const void *input, size_t len,
 #define CDICT__DEFAULT_SEED 2718182
 #endif
 
+/* An insert probing past CDICT__RESEED_PSL buckets means keys collide under
+ * the current seed; the dict draws a new seed and rehashes, at most
+ * CDICT__MAX_RESEEDS times so that a hasher ignoring the seed cannot loop. */
+#ifndef CDICT__RESEED_PSL
+#define CDICT__RESEED_PSL 96
+#endif
+
+#ifndef CDICT__MAX_RESEEDS
+#define CDICT__MAX_RESEEDS 4
+#endif
+
+/* Seeds: every dict draws its own seed at init, a keyed hash of a counter
+ * under a process key from getrandom(), so collisions crafted against one
+ * dict or process do not carry over. CDICT__FIXED_SEED restores the
+ * reproducible CDICT__DEFAULT_SEED everywhere. */
+
+static uint64_t cdict__seed_key;
+static uint64_t cdict__seed_counter;
+
+static inline uint64_t cdict__random_seed(void) {
+#ifdef CDICT__FIXED_SEED
+  return CDICT__DEFAULT_SEED;
+#else
+  uint64_t key = __atomic_load_n(&cdict__seed_key, __ATOMIC_RELAXED);
+  if (key == 0) {
+#if CDICT__HAS_GETRANDOM
+    if (getrandom(&key, sizeof(key), GRND_NONBLOCK) != sizeof(key)) {
+      key = 0;
+    }
+#endif
+    if (key == 0) {
+      /* no entropy source: the clock and an address moved around by ASLR */
+      key = cdict__XXH64_avalanche((uint64_t)time(NULL) ^
+                                   ((uint64_t)clock() << 32) ^
+                                   (uint64_t)(uintptr_t)&key);
+    }
+    /* racing threads may each store a key, any of them will do */
+    __atomic_store_n(&cdict__seed_key, key | 1, __ATOMIC_RELAXED);
+    key |= 1;
+  }
+  uint64_t n = __atomic_add_fetch(&cdict__seed_counter, 1, __ATOMIC_RELAXED);
+  return cdict__XXH64(&n, sizeof(n), key);
+#endif
+}
+
+/* seed of the dict whose custom hasher is running, for the hash callbacks */
+static __thread uint64_t cdict__callback_seed = CDICT__DEFAULT_SEED;
+
 #ifndef CDICT__MAX_LOAD_FACTOR
 #define CDICT__MAX_LOAD_FACTOR 0.7
 #endif
@@ -265,15 +334,24 @@ static cdict__XXH64_hash_t cdict__XXH64_h(const void *input, size_t len,
 #define CDICT__MIN_LOAD_FACTOR 0.2
 #endif
 
+/* Load factors shared by every dict pointing at it with `cdict__set_config`;
+ * it must outlive them. Dicts without one use the defaults above. */
+typedef struct cdict_Config {
+  double max_load_factor;
+  double min_load_factor;
+} cdict_Config;
+
 #define cdict__ref(cdict) (&(cdict))
 
-#define cdict__set_max_load_factor(cdict, value)                               \
-  (((cdict)->cdict__max_load_factor_m) = (value))
-#define cdict__set_min_load_factor(cdict, value)                               \
-  (((cdict)->cdict__min_load_factor_m) = (value))
+#define cdict__config(cdict) ((cdict)->cdict__config_m)
+#define cdict__set_config(cdict, config) (((cdict)->cdict__config_m) = (config))
 
-#define cdict__max_load_factor(cdict) ((cdict)->cdict__max_load_factor_m)
-#define cdict__min_load_factor(cdict) ((cdict)->cdict__min_load_factor_m)
+#define cdict__max_load_factor(cdict)                                          \
+  (cdict__config(cdict) ? cdict__config(cdict)->max_load_factor                \
+                        : (CDICT__MAX_LOAD_FACTOR))
+#define cdict__min_load_factor(cdict)                                          \
+  (cdict__config(cdict) ? cdict__config(cdict)->min_load_factor                \
+                        : (CDICT__MIN_LOAD_FACTOR))
 
 #define cdict__seed(cdict) ((cdict)->cdict__seed_m)
 #define cdict__set_seed(cdict, value) (((cdict)->cdict__seed_m) = (value))
@@ -281,10 +359,6 @@ static cdict__XXH64_hash_t cdict__XXH64_h(const void *input, size_t len,
 #define cdict__vector_buckets(cdict) (((cdict)->cdict__buckets_m))
 #define cdict__vector_buckets_ref(cdict) (&((cdict)->cdict__buckets_m))
 
-#define cdict__vector_temp_buckets_ref(cdict)                                  \
-  (&((cdict)->cdict__temp_buckets_m))
-#define cdict__vector_temp_buckets(cdict) ((cdict)->cdict__temp_buckets_m)
-
 #define cdict__size(cdict) ((cdict)->cdict__bucket_size_m)
 #define cdict__set_size(cdict, value)                                          \
   (((cdict)->cdict__bucket_size_m) = (value))
@@ -317,25 +391,492 @@ static cdict__XXH64_hash_t cdict__XXH64_h(const void *input, size_t len,
 typedef uint8_t cdict__u8;
 typedef uint64_t cdict__u64;
 
+/* Allocator */
+
+/* Allocation hooks used for bucket storage. `realloc` is optional; when it is
+ * NULL growing falls back to alloc + memcpy + free. `zalloc` (optional) must
+ * return zero filled memory, e.g. calloc or fresh mmap pages; without it
+ * alloc + memset is used. A NULL allocator means libc calloc/realloc/free. */
+typedef struct cdict_Allocator {
+  void *(*alloc)(void *ctx, size_t size);
+  void (*free)(void *ctx, void *ptr, size_t size);
+  void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+  void *(*zalloc)(void *ctx, size_t size);
+  void *ctx;
+} cdict_Allocator;
+
+static inline void *cdict__allocator_alloc(const cdict_Allocator *allocator,
+                                           size_t size) {
+  if (allocator == NULL) {
+    return malloc(size);
+  }
+  return allocator->alloc(allocator->ctx, size);
+}
+
+static inline void *cdict__allocator_zalloc(const cdict_Allocator *allocator,
+                                            size_t size) {
+  if (allocator == NULL) {
+    return calloc(1, size);
+  }
+  if (allocator->zalloc) {
+    return allocator->zalloc(allocator->ctx, size);
+  }
+  void *mem = allocator->alloc(allocator->ctx, size);
+  if (mem) {
+    memset(mem, 0, size);
+  }
+  return mem;
+}
+
+static inline void cdict__allocator_free(const cdict_Allocator *allocator,
+                                         void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return;
+  }
+  if (allocator == NULL) {
+    free(ptr);
+    return;
+  }
+  allocator->free(allocator->ctx, ptr, size);
+}
+
+static inline void *cdict__allocator_realloc(const cdict_Allocator *allocator,
+                                             void *ptr, size_t old_size,
+                                             size_t new_size) {
+  if (allocator == NULL) {
+    return realloc(ptr, new_size);
+  }
+  if (allocator->realloc) {
+    return allocator->realloc(allocator->ctx, ptr, old_size, new_size);
+  }
+  /* as realloc, a failure leaves `ptr` allocated */
+  void *mem = allocator->alloc(allocator->ctx, new_size);
+  if (mem) {
+    if (ptr) {
+      memcpy(mem, ptr, (old_size < new_size) ? old_size : new_size);
+    }
+    cdict__allocator_free(allocator, ptr, old_size);
+  }
+  return mem;
+}
+
+/* Arena: bump allocator for dicts that are built and dropped together. Frees
+ * of individual blocks are no-ops (except for the most recent block), the
+ * memory is returned by `cdict_arena__free`. Not thread safe; use one arena
+ * per thread / request. */
+
+#ifndef CDICT__ARENA_CHUNK_SIZE
+#define CDICT__ARENA_CHUNK_SIZE (64 * 1024)
+#endif
+
+#define CDICT__ARENA_ALIGN 16
+
+typedef struct cdict_Arena_chunk {
+  struct cdict_Arena_chunk *cdict_arena__next_m;
+  size_t cdict_arena__cap_m;
+  size_t cdict_arena__used_m;
+  size_t cdict_arena__last_m;
+} cdict_Arena_chunk;
+
+typedef struct cdict_Arena {
+  cdict_Arena_chunk *cdict_arena__head_m;
+  size_t cdict_arena__chunk_size_m;
+  cdict_Allocator cdict_arena__allocator_m;
+} cdict_Arena;
+
+#define cdict_arena__allocator(arena) (&((arena)->cdict_arena__allocator_m))
+
+#define cdict_arena__align(size)                                               \
+  (((size) + (CDICT__ARENA_ALIGN - 1)) & ~((size_t)(CDICT__ARENA_ALIGN - 1)))
+
+#define cdict_arena__chunk_header_size                                         \
+  cdict_arena__align(sizeof(cdict_Arena_chunk))
+
+#define cdict_arena__chunk_data(chunk)                                         \
+  (((char *)(chunk)) + cdict_arena__chunk_header_size)
+
+static inline void *cdict_arena__alloc(void *ctx, size_t size) {
+  cdict_Arena *arena = (cdict_Arena *)ctx;
+  cdict_Arena_chunk *chunk = arena->cdict_arena__head_m;
+  size = cdict_arena__align(size);
+  if (chunk == NULL ||
+      (chunk->cdict_arena__cap_m - chunk->cdict_arena__used_m) < size) {
+    size_t cap = arena->cdict_arena__chunk_size_m;
+    if (cap < size) {
+      cap = size;
+    }
+    chunk = (cdict_Arena_chunk *)malloc(cdict_arena__chunk_header_size + cap);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    chunk->cdict_arena__next_m = arena->cdict_arena__head_m;
+    chunk->cdict_arena__cap_m = cap;
+    chunk->cdict_arena__used_m = 0;
+    chunk->cdict_arena__last_m = 0;
+    arena->cdict_arena__head_m = chunk;
+  }
+  chunk->cdict_arena__last_m = chunk->cdict_arena__used_m;
+  chunk->cdict_arena__used_m += size;
+  return cdict_arena__chunk_data(chunk) + chunk->cdict_arena__last_m;
+}
+
+/* only the most recent block of the current chunk can be given back */
+#define cdict_arena__is_last(chunk, ptr)                                       \
+  ((chunk) != NULL &&                                                          \
+   ((char *)(ptr)) ==                                                          \
+       (cdict_arena__chunk_data(chunk) + (chunk)->cdict_arena__last_m))
+
+static inline void cdict_arena__free_block(void *ctx, void *ptr, size_t size) {
+  (void)size;
+  cdict_Arena *arena = (cdict_Arena *)ctx;
+  cdict_Arena_chunk *chunk = arena->cdict_arena__head_m;
+  if (cdict_arena__is_last(chunk, ptr)) {
+    chunk->cdict_arena__used_m = chunk->cdict_arena__last_m;
+  }
+}
+
+static inline void *cdict_arena__realloc(void *ctx, void *ptr, size_t old_size,
+                                         size_t new_size) {
+  cdict_Arena *arena = (cdict_Arena *)ctx;
+  cdict_Arena_chunk *chunk = arena->cdict_arena__head_m;
+  if (ptr != NULL && cdict_arena__is_last(chunk, ptr) &&
+      (chunk->cdict_arena__cap_m - chunk->cdict_arena__last_m) >=
+          cdict_arena__align(new_size)) {
+    /* grow (or shrink) in place */
+    chunk->cdict_arena__used_m =
+        chunk->cdict_arena__last_m + cdict_arena__align(new_size);
+    return ptr;
+  }
+  void *mem = cdict_arena__alloc(ctx, new_size);
+  if (mem && ptr) {
+    memcpy(mem, ptr, (old_size < new_size) ? old_size : new_size);
+  }
+  return mem;
+}
+
+static inline void cdict_arena__init(cdict_Arena *arena, size_t chunk_size) {
+  arena->cdict_arena__head_m = NULL;
+  arena->cdict_arena__chunk_size_m =
+      chunk_size ? chunk_size : CDICT__ARENA_CHUNK_SIZE;
+  arena->cdict_arena__allocator_m.alloc = cdict_arena__alloc;
+  arena->cdict_arena__allocator_m.free = cdict_arena__free_block;
+  arena->cdict_arena__allocator_m.realloc = cdict_arena__realloc;
+  arena->cdict_arena__allocator_m.zalloc = NULL;
+  arena->cdict_arena__allocator_m.ctx = arena;
+}
+
+/* Releases every block handed out by the arena at once. Dicts allocated from
+ * it must not be used (or `cdict__free`d) afterwards. */
+static inline void cdict_arena__free(cdict_Arena *arena) {
+  cdict_Arena_chunk *chunk = arena->cdict_arena__head_m;
+  while (chunk) {
+    cdict_Arena_chunk *next = chunk->cdict_arena__next_m;
+    free(chunk);
+    chunk = next;
+  }
+  arena->cdict_arena__head_m = NULL;
+}
+
+/* Hugepage: bucket storage aligned to a cache line. Blocks of at least
+ * `threshold` bytes are mmap'ed in 2 MB multiples and advised with
+ * MADV_HUGEPAGE (or backed by explicit MAP_HUGETLB pages when requested and
+ * reserved by the system) to cut TLB misses on random probes. */
+
+#ifndef CDICT__CACHE_LINE_SIZE
+#define CDICT__CACHE_LINE_SIZE 64
+#endif
+
+#ifndef CDICT__HUGE_PAGE_SIZE
+#define CDICT__HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+
+#ifndef CDICT__HUGE_PAGE_THRESHOLD
+#define CDICT__HUGE_PAGE_THRESHOLD (4 * CDICT__HUGE_PAGE_SIZE)
+#endif
+
+typedef struct cdict_Hugepage {
+  size_t cdict_hugepage__threshold_m;
+  bool cdict_hugepage__explicit_m;
+  cdict_Allocator cdict_hugepage__allocator_m;
+} cdict_Hugepage;
+
+#define cdict_hugepage__allocator(hugepage)                                    \
+  (&((hugepage)->cdict_hugepage__allocator_m))
+
+#define cdict_hugepage__round(size, to) ((((size) + (to)-1) / (to)) * (to))
+
+#define cdict_hugepage__mapped(hugepage, size)                                 \
+  (CDICT__HAS_MMAP && ((size) >= ((hugepage)->cdict_hugepage__threshold_m)))
+
+static inline void *cdict_hugepage__alloc(void *ctx, size_t size) {
+  cdict_Hugepage *hugepage = (cdict_Hugepage *)ctx;
+#if CDICT__HAS_MMAP
+  if (cdict_hugepage__mapped(hugepage, size)) {
+    size_t len = cdict_hugepage__round(size, CDICT__HUGE_PAGE_SIZE);
+    void *mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (hugepage->cdict_hugepage__explicit_m) {
+      mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (mem == MAP_FAILED) {
+      /* no reserved huge pages: fall back to transparent huge pages */
+      mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0);
+      if (mem == MAP_FAILED) {
+        return NULL;
+      }
+#ifdef MADV_HUGEPAGE
+      madvise(mem, len, MADV_HUGEPAGE);
+#endif
+    }
+    return mem;
+  }
+  void *mem = NULL;
+  if (posix_memalign(&mem, CDICT__CACHE_LINE_SIZE,
+                     cdict_hugepage__round(size, CDICT__CACHE_LINE_SIZE))) {
+    return NULL;
+  }
+  return mem;
+#else
+  (void)hugepage;
+  return malloc(size);
+#endif
+}
+
+/* fresh anonymous mappings are already zero filled by the kernel */
+static inline void *cdict_hugepage__zalloc(void *ctx, size_t size) {
+  cdict_Hugepage *hugepage = (cdict_Hugepage *)ctx;
+  void *mem = cdict_hugepage__alloc(ctx, size);
+  if (mem && !cdict_hugepage__mapped(hugepage, size)) {
+    memset(mem, 0, size);
+  }
+  return mem;
+}
+
+static inline void cdict_hugepage__free(void *ctx, void *ptr, size_t size) {
+  cdict_Hugepage *hugepage = (cdict_Hugepage *)ctx;
+#if CDICT__HAS_MMAP
+  if (cdict_hugepage__mapped(hugepage, size)) {
+    munmap(ptr, cdict_hugepage__round(size, CDICT__HUGE_PAGE_SIZE));
+    return;
+  }
+#else
+  (void)hugepage;
+  (void)size;
+#endif
+  free(ptr);
+}
+
+/* `threshold` of 0 selects CDICT__HUGE_PAGE_THRESHOLD, `explicit_pages` asks
+ * for MAP_HUGETLB pages first. */
+static inline void cdict_hugepage__init(cdict_Hugepage *hugepage,
+                                        size_t threshold, bool explicit_pages) {
+  hugepage->cdict_hugepage__threshold_m =
+      threshold ? threshold : CDICT__HUGE_PAGE_THRESHOLD;
+  hugepage->cdict_hugepage__explicit_m = explicit_pages;
+  hugepage->cdict_hugepage__allocator_m.alloc = cdict_hugepage__alloc;
+  hugepage->cdict_hugepage__allocator_m.free = cdict_hugepage__free;
+  hugepage->cdict_hugepage__allocator_m.realloc = NULL;
+  hugepage->cdict_hugepage__allocator_m.zalloc = cdict_hugepage__zalloc;
+  hugepage->cdict_hugepage__allocator_m.ctx = hugepage;
+}
+
+/* Bloom: optional blocked Bloom filter in front of the buckets for miss heavy
+ * workloads. Every key sets CDICT__BLOOM_HASHES bits inside a single cache
+ * line sized block, so a negative lookup costs one (mostly cached) line
+ * instead of a probe sequence. Bits cannot be cleared: removals leave stale
+ * bits behind until the next resize rebuilds the filter. */
+
+#ifndef CDICT__BLOOM_SLOTS_PER_BLOCK
+#define CDICT__BLOOM_SLOTS_PER_BLOCK 64
+#endif
+
+#define CDICT__BLOOM_HASHES 6
+#define CDICT__BLOOM_BLOCK_WORDS (CDICT__CACHE_LINE_SIZE / sizeof(uint64_t))
+
+typedef struct cdict_Bloom {
+  void *cdict_bloom__mem_m;
+  uint64_t *cdict_bloom__bits_m;
+  size_t cdict_bloom__blocks_m;
+} cdict_Bloom;
+
+#define cdict_bloom__enabled(bloom) ((bloom)->cdict_bloom__bits_m != NULL)
+
+#define cdict_bloom__bytes(bloom)                                              \
+  (((bloom)->cdict_bloom__blocks_m + 1) * CDICT__CACHE_LINE_SIZE)
+
+static inline uint64_t *cdict_bloom__block(const cdict_Bloom *bloom,
+                                           cdict__u64 hash, cdict__u64 *bits) {
+  cdict__u64 mixed = cdict__XXH64_avalanche(hash);
+  size_t block = (size_t)(((unsigned __int128)mixed *
+                           bloom->cdict_bloom__blocks_m) >>
+                          64);
+  /* low bits of the product are independent of the block index */
+  *bits = mixed * cdict__XXH_PRIME64_1;
+  return bloom->cdict_bloom__bits_m + block * CDICT__BLOOM_BLOCK_WORDS;
+}
+
+static inline void cdict_bloom__add(cdict_Bloom *bloom, cdict__u64 hash) {
+  cdict__u64 bits;
+  uint64_t *block = cdict_bloom__block(bloom, hash, &bits);
+  for (int i = 0; i < CDICT__BLOOM_HASHES; i++, bits >>= 9) {
+    block[(bits & 511) >> 6] |= 1ULL << (bits & 63);
+  }
+}
+
+static inline bool cdict_bloom__maybe(const cdict_Bloom *bloom,
+                                      cdict__u64 hash) {
+  if (!cdict_bloom__enabled(bloom)) {
+    return true;
+  }
+  cdict__u64 bits;
+  const uint64_t *block = cdict_bloom__block(bloom, hash, &bits);
+  for (int i = 0; i < CDICT__BLOOM_HASHES; i++, bits >>= 9) {
+    if (!(block[(bits & 511) >> 6] & (1ULL << (bits & 63)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline void cdict_bloom__free(cdict_Bloom *bloom,
+                                     const cdict_Allocator *allocator) {
+  cdict__allocator_free(allocator, bloom->cdict_bloom__mem_m,
+                        cdict_bloom__bytes(bloom));
+  bloom->cdict_bloom__mem_m = NULL;
+  bloom->cdict_bloom__bits_m = NULL;
+  bloom->cdict_bloom__blocks_m = 0;
+}
+
+/* (Re)allocates an empty filter sized for `cap` buckets, one spare line pays
+ * for cache line alignment. */
+static inline bool cdict_bloom__reset(cdict_Bloom *bloom,
+                                      const cdict_Allocator *allocator,
+                                      size_t cap) {
+  size_t blocks = 1;
+  while (blocks * CDICT__BLOOM_SLOTS_PER_BLOCK < cap) {
+    blocks *= 2;
+  }
+  cdict_bloom__free(bloom, allocator);
+  bloom->cdict_bloom__blocks_m = blocks;
+  bloom->cdict_bloom__mem_m =
+      cdict__allocator_zalloc(allocator, cdict_bloom__bytes(bloom));
+  if (bloom->cdict_bloom__mem_m == NULL) {
+    bloom->cdict_bloom__blocks_m = 0;
+    return false;
+  }
+  uintptr_t address = (uintptr_t)bloom->cdict_bloom__mem_m;
+  address = (address + CDICT__CACHE_LINE_SIZE - 1) &
+            ~((uintptr_t)CDICT__CACHE_LINE_SIZE - 1);
+  bloom->cdict_bloom__bits_m = (uint64_t *)address;
+  return true;
+}
+
+/* Occupancy: one bit per bucket, set while it holds a live entry, so that
+ * iteration skips 64 empty or deleted buckets per word. Dicts opened with
+ * `cdict__mmap_open` have no bitmap and fall back to reading every psl. */
+
+#define cdict__occupied_bytes(cap) ((((cap) + 63) / 64) * sizeof(uint64_t))
+
+static inline void cdict__occupy(uint64_t *bits, size_t i) {
+  if (bits) {
+    bits[i >> 6] |= 1ULL << (i & 63);
+  }
+}
+
+static inline void cdict__vacate(uint64_t *bits, size_t i) {
+  if (bits) {
+    bits[i >> 6] &= ~(1ULL << (i & 63));
+  }
+}
+
+/* First live bucket at or after `from`, `cap` when there is none; buckets
+ * start with their psl so the fallback scan needs only the element size */
+static inline size_t cdict__next_occupied(const uint64_t *bits,
+                                          const void *elems, size_t elem_size,
+                                          size_t from, size_t cap) {
+  if (bits == NULL) {
+    while (from < cap &&
+           *(const int *)((const char *)elems + from * elem_size) <= 0) {
+      from++;
+    }
+    return from;
+  }
+  if (from >= cap) {
+    return cap;
+  }
+  size_t word = from >> 6;
+  uint64_t w = bits[word] & (~0ULL << (from & 63));
+  size_t words = (cap + 63) >> 6;
+  while (w == 0) {
+    if (++word >= words) {
+      return cap;
+    }
+    w = bits[word];
+  }
+  size_t i = (word << 6) + (size_t)__builtin_ctzll(w);
+  return i < cap ? i : cap;
+}
+
 #define cdict__bytes_compare(self, other, size) (memcmp(self, other, size) == 0)
 
+/* Counters kept by every dict for `cdict__stats`; hits and misses of
+ * get/contains only exist when compiled with CDICT__STATS, so every
+ * translation unit sharing a dict must agree on it. */
+typedef struct cdict_Counters {
+  size_t resizes;
+  size_t rehashes;
+  size_t reseeds;
+#ifdef CDICT__STATS
+  uint64_t hits;
+  uint64_t misses;
+#endif
+  /* set by an insert probing past CDICT__RESEED_PSL */
+  bool long_probe;
+} cdict_Counters;
+
+/* Zero sized marker at the end of every dict, telling CDict_multi dicts,
+ * whose values own heap arrays, from plain ones at compile time */
+typedef struct cdict_Plain_kind {
+  char cdict__unused_m;
+} cdict_Plain_kind;
+
+typedef struct cdict_Multi_kind {
+  char cdict__unused_m;
+} cdict_Multi_kind;
+
+/* for the macros that copy or compare values bytewise */
+#define cdict__reject_multi_(cdict)                                            \
+  _Static_assert(                                                              \
+      !__builtin_types_compatible_p(__typeof__((cdict)->cdict__kind_m[0]),     \
+                                    cdict_Multi_kind),                         \
+      "use the cdict_multi__ form of this operation on a CDict_multi")
+
 #define CDict(cdict_key_type_, cdict_value_type_)                              \
+  CDict_(cdict_key_type_, cdict_value_type_, cdict_Plain_kind)
+
+#define CDict_(cdict_key_type_, cdict_value_type_, cdict_kind_type_)           \
   cdict__Elem(cdict_key_type_, cdict_value_type_)                              \
       cdict_elem_##cdict_key_type_##cdict_value_type_;                         \
   cdict_Vector(cdict_elem_##cdict_key_type_##cdict_value_type_)                \
       buckets_##cdict_key_type_##cdict_value_type_;                            \
   typedef struct cdict_##cdict_key_type_##cdict_value_type_ {                  \
     buckets_##cdict_key_type_##cdict_value_type_ cdict__buckets_m;             \
-    double cdict__max_load_factor_m;                                           \
-    double cdict__min_load_factor_m;                                           \
+    const cdict_Config *cdict__config_m;                                       \
     uint64_t cdict__seed_m;                                                    \
     cdict_key_type_ cdict__key_m;                                              \
     cdict_value_type_ cdict__value_m;                                          \
     size_t cdict__bucket_size_m;                                               \
+    const cdict_Allocator *cdict__allocator_m;                                 \
+    cdict_Bloom cdict__bloom_m;                                                \
+    uint64_t *cdict__occupied_m;                                               \
+    cdict_Counters cdict__counters_m;                                          \
     bool (*cdict__compare_m)(cdict_key_type_ * self, cdict_key_type_ *other);  \
     cdict__u64 (*cdict__hash_m)(cdict_key_type_ * self,                        \
                                 cdict__u64 (*hash)(void *, size_t));           \
-    buckets_##cdict_key_type_##cdict_value_type_ cdict__temp_buckets_m;        \
+    cdict_kind_type_ cdict__kind_m[0];                                         \
   }
 
 #define cdict__set_hash(cdict, hasher) (((cdict)->cdict__hash_m) = (hasher))
@@ -343,26 +884,63 @@ typedef uint64_t cdict__u64;
 #define cdict__set_comparator(cdict, comparator)                               \
   (((cdict)->cdict__compare_m) = (comparator))
 
-#define cdict__init(cdict)                                                     \
+#define cdict__allocator(cdict) ((cdict)->cdict__allocator_m)
+#define cdict__bloom(cdict) (&((cdict)->cdict__bloom_m))
+#define cdict__occupied(cdict) ((cdict)->cdict__occupied_m)
+#define cdict__counters(cdict) (&((cdict)->cdict__counters_m))
+
+#ifdef CDICT__STATS
+#define cdict__count_lookup_(cdict, found)                                     \
+  ((found) ? cdict__counters(cdict)->hits++ : cdict__counters(cdict)->misses++)
+#define cdict__stats_lookups_(cdict, out)                                      \
+  ((out)->hits = cdict__counters(cdict)->hits,                                 \
+   (out)->misses = cdict__counters(cdict)->misses)
+#else
+#define cdict__count_lookup_(cdict, found) ((void)0)
+#define cdict__stats_lookups_(cdict, out) ((void)0)
+#endif
+
+#define cdict__occupied_free_(cdict)                                           \
+  do {                                                                         \
+    cdict__allocator_free(cdict__allocator(cdict), cdict__occupied(cdict),     \
+                          cdict__occupied_bytes(cdict__cap(cdict)));           \
+    cdict__occupied(cdict) = NULL;                                             \
+  } while (0)
+
+/* next live bucket at or after `from`, `cdict__cap` when there is none */
+#define cdict__next_occupied_(cdict, from)                                     \
+  cdict__next_occupied(                                                        \
+      cdict__occupied(cdict),                                                  \
+      cdict_vector__elem(cdict__vector_buckets_ref(cdict)),                    \
+      sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))), (from),   \
+      cdict__cap(cdict))
+
+#define cdict__init(cdict) cdict__init_with_allocator((cdict), NULL)
+
+/* Nothing is allocated until the first `cdict__add` */
+#define cdict__init_with_allocator(cdict, allocator)                           \
   do {                                                                         \
-    cdict__set_max_load_factor((cdict), (CDICT__MAX_LOAD_FACTOR));             \
-    cdict__set_min_load_factor((cdict), (CDICT__MIN_LOAD_FACTOR));             \
-    cdict__set_seed((cdict), (CDICT__DEFAULT_SEED));                           \
+    cdict__set_config((cdict), (NULL));                                        \
+    cdict__set_seed((cdict), cdict__random_seed());                            \
     cdict__set_size((cdict), (0));                                             \
     cdict__set_comparator((cdict), (NULL));                                    \
     cdict__set_hash((cdict), (NULL));                                          \
-    cdict_vector__init_with_cap(cdict__vector_buckets_ref(cdict),              \
-                                (CDICT__INITIAL_CAP));                         \
-    if (CDICT__FORCE_INITIALIZE) {                                             \
-      for (size_t cdict__i_m = 0;                                              \
-           cdict__i_m < cdict_vector__cap(cdict__vector_buckets_ref(cdict));   \
-           ((cdict__i_m)++)) {                                                 \
-        cdict__set_elem_psl(                                                   \
-            (cdict_vector__index(cdict__vector_buckets_ref(cdict),             \
-                                 (cdict__i_m))),                               \
-            0);                                                                \
-      }                                                                        \
-    }                                                                          \
+    (cdict__allocator(cdict)) = (allocator);                                   \
+    memset(cdict__bloom(cdict), 0, sizeof(*cdict__bloom(cdict)));              \
+    cdict__occupied(cdict) = NULL;                                             \
+    memset(cdict__counters(cdict), 0, sizeof(*cdict__counters(cdict)));        \
+    cdict_vector__init(cdict__vector_buckets_ref(cdict));                      \
+  } while (0)
+
+/* `dst` takes the allocator, config, seed, hasher and comparator of `src`,
+ * e.g. for per-thread partial dicts merged into `src` with `cdict__update` */
+#define cdict__init_like(dst, src)                                             \
+  do {                                                                         \
+    cdict__init_with_allocator((dst), cdict__allocator(src));                  \
+    cdict__set_config((dst), cdict__config(src));                              \
+    cdict__set_seed((dst), cdict__seed(src));                                  \
+    cdict__set_hash((dst), cdict__hash(src));                                  \
+    cdict__set_comparator((dst), cdict__compare(src));                         \
   } while (0)
 
 #define cdict__empty(vector_ref, index)                                        \
@@ -381,11 +959,11 @@ typedef uint64_t cdict__u64;
             (ref), sizeof(value))
 
 static cdict__u64 cdict__hash1_callback(void *memptr, size_t size) {
-  return cdict__XXH64(memptr, size, CDICT__DEFAULT_SEED);
+  return cdict__XXH64(memptr, size, cdict__callback_seed);
 }
 
 static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
-  return ((cdict__XXH64_h(memptr, size, CDICT__DEFAULT_SEED)) | 1);
+  return ((cdict__XXH64_h(memptr, size, cdict__callback_seed)) | 1);
 }
 
 #define cdict__get_(cdict, ref, key, buffer)                                   \
@@ -394,9 +972,11 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
     size_t cdict__iteration_m = 1;                                             \
     size_t cdict__index_m = 0;                                                 \
     bool cdict__found_m = false;                                               \
+    bool cdict__maybe_m =                                                      \
+        cdict_bloom__maybe(cdict__bloom(cdict), cdict__h1_m);                  \
     for (;;) {                                                                 \
-      /* break if we reach to the end */                                       \
-      if ((cdict__iteration_m - 1) >= cdict__cap(cdict)) {                     \
+      /* break if we reach to the end or the filter rules the key out */       \
+      if (!cdict__maybe_m || (cdict__iteration_m - 1) >= cdict__cap(cdict)) {  \
         break;                                                                 \
       }                                                                        \
       cdict__u64 cdict__h2_m = cdict__h2hash((cdict), (ref), (key));           \
@@ -421,6 +1001,7 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
         break;                                                                 \
       }                                                                        \
     }                                                                          \
+    cdict__count_lookup_((cdict), cdict__found_m);                             \
     (cdict__found_m);                                                          \
   })
 
@@ -436,9 +1017,11 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
     size_t cdict__iteration_m = 1;                                             \
     size_t cdict__index_m = 0;                                                 \
     bool cdict__found_m = false;                                               \
+    bool cdict__maybe_m =                                                      \
+        cdict_bloom__maybe(cdict__bloom(cdict), cdict__h1_m);                  \
     for (;;) {                                                                 \
-      /* break if we reach to the end */                                       \
-      if ((cdict__iteration_m - 1) >= cdict__cap(cdict)) {                     \
+      /* break if we reach to the end or the filter rules the key out */       \
+      if (!cdict__maybe_m || (cdict__iteration_m - 1) >= cdict__cap(cdict)) {  \
         break;                                                                 \
       }                                                                        \
       cdict__u64 cdict__h2_m = cdict__h2hash((cdict), (ref), (key));           \
@@ -461,6 +1044,7 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
         break;                                                                 \
       }                                                                        \
     }                                                                          \
+    cdict__count_lookup_((cdict), cdict__found_m);                             \
     (cdict__found_m);                                                          \
   })
 
@@ -472,58 +1056,185 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
 
 #define cdict__h2hash(cdict, ref, key)                                         \
   ((cdict__hash(cdict)))                                                       \
-      ? (((cdict__hash(cdict)))((ref), cdict__hash2_callback))                 \
+      ? ((cdict__callback_seed = cdict__seed(cdict)),                          \
+         ((cdict__hash(cdict)))((ref), cdict__hash2_callback))                 \
       : ((cdict__XXH64_h((ref), sizeof(key), cdict__seed(cdict))) | 1);
 
 #define cdict__h1hash(cdict, ref, key)                                         \
   ((cdict__hash(cdict)))                                                       \
-      ? (((cdict__hash(cdict)))((ref), cdict__hash1_callback))                 \
+      ? ((cdict__callback_seed = cdict__seed(cdict)),                          \
+         ((cdict__hash(cdict)))((ref), cdict__hash1_callback))                 \
       : (cdict__XXH64((ref), sizeof(key), (cdict__seed(cdict))))
 
 // NOTE: & works instead of % because cap is power of 2 i.e mod(cap , 2) = 0
 #define cdict__double_hash_index(ha1, ha2, i, cap) (((ha1) + ((i) * (ha2))) & (cap-1))
 
+/* makes room for one more entry; when the buckets cannot grow, a table with
+ * a free bucket left still takes it, past the max load factor */
+#define cdict__grow_for_add_(cdict)                                            \
+  ({                                                                           \
+    bool cdict__room_m = true;                                                 \
+    if ((cdict__cap(cdict) == 0) ||                                            \
+        (((double)(cdict__size(cdict)) / (cdict__cap(cdict))) >=               \
+         (cdict__max_load_factor(cdict)))) {                                   \
+      size_t cdict__grown_m =                                                  \
+          cdict__cap(cdict) ? (cdict__cap(cdict) * 2) : (CDICT__INITIAL_CAP);  \
+      cdict__room_m = cdict__resize((cdict), cdict__grown_m) ||                \
+                      cdict__size(cdict) < cdict__cap(cdict);                  \
+    }                                                                          \
+    (cdict__room_m);                                                           \
+  })
+
+/* false when the buckets could not grow, the dict is then unchanged */
 #define cdict__add(cdict, key, val)                                            \
+  ({                                                                           \
+    bool cdict__added_m = cdict__grow_for_add_(cdict);                         \
+    if (cdict__added_m) {                                                      \
+      (cdict__key(cdict)) = (key);                                             \
+      cdict__add_((cdict), cdict__vector_buckets_ref(cdict),                   \
+                  cdict__key_ref(cdict), cdict__key(cdict), (val));            \
+      cdict__reseed_if_long_(cdict);                                           \
+    }                                                                          \
+    (cdict__added_m);                                                          \
+  })
+
+#define cdict__note_psl_(cdict, psl)                                           \
   do {                                                                         \
-    if ((((double)(cdict__size(cdict)) / (cdict__cap(cdict))) >=               \
-         (cdict__max_load_factor(cdict)))) {                                   \
-      cdict__resize((cdict), (cdict__cap(cdict) * 2));                         \
+    if ((psl) > CDICT__RESEED_PSL) {                                           \
+      cdict__counters(cdict)->long_probe = true;                               \
     }                                                                          \
-    (cdict__key(cdict)) = (key);                                               \
-    cdict__add_((cdict), cdict__vector_buckets_ref(cdict),                     \
-                cdict__key_ref(cdict), cdict__key(cdict), (val));              \
   } while (0)
 
-#define cdict__add_(cdict, vector_ref, key_ref, key, value)                    \
+/* new seed and an in place rehash after a long probe, see CDICT__RESEED_PSL */
+#define cdict__reseed_if_long_(cdict)                                          \
   do {                                                                         \
-    cdict__u64 cdict__h1 = cdict__h1hash((cdict), (key_ref), (key));           \
-    size_t cdict__iteration_m = 1;                                             \
-    bool cdict__found_m = false;                                               \
-    size_t cdict__index_m;                                                     \
-    for (;;) {                                                                 \
-      cdict__u64 cdict__h2 = cdict__h2hash((cdict), (key_ref), (key));         \
-      cdict__index_m = cdict__double_hash_index(                               \
-          (cdict__h1), (cdict__h2), (cdict__iteration_m - 1),                  \
-          cdict_vector__cap(vector_ref));                                      \
-      (cdict__iteration_m)++;                                                  \
-      if (cdict__empty((vector_ref), (cdict__index_m)) ||                      \
-          cdict__tombstone((vector_ref), (cdict__index_m))) {                  \
-        break;                                                                 \
+    if (cdict__counters(cdict)->long_probe) {                                  \
+      if (cdict__counters(cdict)->reseeds < CDICT__MAX_RESEEDS) {              \
+        size_t cdict__reseed_cap_m = cdict__cap(cdict);                        \
+        uint64_t cdict__old_seed_m = cdict__seed(cdict);                       \
+        cdict__set_seed((cdict), cdict__random_seed());                        \
+        if (cdict__resize((cdict), cdict__reseed_cap_m)) {                     \
+          cdict__counters(cdict)->reseeds++;                                   \
+        } else {                                                               \
+          /* the entries are still placed for the old seed */                  \
+          cdict__set_seed((cdict), cdict__old_seed_m);                         \
+        }                                                                      \
       }                                                                        \
-      bool cdict__matches_m = cdict__matches((cdict), (vector_ref), (key_ref), \
-                                             (key), (cdict__index_m));         \
+      cdict__counters(cdict)->long_probe = false;                              \
+    }                                                                          \
+  } while (0)
+
+/* Probes `vector_ref` with the already computed hashes of the key. Returns the
+ * bucket holding the key (and sets `*found`), otherwise the first tombstone
+ * or empty bucket of the sequence, so that a key is never stored twice;
+ * `*psl` gets the probe length of the returned bucket. */
+#define cdict__slot_(cdict, vector_ref, ref, key, h1, h2, found, psl)          \
+  ({                                                                           \
+    size_t cdict__cap_m = cdict_vector__cap(vector_ref);                       \
+    size_t cdict__slot_m = SIZE_MAX;                                           \
+    *(found) = false;                                                          \
+    for (size_t cdict__i_m = 0; cdict__i_m < cdict__cap_m; cdict__i_m++) {     \
+      size_t cdict__at_m =                                                     \
+          cdict__double_hash_index((h1), (h2), cdict__i_m, cdict__cap_m);      \
+      bool cdict__empty_m = cdict__empty((vector_ref), cdict__at_m);           \
+      if (cdict__empty_m || cdict__tombstone((vector_ref), cdict__at_m)) {     \
+        if (cdict__slot_m == SIZE_MAX) {                                       \
+          cdict__slot_m = cdict__at_m;                                         \
+          *(psl) = cdict__i_m + 1;                                             \
+        }                                                                      \
+        if (cdict__empty_m) {                                                  \
+          break;                                                               \
+        }                                                                      \
+        continue;                                                              \
+      }                                                                        \
+      bool cdict__matches_m = cdict__matches((cdict), (vector_ref), (ref),     \
+                                             (key), cdict__at_m);              \
       if (cdict__matches_m) {                                                  \
-        cdict__found_m = true;                                                 \
+        cdict__slot_m = cdict__at_m;                                           \
+        *(psl) = cdict__i_m + 1;                                               \
+        *(found) = true;                                                       \
         break;                                                                 \
       }                                                                        \
     }                                                                          \
+    (cdict__slot_m);                                                           \
+  })
+
+#define cdict__add_(cdict, vector_ref, key_ref, key, value)                    \
+  do {                                                                         \
+    cdict__u64 cdict__h1 = cdict__h1hash((cdict), (key_ref), (key));           \
+    cdict__u64 cdict__h2 = cdict__h2hash((cdict), (key_ref), (key));           \
+    bool cdict__found_m;                                                       \
+    size_t cdict__psl_m = 0;                                                   \
+    if (cdict_bloom__enabled(cdict__bloom(cdict))) {                           \
+      cdict_bloom__add(cdict__bloom(cdict), cdict__h1);                        \
+    }                                                                          \
+    size_t cdict__index_m =                                                    \
+        cdict__slot_((cdict), (vector_ref), (key_ref), (key), cdict__h1,       \
+                     cdict__h2, &cdict__found_m, &cdict__psl_m);               \
     cdict__set_at_index((vector_ref), (cdict__index_m), (key), (value),        \
-                        (cdict__iteration_m));                                 \
+                        (int)(cdict__psl_m));                                  \
+    cdict__note_psl_((cdict), cdict__psl_m);                                   \
+    cdict__occupy(cdict__occupied(cdict), cdict__index_m);                     \
     if ((!(cdict__found_m))) {                                                 \
       cdict__set_size((cdict), ((cdict__size(cdict)) + 1));                    \
     }                                                                          \
   } while (0)
 
+/* Pointer to the value of `key`, which is added with a zero filled value
+ * when missing: one probe for read-modify-write updates. The pointer is valid
+ * until the next add or remove; NULL when the buckets could not grow. */
+#define cdict__entry(cdict, key)                                               \
+  ({                                                                           \
+    __typeof__(&(cdict)->cdict__value_m) cdict__entry_m = NULL;                \
+    if (cdict__grow_for_add_(cdict)) {                                         \
+      (cdict__key(cdict)) = (key);                                             \
+      cdict__entry_m =                                                         \
+          cdict__entry_((cdict), cdict__key_ref(cdict), cdict__key(cdict));    \
+    }                                                                          \
+    (cdict__entry_m);                                                          \
+  })
+
+#define cdict__entry_(cdict, key_ref, key)                                     \
+  ({                                                                           \
+    bool cdict__found_m;                                                       \
+    size_t cdict__psl_m = 0;                                                   \
+    size_t cdict__at_m = cdict__entry_slot_((cdict), (key_ref), (key),         \
+                                            &cdict__found_m, &cdict__psl_m);   \
+    if (!cdict__found_m) {                                                     \
+      __typeof__(cdict_vector__index(cdict__vector_buckets_ref(cdict), 0))     \
+          cdict__elem_m = cdict_vector__index(                                 \
+              cdict__vector_buckets_ref(cdict), cdict__at_m);                  \
+      cdict__set_key_at_index(cdict__vector_buckets_ref(cdict), cdict__at_m,   \
+                              (key));                                          \
+      memset(cdict__elem_val_ref(cdict__elem_m), 0,                            \
+             sizeof(cdict__elem_val(cdict__elem_m)));                          \
+      cdict__set_psl_at_index(cdict__vector_buckets_ref(cdict), cdict__at_m,   \
+                              (int)cdict__psl_m);                              \
+      cdict__note_psl_((cdict), cdict__psl_m);                                 \
+      cdict__occupy(cdict__occupied(cdict), cdict__at_m);                      \
+      cdict__set_size((cdict), cdict__size(cdict) + 1);                        \
+      if (cdict__counters(cdict)->long_probe) {                                \
+        /* the rehash moves the entry */                                       \
+        cdict__reseed_if_long_(cdict);                                         \
+        cdict__at_m = cdict__entry_slot_((cdict), (key_ref), (key),            \
+                                         &cdict__found_m, &cdict__psl_m);      \
+      }                                                                        \
+    }                                                                          \
+    cdict__elem_val_ref(                                                       \
+        cdict_vector__index(cdict__vector_buckets_ref(cdict), cdict__at_m));   \
+  })
+
+#define cdict__entry_slot_(cdict, key_ref, key, found, psl)                    \
+  ({                                                                           \
+    cdict__u64 cdict__h1_m = cdict__h1hash((cdict), (key_ref), (key));         \
+    cdict__u64 cdict__h2_m = cdict__h2hash((cdict), (key_ref), (key));         \
+    if (cdict_bloom__enabled(cdict__bloom(cdict))) {                           \
+      cdict_bloom__add(cdict__bloom(cdict), cdict__h1_m);                      \
+    }                                                                          \
+    cdict__slot_((cdict), cdict__vector_buckets_ref(cdict), (key_ref), (key),  \
+                 cdict__h1_m, cdict__h2_m, (found), (psl));                    \
+  })
+
 #define cdict__set_key_at_index(vector_ref, index, key)                        \
   (((cdict__elem_key(cdict_vector__index((vector_ref), (index)))) = (key)))
 #define cdict__set_value_at_index(vector_ref, index, value)                    \
@@ -538,44 +1249,76 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
     cdict__set_psl_at_index((vector_ref), (index), (psl));                     \
   } while (0)
 
+/* zero filled buckets are empty (psl 0), no initialization pass needed; the
+ * new buckets live on the stack until they replace the old ones. Returns
+ * false, leaving the dict as it was, when either array cannot be allocated */
 #define cdict__resize(cdict, cap)                                              \
-  do {                                                                         \
-    cdict_vector__init_with_cap(cdict__vector_temp_buckets_ref(cdict), (cap)); \
-    for (size_t cdict__i_m = 0;                                                \
-         cdict__i_m <                                                          \
-         cdict_vector__cap(cdict__vector_temp_buckets_ref(cdict));             \
-         (cdict__i_m)++) {                                                     \
-      (cdict__set_elem_psl(                                                    \
-          (cdict_vector__index(cdict__vector_temp_buckets_ref(cdict),          \
-                               (cdict__i_m))),                                 \
-          0));                                                                 \
-    }                                                                          \
-    /* reset the size of cdict */                                              \
-    cdict__set_size((cdict), 0);                                               \
-    size_t cdict__current_index = 0;                                           \
-    for (;;) {                                                                 \
-      if (cdict__current_index >= (cdict__cap(cdict))) {                       \
-        break;                                                                 \
+  ({                                                                           \
+    __typeof__(cdict__vector_buckets(cdict)) cdict__temp_buckets_m;            \
+    cdict_vector__init_zeroed_(&cdict__temp_buckets_m, (cap),                  \
+                               cdict__allocator(cdict));                       \
+    uint64_t *cdict__new_occupied_m = cdict__allocator_zalloc(                 \
+        cdict__allocator(cdict), cdict__occupied_bytes(cap));                  \
+    bool cdict__resized_m = cdict_vector__elem(&cdict__temp_buckets_m) &&      \
+                            cdict__new_occupied_m;                             \
+    if (!cdict__resized_m) {                                                   \
+      cdict_vector__free_(&cdict__temp_buckets_m, cdict__allocator(cdict));    \
+      cdict__allocator_free(cdict__allocator(cdict), cdict__new_occupied_m,    \
+                            cdict__occupied_bytes(cap));                       \
+    } else {                                                                   \
+      /* the filter is rebuilt by the reinsertion below */                     \
+      if (cdict_bloom__enabled(cdict__bloom(cdict))) {                         \
+        cdict_bloom__reset(cdict__bloom(cdict), cdict__allocator(cdict),       \
+                           cdict_vector__cap(&cdict__temp_buckets_m));         \
       }                                                                        \
-      int cdict__psl_m = cdict__elem_psl(cdict_vector__index(                  \
-          (cdict__vector_buckets_ref(cdict)), (cdict__current_index)));        \
-      if (((cdict__psl_m) == 0) || ((cdict__psl_m) == -1)) {                   \
+      /* reinsertion marks the new bitmap, the old one finds live entries */   \
+      uint64_t *cdict__old_occupied_m = cdict__occupied(cdict);                \
+      cdict__occupied(cdict) = cdict__new_occupied_m;                          \
+      /* reset the size of cdict */                                            \
+      cdict__set_size((cdict), 0);                                             \
+      cdict__counters(cdict)->resizes++;                                       \
+      size_t cdict__current_index = 0;                                         \
+      for (;;) {                                                               \
+        cdict__current_index = cdict__next_occupied(                           \
+            cdict__old_occupied_m,                                             \
+            cdict_vector__elem(cdict__vector_buckets_ref(cdict)),              \
+            sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),     \
+            cdict__current_index, cdict__cap(cdict));                          \
+        if (cdict__current_index >= (cdict__cap(cdict))) {                     \
+          break;                                                               \
+        }                                                                      \
+        cdict__add_(                                                           \
+            (cdict), (&cdict__temp_buckets_m),                                 \
+            cdict__elem_key_ref(cdict_vector__index(                           \
+                (cdict__vector_buckets_ref(cdict)), (cdict__current_index))),  \
+            cdict__elem_key(cdict_vector__index(                               \
+                (cdict__vector_buckets_ref(cdict)), (cdict__current_index))),  \
+            cdict__elem_val(cdict_vector__index(                               \
+                cdict__vector_buckets_ref(cdict), (cdict__current_index))));   \
         (cdict__current_index)++;                                              \
-        continue;                                                              \
       }                                                                        \
-      cdict__add_(                                                             \
-          (cdict), (cdict__vector_temp_buckets_ref(cdict)),                    \
-          cdict__elem_key_ref(cdict_vector__index(                             \
-              (cdict__vector_buckets_ref(cdict)), (cdict__current_index))),    \
-          cdict__elem_key(cdict_vector__index(                                 \
-              (cdict__vector_buckets_ref(cdict)), (cdict__current_index))),    \
-          cdict__elem_val(cdict_vector__index(                                 \
-              cdict__vector_buckets_ref(cdict), (cdict__current_index))));     \
-      (cdict__current_index)++;                                                \
+      cdict__counters(cdict)->rehashes += cdict__size(cdict);                  \
+      cdict__allocator_free(cdict__allocator(cdict), cdict__old_occupied_m,    \
+                            cdict__occupied_bytes(cdict__cap(cdict)));         \
+      cdict_vector__free_(cdict__vector_buckets_ref(cdict),                    \
+                          cdict__allocator(cdict));                            \
+      ((cdict__vector_buckets(cdict)) = (cdict__temp_buckets_m));              \
     }                                                                          \
-    cdict__free(cdict);                                                        \
-    ((cdict__vector_buckets(cdict)) = ((cdict__vector_temp_buckets(cdict))));  \
-  } while (0)
+    (cdict__resized_m);                                                        \
+  })
+
+/* Presizes buckets so that `n` entries fit without a resize; false when the
+ * buckets could not be allocated */
+#define cdict__reserve(cdict, n)                                               \
+  ({                                                                           \
+    size_t cdict__want_m = (CDICT__INITIAL_CAP);                               \
+    while (((double)(n) / (cdict__want_m)) >=                                  \
+           (cdict__max_load_factor(cdict))) {                                  \
+      cdict__want_m *= 2;                                                      \
+    }                                                                          \
+    (cdict__want_m <= cdict__cap(cdict) ||                                     \
+     cdict__resize((cdict), cdict__want_m));                                   \
+  })
 
 #define cdict__remove_(cdict, ref, key, vector_ref)                            \
   ({                                                                           \
@@ -584,8 +1327,11 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
     size_t cdict__iteration_m = 1;                                             \
     size_t cdict__index_m;                                                     \
     size_t cap = cdict_vector__cap(vector_ref);                                \
+    bool cdict__maybe_m =                                                      \
+        cdict_bloom__maybe(cdict__bloom(cdict), cdict__h1_m);                  \
     for (;;) {                                                                 \
-      if (((cdict__iteration_m)-1) >= cdict_vector__cap(vector_ref))           \
+      if (!cdict__maybe_m ||                                                   \
+          ((cdict__iteration_m)-1) >= cdict_vector__cap(vector_ref))           \
         break;                                                                 \
       cdict__u64 cdict__h2_m = cdict__h2hash((cdict), (ref), (key));           \
       cdict__index_m = cdict__double_hash_index(                               \
@@ -608,6 +1354,7 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
     if (cdict__found_m) {                                                      \
       (cdict__set_elem_psl(                                                    \
           (cdict_vector__index((vector_ref), (cdict__index_m))), -1));         \
+      cdict__vacate(cdict__occupied(cdict), cdict__index_m);                   \
       cdict__set_size((cdict), (cdict__size(cdict)) - 1);                      \
     }                                                                          \
     ((cdict__found_m));                                                        \
@@ -627,26 +1374,53 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
     cdict__remove((cdict), cdict__key(cdict));                                 \
   })
 
+/* buckets are released, the next `cdict__add` allocates again */
 #define cdict__clear(cdict)                                                    \
   do {                                                                         \
-    cdict__free(cdict);                                                        \
-    cdict_vector__init_with_cap(cdict__vector_buckets_ref(cdict),              \
-                                (CDICT__INITIAL_CAP));                         \
+    cdict__occupied_free_(cdict);                                              \
+    cdict_vector__free_(cdict__vector_buckets_ref(cdict),                      \
+                        cdict__allocator(cdict));                              \
+    if (cdict_bloom__enabled(cdict__bloom(cdict))) {                           \
+      memset(cdict__bloom(cdict)->cdict_bloom__bits_m, 0,                      \
+             cdict__bloom(cdict)->cdict_bloom__blocks_m *                      \
+                 CDICT__CACHE_LINE_SIZE);                                      \
+    }                                                                          \
     cdict__set_size((cdict), 0);                                               \
-                                                                               \
-    if (CDICT__FORCE_INITIALIZE) {                                             \
-      for (size_t cdict__i_m = 0;                                              \
-           cdict__i_m < (cdict_vector__cap(cdict__vector_buckets_ref(cdict))); \
-           (cdict__i_m)++) {                                                   \
-        (cdict__set_elem_psl(                                                  \
-            (cdict_vector__index(cdict__vector_buckets_ref(cdict),             \
-                                 (cdict__i_m))),                               \
-            0));                                                               \
+  } while (0)
+
+#define cdict__free(cdict)                                                     \
+  do {                                                                         \
+    cdict__occupied_free_(cdict);                                              \
+    cdict_vector__free_(cdict__vector_buckets_ref(cdict),                      \
+                        cdict__allocator(cdict));                              \
+    cdict_bloom__free(cdict__bloom(cdict), cdict__allocator(cdict));           \
+  } while (0)
+
+/* Puts a Bloom filter in front of the buckets, filled from the live entries.
+ * Returns false when the filter could not be allocated. */
+#define cdict__enable_bloom(cdict)                                             \
+  ({                                                                           \
+    bool cdict__ok_m = cdict_bloom__reset(                                     \
+        cdict__bloom(cdict), cdict__allocator(cdict),                          \
+        cdict__cap(cdict) ? cdict__cap(cdict) : (CDICT__INITIAL_CAP));         \
+    for (size_t cdict__i_m = 0; cdict__ok_m && cdict__i_m < cdict__cap(cdict); \
+         cdict__i_m++) {                                                       \
+      if (cdict__elem_psl(cdict_vector__index(                                 \
+              cdict__vector_buckets_ref(cdict), cdict__i_m)) > 0) {            \
+        cdict__u64 cdict__h1_m = cdict__h1hash(                                \
+            (cdict),                                                           \
+            cdict__elem_key_ref(cdict_vector__index(                           \
+                cdict__vector_buckets_ref(cdict), cdict__i_m)),                \
+            cdict__elem_key(cdict_vector__index(                               \
+                cdict__vector_buckets_ref(cdict), cdict__i_m)));               \
+        cdict_bloom__add(cdict__bloom(cdict), cdict__h1_m);                    \
       }                                                                        \
     }                                                                          \
-  } while (0)
+    (cdict__ok_m);                                                             \
+  })
 
-#define cdict__free(cdict) cdict_vector__free(cdict__vector_buckets_ref(cdict))
+/* Rebuilds the filter from the live entries, dropping bits of removed keys */
+#define cdict__bloom_rebuild(cdict) cdict__enable_bloom(cdict)
 
 /* Cdict_iterator */
 
@@ -682,20 +1456,18 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
   (((iterator)->cdict__current_count_m) >=                                     \
    ((cdict__size(((iterator)->cdict__m)))))
 
+/* moves the index onto the next live bucket */
+#define cdict_iterator__skip_(iterator)                                        \
+  cdict_iterator__set_index(                                                   \
+      (iterator),                                                              \
+      cdict__next_occupied_(cdict_iterator__m(iterator),                       \
+                            cdict_iterator__current_index(iterator)))
+
 #define cdict_iterator__next(iterator)                                         \
   ({                                                                           \
-    for (;;) {                                                                 \
-      int cdict__psl_m = cdict__elem_psl(cdict_vector__index(                  \
-          (cdict__vector_buckets_ref(cdict_iterator__m(iterator))),            \
-          cdict_iterator__current_index(iterator)));                           \
-      if (cdict__psl_m == 0 || cdict__psl_m == -1) {                           \
-        ((cdict_iterator__current_index(iterator))++);                         \
-        continue;                                                              \
-      }                                                                        \
-      ((cdict_iterator__current_count(iterator))++);                           \
-      ((cdict_iterator__current_index(iterator))++);                           \
-      break;                                                                   \
-    }                                                                          \
+    cdict_iterator__skip_(iterator);                                           \
+    (cdict_iterator__current_count(iterator))++;                               \
+    (cdict_iterator__current_index(iterator))++;                               \
     (cdict__elem_key(cdict_vector__index(                                      \
         (cdict__vector_buckets_ref((cdict_iterator__m(iterator)))),            \
         (cdict_iterator__current_index(iterator) - 1))));                      \
@@ -703,18 +1475,9 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
 
 #define cdict_iterator__next_val(iterator)                                     \
   ({                                                                           \
-    for (;;) {                                                                 \
-      int cdict__psl_m = cdict__elem_psl(cdict_vector__index(                  \
-          (cdict__vector_buckets_ref(cdict_iterator__m(iterator))),            \
-          cdict_iterator__current_index(iterator)));                           \
-      if ((cdict__psl_m == 0) || (cdict__psl_m == -1)) {                       \
-        ((cdict_iterator__current_index(iterator))++);                         \
-        continue;                                                              \
-      }                                                                        \
-      (cdict_iterator__current_count(iterator))++;                             \
-      (cdict_iterator__current_index(iterator))++;                             \
-      break;                                                                   \
-    }                                                                          \
+    cdict_iterator__skip_(iterator);                                           \
+    (cdict_iterator__current_count(iterator))++;                               \
+    (cdict_iterator__current_index(iterator))++;                               \
     (cdict__elem_val(cdict_vector__index(                                      \
         (cdict__vector_buckets_ref((cdict_iterator__m(iterator)))),            \
         (cdict_iterator__current_index(iterator) - 1))));                      \
@@ -722,32 +1485,3412 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
 
 #define cdict_iterator__next_keyval(iterator, value)                           \
   ({                                                                           \
-    for (;;) {                                                                 \
-      int cdict__psl_m = cdict__elem_psl(cdict_vector__index(                  \
-          (cdict__vector_buckets_ref(cdict_iterator__m(iterator))),            \
-          cdict_iterator__current_index(iterator)));                           \
-      if ((cdict__psl_m == 0) || (cdict__psl_m == -1)) {                       \
-        ((cdict_iterator__current_index(iterator))++);                         \
-        continue;                                                              \
-      }                                                                        \
-      (*(value)) = (cdict__elem_val(cdict_vector__index(                       \
-          (cdict__vector_buckets_ref((cdict_iterator__m(iterator)))),          \
-          (cdict_iterator__current_index(iterator)))));                        \
-      (cdict_iterator__current_count(iterator))++;                             \
-      (cdict_iterator__current_index(iterator))++;                             \
-      break;                                                                   \
-    }                                                                          \
+    cdict_iterator__skip_(iterator);                                           \
+    (*(value)) = (cdict__elem_val(cdict_vector__index(                         \
+        (cdict__vector_buckets_ref((cdict_iterator__m(iterator)))),            \
+        (cdict_iterator__current_index(iterator)))));                          \
+    (cdict_iterator__current_count(iterator))++;                               \
+    (cdict_iterator__current_index(iterator))++;                               \
     (cdict__elem_key(cdict_vector__index(                                      \
         (cdict__vector_buckets_ref((cdict_iterator__m(iterator)))),            \
         (cdict_iterator__current_index(iterator) - 1))));                      \
   })
 
+/* Copies up to `max` of the next entries into the `keys` and `vals` arrays and
+ * returns how many were copied, 0 once the iterator is done */
+#define cdict_iterator__next_batch(iterator, keys, vals, max)                  \
+  ({                                                                           \
+    size_t cdict__n_m = 0;                                                     \
+    size_t cdict__max_m = (max);                                               \
+    while (cdict__n_m < cdict__max_m && !cdict_iterator__done(iterator)) {     \
+      cdict_iterator__skip_(iterator);                                         \
+      __typeof__(cdict_vector__index(                                          \
+          cdict__vector_buckets_ref(cdict_iterator__m(iterator)), 0))          \
+          cdict__elem_m = cdict_vector__index(                                 \
+              cdict__vector_buckets_ref(cdict_iterator__m(iterator)),          \
+              cdict_iterator__current_index(iterator));                        \
+      (keys)[cdict__n_m] = cdict__elem_key(cdict__elem_m);                     \
+      (vals)[cdict__n_m] = cdict__elem_val(cdict__elem_m);                     \
+      (cdict_iterator__current_count(iterator))++;                             \
+      (cdict_iterator__current_index(iterator))++;                             \
+      cdict__n_m++;                                                            \
+    }                                                                          \
+    (cdict__n_m);                                                              \
+  })
+
+/* false when an add failed, the later keys are then not added */
 #define cdict__fromkeys(cdict, buffer, size, defval)                           \
-  do {                                                                         \
-    for (size_t cdict__i_m = 0; cdict__i_m < (size); (cdict__i_m)++) {         \
-      cdict__add(cdict, (buffer[(cdict__i_m)]), (defval));                     \
+  ({                                                                           \
+    bool cdict__all_m = true;                                                  \
+    for (size_t cdict__i_m = 0; cdict__all_m && cdict__i_m < (size);           \
+         (cdict__i_m)++) {                                                     \
+      cdict__all_m = cdict__add(cdict, (buffer[(cdict__i_m)]), (defval));      \
     }                                                                          \
-  } while (0)
+    (cdict__all_m);                                                            \
+  })
+
+/* Stats: a snapshot of how well the table is doing. Probe lengths come from
+ * the stored psl, 1 for an entry in its home bucket. */
+
+#ifndef CDICT__PSL_HISTOGRAM_SIZE
+#define CDICT__PSL_HISTOGRAM_SIZE 16
+#endif
+
+typedef struct cdict_Stats {
+  size_t size;
+  size_t cap;
+  size_t tombstones;
+  size_t max_psl;
+  double mean_psl;
+  /* entries with probe length i + 1, the last slot counts all longer ones */
+  size_t psl_histogram[CDICT__PSL_HISTOGRAM_SIZE];
+  /* bucket array reallocations and the entries they reinserted */
+  size_t resizes;
+  size_t rehashes;
+  /* new seeds drawn after long probes, see CDICT__RESEED_PSL */
+  size_t reseeds;
+  /* get/contains outcomes, zero unless built with CDICT__STATS */
+  uint64_t hits;
+  uint64_t misses;
+} cdict_Stats;
+
+static inline void cdict__stats_scan(const void *elems, size_t elem_size,
+                                     size_t cap, cdict_Stats *out) {
+  size_t live = 0, total = 0;
+  for (size_t i = 0; i < cap; i++) {
+    int psl = *(const int *)((const char *)elems + i * elem_size);
+    if (psl < 0) {
+      out->tombstones++;
+      continue;
+    }
+    if (psl == 0) {
+      continue;
+    }
+    size_t len = (size_t)psl;
+    out->max_psl = len > out->max_psl ? len : out->max_psl;
+    out->psl_histogram[len < CDICT__PSL_HISTOGRAM_SIZE
+                           ? len - 1
+                           : CDICT__PSL_HISTOGRAM_SIZE - 1]++;
+    total += len;
+    live++;
+  }
+  out->mean_psl = live ? (double)total / (double)live : 0;
+}
+
+#define cdict__stats(cdict, out)                                               \
+  do {                                                                         \
+    cdict_Stats *cdict__out_m = (out);                                         \
+    memset(cdict__out_m, 0, sizeof(*cdict__out_m));                            \
+    cdict__out_m->size = cdict__size(cdict);                                   \
+    cdict__out_m->cap = cdict__cap(cdict);                                     \
+    cdict__stats_scan(                                                         \
+        cdict_vector__elem(cdict__vector_buckets_ref(cdict)),                  \
+        sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),         \
+        cdict__cap(cdict), cdict__out_m);                                      \
+    cdict__out_m->resizes = cdict__counters(cdict)->resizes;                   \
+    cdict__out_m->rehashes = cdict__counters(cdict)->rehashes;                 \
+    cdict__out_m->reseeds = cdict__counters(cdict)->reseeds;                   \
+    cdict__stats_lookups_(cdict, cdict__out_m);                                \
+  } while (0)
+
+#define cdict__reset_stats(cdict)                                              \
+  memset(cdict__counters(cdict), 0, sizeof(*cdict__counters(cdict)))
+
+/* Memory: bytes held by a dict and where they go. `cdict__Elem` pads the int
+ * psl up to the alignment of the key and value, so small pairs can spend as
+ * much on padding as on data. */
+
+typedef struct cdict_Memory {
+  /* buckets, occupancy bitmap and bloom filter */
+  size_t allocated;
+  size_t buckets;
+  size_t elem_size;
+  /* per bucket, beyond the psl, the key and the value */
+  size_t elem_padding;
+  /* keys and values of the live entries */
+  size_t live;
+  /* `elem_padding` over every bucket */
+  size_t padding;
+  /* empty and deleted buckets */
+  size_t unused;
+  /* held at once while the next resize doubles the buckets: old and new
+   * buckets and bitmaps are all live until the old ones are freed, the
+   * filter is replaced by one twice its size */
+  size_t resize_peak;
+} cdict_Memory;
+
+static inline cdict_Memory cdict__memory_of(size_t cap, size_t size,
+                                            size_t elem_size, size_t payload,
+                                            bool bitmap, size_t bloom_bytes) {
+  cdict_Memory memory;
+  memory.elem_size = elem_size;
+  memory.elem_padding = elem_size - sizeof(int) - payload;
+  memory.buckets = cap * elem_size;
+  memory.allocated = memory.buckets + bloom_bytes +
+                     (bitmap ? cdict__occupied_bytes(cap) : 0);
+  memory.live = size * payload;
+  memory.padding = cap * memory.elem_padding;
+  memory.unused = (cap - size) * elem_size;
+  size_t next = cap ? cap * 2 : CDICT__INITIAL_CAP;
+  memory.resize_peak = memory.buckets + next * elem_size +
+                       cdict__occupied_bytes(cap) +
+                       cdict__occupied_bytes(next) + bloom_bytes * 2;
+  return memory;
+}
+
+/* Buckets of a dict opened with `cdict__mmap_open` are mapped from the file
+ * but counted the same way. */
+#define cdict__memory_usage(cdict)                                             \
+  cdict__memory_of(                                                            \
+      cdict__cap(cdict), cdict__size(cdict),                                   \
+      sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),           \
+      sizeof(cdict__key(cdict)) + sizeof((cdict)->cdict__value_m),             \
+      cdict__occupied(cdict) != NULL,                                          \
+      cdict_bloom__enabled(cdict__bloom(cdict))                                \
+          ? cdict_bloom__bytes(cdict__bloom(cdict))                            \
+          : 0)
+
+/* Update: merges `src` into `dst` (same dict type) */
+
+typedef enum cdict_Update_policy {
+  CDICT_UPDATE_OVERWRITE, /* values of `src` win */
+  CDICT_UPDATE_KEEP,      /* values already in `dst` win */
+  CDICT_UPDATE_COMBINE    /* `combine(&dst_val, &src_val, ctx)` merges them */
+} cdict_Update_policy;
+
+/* `dst` is presized once and every key of `src` is hashed at most once. An
+ * empty `dst` sharing hasher and comparator with `src` takes its seed and
+ * copies the buckets as they are, no key is hashed at all; when those copies
+ * cannot be allocated it falls back to inserting. A non-empty `dst` reuses
+ * bucket positions only when it also shares the seed (see `cdict__init_like`)
+ * and, after presizing, has no more buckets than `src`: a key in its home
+ * bucket of `src` then has its home at the same index masked to `dst`'s
+ * capacity, and is stored there unhashed when that bucket is empty. Any other
+ * merge hashes every key. `on_conflict` runs for keys in both, with
+ * `cdict__dst_val_m` and `cdict__src_val_m` pointing at the two values.
+ * False when `dst` could not grow, the keys of `src` not yet merged are then
+ * missing from it. */
+#define cdict__update_(dst, src, on_conflict)                                  \
+  ({                                                                           \
+    cdict__reject_multi_(dst);                                                 \
+    bool cdict__copied_m = false;                                              \
+    bool cdict__merged_m = true;                                               \
+    if (cdict__size(dst) == 0 && cdict__cap(src) > 0 &&                        \
+        cdict__occupied(src) != NULL &&                                        \
+        cdict__hash(dst) == cdict__hash(src) &&                                \
+        cdict__compare(dst) == cdict__compare(src)) {                          \
+      size_t cdict__bytes_m =                                                  \
+          cdict__cap(src) *                                                    \
+          sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(src)));         \
+      size_t cdict__bits_bytes_m = cdict__occupied_bytes(cdict__cap(src));     \
+      void *cdict__elems_m =                                                   \
+          cdict__allocator_alloc(cdict__allocator(dst), cdict__bytes_m);       \
+      void *cdict__bits_m =                                                    \
+          cdict__allocator_alloc(cdict__allocator(dst), cdict__bits_bytes_m);  \
+      if (cdict__elems_m != NULL && cdict__bits_m != NULL) {                   \
+        cdict__occupied_free_(dst);                                            \
+        cdict_vector__free_(cdict__vector_buckets_ref(dst),                    \
+                            cdict__allocator(dst));                            \
+        cdict_vector__set_elem(cdict__vector_buckets_ref(dst),                 \
+                               cdict__elems_m);                                \
+        cdict__vector_buckets_ref(dst)->cdict_vector__cap_m =                  \
+            cdict__cap(src);                                                   \
+        memcpy(cdict__elems_m,                                                 \
+               cdict_vector__elem(cdict__vector_buckets_ref(src)),             \
+               cdict__bytes_m);                                                \
+        cdict__occupied(dst) = (uint64_t *)cdict__bits_m;                      \
+        memcpy(cdict__bits_m, cdict__occupied(src), cdict__bits_bytes_m);      \
+        cdict__set_size((dst), cdict__size(src));                              \
+        cdict__set_seed((dst), cdict__seed(src));                              \
+        if (cdict_bloom__enabled(cdict__bloom(dst))) {                         \
+          cdict__bloom_rebuild(dst);                                           \
+        }                                                                      \
+        cdict__copied_m = true;                                                \
+      } else {                                                                 \
+        if (cdict__elems_m != NULL) {                                          \
+          cdict__allocator_free(cdict__allocator(dst), cdict__elems_m,         \
+                                cdict__bytes_m);                               \
+        }                                                                      \
+        if (cdict__bits_m != NULL) {                                           \
+          cdict__allocator_free(cdict__allocator(dst), cdict__bits_m,          \
+                                cdict__bits_bytes_m);                          \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+    if (!cdict__copied_m) {                                                    \
+      cdict__reserve((dst), cdict__size(dst) + cdict__size(src));              \
+      bool cdict__same_hash_m = cdict__seed(dst) == cdict__seed(src) &&        \
+                                cdict__hash(dst) == cdict__hash(src) &&        \
+                                cdict__compare(dst) == cdict__compare(src);    \
+      for (size_t cdict__j_m = cdict__next_occupied_((src), 0);                \
+           cdict__j_m < cdict__cap(src);                                       \
+           cdict__j_m = cdict__next_occupied_((src), cdict__j_m + 1)) {        \
+        /* a no-op unless the reservation failed */                            \
+        if (!cdict__grow_for_add_(dst)) {                                      \
+          cdict__merged_m = false;                                             \
+          break;                                                               \
+        }                                                                      \
+        __typeof__(cdict_vector__index(cdict__vector_buckets_ref(src), 0))     \
+            cdict__from_m = cdict_vector__index(                               \
+                cdict__vector_buckets_ref(src), cdict__j_m);                   \
+        size_t cdict__home_m = cdict__j_m & (cdict__cap(dst) - 1);             \
+        if (cdict__same_hash_m && cdict__cap(dst) <= cdict__cap(src) &&        \
+            cdict__elem_psl(cdict__from_m) == 1 &&                             \
+            cdict__empty(cdict__vector_buckets_ref(dst), cdict__home_m)) {     \
+          if (cdict_bloom__enabled(cdict__bloom(dst))) {                       \
+            cdict__u64 cdict__home_h1_m =                                      \
+                cdict__h1hash((dst), cdict__elem_key_ref(cdict__from_m),       \
+                              cdict__elem_key(cdict__from_m));                 \
+            cdict_bloom__add(cdict__bloom(dst), cdict__home_h1_m);             \
+          }                                                                    \
+          cdict__set_at_index(cdict__vector_buckets_ref(dst), cdict__home_m,   \
+                              cdict__elem_key(cdict__from_m),                  \
+                              cdict__elem_val(cdict__from_m), 1);              \
+          cdict__occupy(cdict__occupied(dst), cdict__home_m);                  \
+          cdict__set_size((dst), cdict__size(dst) + 1);                        \
+          continue;                                                            \
+        }                                                                      \
+        cdict__u64 cdict__h1_m =                                               \
+            cdict__h1hash((dst), cdict__elem_key_ref(cdict__from_m),           \
+                          cdict__elem_key(cdict__from_m));                     \
+        cdict__u64 cdict__h2_m =                                               \
+            cdict__h2hash((dst), cdict__elem_key_ref(cdict__from_m),           \
+                          cdict__elem_key(cdict__from_m));                     \
+        bool cdict__found_m;                                                   \
+        size_t cdict__psl_m = 0;                                               \
+        size_t cdict__at_m = cdict__slot_(                                     \
+            (dst), cdict__vector_buckets_ref(dst),                             \
+            cdict__elem_key_ref(cdict__from_m),                                \
+            cdict__elem_key(cdict__from_m), cdict__h1_m, cdict__h2_m,          \
+            &cdict__found_m, &cdict__psl_m);                                   \
+        if (!cdict__found_m) {                                                 \
+          if (cdict_bloom__enabled(cdict__bloom(dst))) {                       \
+            cdict_bloom__add(cdict__bloom(dst), cdict__h1_m);                  \
+          }                                                                    \
+          cdict__set_at_index(cdict__vector_buckets_ref(dst), cdict__at_m,     \
+                              cdict__elem_key(cdict__from_m),                  \
+                              cdict__elem_val(cdict__from_m),                  \
+                              (int)cdict__psl_m);                              \
+          cdict__note_psl_((dst), cdict__psl_m);                               \
+          cdict__occupy(cdict__occupied(dst), cdict__at_m);                    \
+          cdict__set_size((dst), cdict__size(dst) + 1);                        \
+        } else {                                                               \
+          __typeof__(&(dst)->cdict__value_m) cdict__dst_val_m =                \
+              cdict__elem_val_ref(cdict_vector__index(                         \
+                  cdict__vector_buckets_ref(dst), cdict__at_m));               \
+          __typeof__(&(dst)->cdict__value_m) cdict__src_val_m =                \
+              cdict__elem_val_ref(cdict__from_m);                              \
+          (void)cdict__dst_val_m;                                              \
+          (void)cdict__src_val_m;                                              \
+          on_conflict;                                                         \
+        }                                                                      \
+      }                                                                        \
+      cdict__reseed_if_long_(dst);                                             \
+    }                                                                          \
+    (cdict__merged_m);                                                         \
+  })
+
+#define cdict__update(dst, src, policy)                                        \
+  cdict__update_((dst), (src), if ((policy) == CDICT_UPDATE_OVERWRITE) {       \
+    *cdict__dst_val_m = *cdict__src_val_m;                                     \
+  })
+
+/* conflicts are merged with `combine(&dst_val, &src_val, ctx)` */
+#define cdict__update_with(dst, src, combine, ctx)                             \
+  cdict__update_((dst), (src),                                                 \
+                 (combine)(cdict__dst_val_m, cdict__src_val_m, (ctx)))
+
+/* Equality and diff: values are compared bytewise. When both dicts have the
+ * same capacity, seed and hasher, a key usually sits in the same bucket on
+ * both sides, so that bucket is tried before probing. Every dict draws its
+ * own seed at init, so dicts built independently only share one when it is
+ * arranged with `cdict__set_seed(&b, cdict__seed(&a))` before filling. */
+
+/* bucket of the key in `cdict` or SIZE_MAX; `hint` is tried first */
+#define cdict__find_hinted_(cdict, ref, key, hint)                             \
+  ({                                                                           \
+    size_t cdict__hit_m = SIZE_MAX;                                            \
+    size_t cdict__hint_m = (hint);                                             \
+    if (cdict__hint_m < cdict__cap(cdict) &&                                   \
+        cdict__elem_psl(cdict_vector__index(cdict__vector_buckets_ref(cdict),  \
+                                            cdict__hint_m)) > 0) {             \
+      bool cdict__matches_m =                                                  \
+          cdict__matches((cdict), cdict__vector_buckets_ref(cdict), (ref),     \
+                         (key), cdict__hint_m);                                \
+      if (cdict__matches_m) {                                                  \
+        cdict__hit_m = cdict__hint_m;                                          \
+      }                                                                        \
+    }                                                                          \
+    if (cdict__hit_m == SIZE_MAX && cdict__cap(cdict) > 0) {                   \
+      cdict__u64 cdict__h1_m = cdict__h1hash((cdict), (ref), (key));           \
+      cdict__u64 cdict__h2_m = cdict__h2hash((cdict), (ref), (key));           \
+      bool cdict__found_m;                                                     \
+      size_t cdict__psl_m;                                                     \
+      size_t cdict__at_m = cdict__slot_(                                       \
+          (cdict), cdict__vector_buckets_ref(cdict), (ref), (key),             \
+          cdict__h1_m, cdict__h2_m, &cdict__found_m, &cdict__psl_m);           \
+      if (cdict__found_m) {                                                    \
+        cdict__hit_m = cdict__at_m;                                            \
+      }                                                                        \
+    }                                                                          \
+    (cdict__hit_m);                                                            \
+  })
+
+#define cdict__same_layout_(a, b)                                              \
+  (cdict__cap(a) == cdict__cap(b) && cdict__seed(a) == cdict__seed(b) &&       \
+   cdict__hash(a) == cdict__hash(b))
+
+#define cdict__vals_equal_(a_elem, b_elem)                                     \
+  cdict__bytes_compare(cdict__elem_val_ref(a_elem),                            \
+                       cdict__elem_val_ref(b_elem),                            \
+                       sizeof(cdict__elem_val(a_elem)))
+
+/* true when both dicts hold the same keys with the same values */
+#define cdict__equals(a, b)                                                    \
+  ({                                                                           \
+    cdict__reject_multi_(a);                                                   \
+    bool cdict__equal_m = cdict__size(a) == cdict__size(b);                    \
+    bool cdict__hinted_m = cdict__same_layout_((a), (b));                      \
+    for (size_t cdict__j_m = cdict__next_occupied_((a), 0);                    \
+         cdict__equal_m && cdict__j_m < cdict__cap(a);                         \
+         cdict__j_m = cdict__next_occupied_((a), cdict__j_m + 1)) {            \
+      __typeof__(cdict_vector__index(cdict__vector_buckets_ref(a), 0))         \
+          cdict__elem_m =                                                      \
+              cdict_vector__index(cdict__vector_buckets_ref(a), cdict__j_m);   \
+      size_t cdict__at_m = cdict__find_hinted_(                                \
+          (b), cdict__elem_key_ref(cdict__elem_m),                             \
+          cdict__elem_key(cdict__elem_m),                                      \
+          cdict__hinted_m ? cdict__j_m : SIZE_MAX);                            \
+      cdict__equal_m =                                                         \
+          cdict__at_m != SIZE_MAX &&                                           \
+          cdict__vals_equal_(cdict__elem_m,                                    \
+                             cdict_vector__index(                              \
+                                 cdict__vector_buckets_ref(b), cdict__at_m));  \
+    }                                                                          \
+    (cdict__equal_m);                                                          \
+  })
+
+/* Reports how `b` differs from `a` through `on_added(&key, &b_val, ctx)`,
+ * `on_removed(&key, &a_val, ctx)` and `on_changed(&key, &a_val, &b_val, ctx)`;
+ * returns the number of differences */
+#define cdict__diff(a, b, on_added, on_removed, on_changed, ctx)               \
+  ({                                                                           \
+    cdict__reject_multi_(a);                                                   \
+    size_t cdict__diffs_m = 0;                                                 \
+    size_t cdict__common_m = 0;                                                \
+    bool cdict__hinted_m = cdict__same_layout_((a), (b));                      \
+    for (size_t cdict__j_m = cdict__next_occupied_((a), 0);                    \
+         cdict__j_m < cdict__cap(a);                                           \
+         cdict__j_m = cdict__next_occupied_((a), cdict__j_m + 1)) {            \
+      __typeof__(cdict_vector__index(cdict__vector_buckets_ref(a), 0))         \
+          cdict__elem_m =                                                      \
+              cdict_vector__index(cdict__vector_buckets_ref(a), cdict__j_m);   \
+      size_t cdict__at_m = cdict__find_hinted_(                                \
+          (b), cdict__elem_key_ref(cdict__elem_m),                             \
+          cdict__elem_key(cdict__elem_m),                                      \
+          cdict__hinted_m ? cdict__j_m : SIZE_MAX);                            \
+      if (cdict__at_m == SIZE_MAX) {                                           \
+        (on_removed)(cdict__elem_key_ref(cdict__elem_m),                       \
+                     cdict__elem_val_ref(cdict__elem_m), (ctx));               \
+        cdict__diffs_m++;                                                      \
+        continue;                                                              \
+      }                                                                        \
+      cdict__common_m++;                                                       \
+      __typeof__(cdict__elem_m) cdict__other_m =                               \
+          cdict_vector__index(cdict__vector_buckets_ref(b), cdict__at_m);      \
+      if (!cdict__vals_equal_(cdict__elem_m, cdict__other_m)) {                \
+        (on_changed)(cdict__elem_key_ref(cdict__elem_m),                       \
+                     cdict__elem_val_ref(cdict__elem_m),                       \
+                     cdict__elem_val_ref(cdict__other_m), (ctx));              \
+        cdict__diffs_m++;                                                      \
+      }                                                                        \
+    }                                                                          \
+    /* keys only in `b`, skipped when every key of `b` was matched */          \
+    for (size_t cdict__j_m = cdict__next_occupied_((b), 0);                    \
+         cdict__common_m < cdict__size(b) && cdict__j_m < cdict__cap(b);       \
+         cdict__j_m = cdict__next_occupied_((b), cdict__j_m + 1)) {            \
+      __typeof__(cdict_vector__index(cdict__vector_buckets_ref(b), 0))         \
+          cdict__elem_m =                                                      \
+              cdict_vector__index(cdict__vector_buckets_ref(b), cdict__j_m);   \
+      size_t cdict__at_m = cdict__find_hinted_(                                \
+          (a), cdict__elem_key_ref(cdict__elem_m),                             \
+          cdict__elem_key(cdict__elem_m),                                      \
+          cdict__hinted_m ? cdict__j_m : SIZE_MAX);                            \
+      if (cdict__at_m == SIZE_MAX) {                                           \
+        (on_added)(cdict__elem_key_ref(cdict__elem_m),                         \
+                   cdict__elem_val_ref(cdict__elem_m), (ctx));                 \
+        cdict__diffs_m++;                                                      \
+      }                                                                        \
+    }                                                                          \
+    (cdict__diffs_m);                                                          \
+  })
+
+/* CDict_set: set of keys on the dict engine. The value is an empty struct
+ * (zero sized in GNU C), so a bucket costs only its psl and the key while
+ * probing, hashing, resizing and iteration are shared with CDict. */
+
+typedef struct cdict_Unit {
+} cdict_Unit;
+
+#define CDict_set(cdict_key_type_) CDict(cdict_key_type_, cdict_Unit)
+
+#define cdict_set__init(set) cdict__init(set)
+#define cdict_set__init_with_allocator(set, allocator)                         \
+  cdict__init_with_allocator((set), (allocator))
+#define cdict_set__size(set) cdict__size(set)
+#define cdict_set__reserve(set, n) cdict__reserve((set), (n))
+#define cdict_set__add(set, key) cdict__add((set), (key), (cdict_Unit){})
+#define cdict_set__contains(set, key) cdict__contains((set), (key))
+#define cdict_set__remove(set, key) cdict__remove((set), (key))
+#define cdict_set__clear(set) cdict__clear(set)
+#define cdict_set__free(set) cdict__free(set)
+
+#define cdict_set__smaller_(a, b) (cdict__size(a) <= cdict__size(b) ? (a) : (b))
+
+#define cdict_set__key_at_(set, i)                                             \
+  cdict__elem_key(cdict_vector__index(cdict__vector_buckets_ref(set), (i)))
+
+/* walks the smaller set and probes the larger one */
+#define cdict_set__intersect_count(a, b)                                       \
+  ({                                                                           \
+    __typeof__(a) cdict__small_m = cdict_set__smaller_((a), (b));              \
+    __typeof__(a) cdict__large_m = cdict__small_m == (a) ? (b) : (a);          \
+    size_t cdict__n_m = 0;                                                     \
+    for (size_t cdict__j_m = cdict__next_occupied_(cdict__small_m, 0);         \
+         cdict__j_m < cdict__cap(cdict__small_m);                              \
+         cdict__j_m = cdict__next_occupied_(cdict__small_m, cdict__j_m + 1)) { \
+      cdict__n_m += cdict__contains(cdict__large_m,                            \
+                                    cdict_set__key_at_(cdict__small_m,         \
+                                                       cdict__j_m));           \
+    }                                                                          \
+    (cdict__n_m);                                                              \
+  })
+
+#define cdict_set__is_disjoint(a, b)                                           \
+  ({                                                                           \
+    __typeof__(a) cdict__small_m = cdict_set__smaller_((a), (b));              \
+    __typeof__(a) cdict__large_m = cdict__small_m == (a) ? (b) : (a);          \
+    bool cdict__disjoint_m = true;                                             \
+    for (size_t cdict__j_m = cdict__next_occupied_(cdict__small_m, 0);         \
+         cdict__disjoint_m && cdict__j_m < cdict__cap(cdict__small_m);         \
+         cdict__j_m = cdict__next_occupied_(cdict__small_m, cdict__j_m + 1)) { \
+      cdict__disjoint_m = !cdict__contains(                                    \
+          cdict__large_m, cdict_set__key_at_(cdict__small_m, cdict__j_m));     \
+    }                                                                          \
+    (cdict__disjoint_m);                                                       \
+  })
+
+/* `res` gets the keys in both sets */
+#define cdict_set__intersect(res, a, b)                                        \
+  do {                                                                         \
+    __typeof__(a) cdict__small_m = cdict_set__smaller_((a), (b));              \
+    __typeof__(a) cdict__large_m = cdict__small_m == (a) ? (b) : (a);          \
+    cdict__reserve((res), cdict__size(res) + cdict__size(cdict__small_m));     \
+    for (size_t cdict__j_m = cdict__next_occupied_(cdict__small_m, 0);         \
+         cdict__j_m < cdict__cap(cdict__small_m);                              \
+         cdict__j_m = cdict__next_occupied_(cdict__small_m, cdict__j_m + 1)) { \
+      if (cdict__contains(cdict__large_m,                                      \
+                          cdict_set__key_at_(cdict__small_m, cdict__j_m))) {   \
+        cdict_set__add((res), cdict_set__key_at_(cdict__small_m, cdict__j_m)); \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+/* `a` gets the keys of `b` */
+#define cdict_set__update(a, b) cdict__update((a), (b), CDICT_UPDATE_KEEP)
+
+/* `res` gets the keys in either set */
+#define cdict_set__union(res, a, b)                                            \
+  do {                                                                         \
+    cdict__reserve((res), cdict__size(res) + cdict__size(a) + cdict__size(b)); \
+    cdict_set__update((res), (a));                                             \
+    cdict_set__update((res), (b));                                             \
+  } while (0)
+
+/* `res` gets the keys of `a` missing from `b` */
+#define cdict_set__difference(res, a, b)                                       \
+  do {                                                                         \
+    cdict__reserve((res), cdict__size(res) + cdict__size(a));                  \
+    for (size_t cdict__j_m = cdict__next_occupied_((a), 0);                    \
+         cdict__j_m < cdict__cap(a);                                           \
+         cdict__j_m = cdict__next_occupied_((a), cdict__j_m + 1)) {            \
+      if (!cdict__contains((b), cdict_set__key_at_((a), cdict__j_m))) {        \
+        cdict_set__add((res), cdict_set__key_at_((a), cdict__j_m));            \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+#define cdict_set__drop_at_(set, i)                                            \
+  do {                                                                         \
+    cdict__set_psl_at_index(cdict__vector_buckets_ref(set), (i), -1);          \
+    cdict__vacate(cdict__occupied(set), (i));                                  \
+    cdict__set_size((set), cdict__size(set) - 1);                              \
+  } while (0)
+
+/* keeps the keys of `a` that are also in `b`, allocates nothing */
+#define cdict_set__intersect_update(a, b)                                      \
+  do {                                                                         \
+    for (size_t cdict__j_m = cdict__next_occupied_((a), 0);                    \
+         cdict__j_m < cdict__cap(a);                                           \
+         cdict__j_m = cdict__next_occupied_((a), cdict__j_m + 1)) {            \
+      if (!cdict__contains((b), cdict_set__key_at_((a), cdict__j_m))) {        \
+        cdict_set__drop_at_((a), cdict__j_m);                                  \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+/* removes the keys of `b` from `a`, walking the smaller side */
+#define cdict_set__difference_update(a, b)                                     \
+  do {                                                                         \
+    if (cdict__size(b) < cdict__size(a)) {                                     \
+      for (size_t cdict__j_m = cdict__next_occupied_((b), 0);                  \
+           cdict__j_m < cdict__cap(b);                                         \
+           cdict__j_m = cdict__next_occupied_((b), cdict__j_m + 1)) {          \
+        cdict__remove((a), cdict_set__key_at_((b), cdict__j_m));               \
+      }                                                                        \
+    } else {                                                                   \
+      for (size_t cdict__j_m = cdict__next_occupied_((a), 0);                  \
+           cdict__j_m < cdict__cap(a);                                         \
+           cdict__j_m = cdict__next_occupied_((a), cdict__j_m + 1)) {          \
+        if (cdict__contains((b), cdict_set__key_at_((a), cdict__j_m))) {       \
+          cdict_set__drop_at_((a), cdict__j_m);                                \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+/* CDict_multi: every key maps to a growable array of values. The first
+ * CDICT__MULTI_INLINE values live inside the bucket, later ones move to one
+ * heap array, so a key's values are always contiguous and an append costs
+ * one probe (`cdict__entry`) plus an amortized push. */
+
+#ifndef CDICT__MULTI_INLINE
+#define CDICT__MULTI_INLINE 4
+#endif
+
+#define CDict_multi(cdict_key_type_, cdict_value_type_)                        \
+  typedef struct cdict_multi_##cdict_key_type_##cdict_value_type_ {            \
+    uint32_t cdict_multi__len_m;                                               \
+    /* 0 while the values are inline */                                        \
+    uint32_t cdict_multi__cap_m;                                               \
+    union {                                                                    \
+      cdict_value_type_ *cdict_multi__heap_m;                                  \
+      cdict_value_type_ cdict_multi__inline_m[CDICT__MULTI_INLINE];            \
+    };                                                                         \
+  } cdict_multi_##cdict_key_type_##cdict_value_type_;                          \
+  CDict_(cdict_key_type_, cdict_multi_##cdict_key_type_##cdict_value_type_,    \
+         cdict_Multi_kind)
+
+/* on a value array of the multimap */
+#define cdict_multi__len(values) ((values)->cdict_multi__len_m)
+#define cdict_multi__data(values)                                              \
+  ((values)->cdict_multi__cap_m ? (values)->cdict_multi__heap_m                \
+                                : (values)->cdict_multi__inline_m)
+
+/* doubles the value array, moving inline values to the heap */
+static inline bool cdict_multi__grow(const cdict_Allocator *allocator,
+                                     void *storage, uint32_t *cap, uint32_t len,
+                                     size_t elem_size) {
+  size_t old = *cap ? *cap : CDICT__MULTI_INLINE;
+  void *heap;
+  if (*cap) {
+    heap = cdict__allocator_realloc(allocator, *(void **)storage,
+                                    old * elem_size, old * 2 * elem_size);
+  } else {
+    heap = cdict__allocator_alloc(allocator, old * 2 * elem_size);
+    if (heap) {
+      memcpy(heap, storage, len * elem_size);
+    }
+  }
+  if (heap == NULL) {
+    return false;
+  }
+  *(void **)storage = heap;
+  *cap = (uint32_t)(old * 2);
+  return true;
+}
+
+#define cdict_multi__release_(multi, values)                                   \
+  do {                                                                         \
+    if ((values)->cdict_multi__cap_m) {                                        \
+      cdict__allocator_free(cdict__allocator(multi),                           \
+                            (values)->cdict_multi__heap_m,                     \
+                            (values)->cdict_multi__cap_m *                     \
+                                sizeof(*(values)->cdict_multi__heap_m));       \
+    }                                                                          \
+  } while (0)
+
+#define cdict_multi__init(multi) cdict__init(multi)
+#define cdict_multi__init_with_allocator(multi, allocator)                     \
+  cdict__init_with_allocator((multi), (allocator))
+
+/* number of keys */
+#define cdict_multi__size(multi) cdict__size(multi)
+
+/* appends `value` to the values of `key`; false when the buckets or the
+ * value array could not grow, the value is then not added */
+#define cdict_multi__add(multi, key, value)                                    \
+  ({                                                                           \
+    __typeof__(&(multi)->cdict__value_m) cdict__values_m =                     \
+        cdict__entry((multi), (key));                                          \
+    bool cdict__ok_m = cdict__values_m != NULL;                                \
+    if (cdict__ok_m) {                                                         \
+      uint32_t cdict__cap_m = cdict__values_m->cdict_multi__cap_m              \
+                                  ? cdict__values_m->cdict_multi__cap_m        \
+                                  : CDICT__MULTI_INLINE;                       \
+      cdict__ok_m =                                                            \
+          cdict__values_m->cdict_multi__len_m < cdict__cap_m ||                \
+          cdict_multi__grow(cdict__allocator(multi),                           \
+                            &cdict__values_m->cdict_multi__heap_m,             \
+                            &cdict__values_m->cdict_multi__cap_m,              \
+                            cdict__values_m->cdict_multi__len_m,               \
+                            sizeof(*cdict__values_m->cdict_multi__heap_m));    \
+    }                                                                          \
+    if (cdict__ok_m) {                                                         \
+      cdict_multi__data(cdict__values_m)                                       \
+          [cdict__values_m->cdict_multi__len_m++] = (value);                   \
+    }                                                                          \
+    (cdict__ok_m);                                                             \
+  })
+
+/* values of `key` as one array of `*count` values, NULL when it has none;
+ * valid until the next add or remove */
+#define cdict_multi__values(multi, key, count)                                 \
+  ({                                                                           \
+    (cdict__key(multi)) = (key);                                               \
+    size_t cdict__at_m = cdict__find_hinted_(                                  \
+        (multi), cdict__key_ref(multi), cdict__key(multi), SIZE_MAX);          \
+    __typeof__(&(multi)->cdict__value_m) cdict__values_m =                     \
+        cdict__at_m == SIZE_MAX                                                \
+            ? NULL                                                             \
+            : cdict__elem_val_ref(cdict_vector__index(                         \
+                  cdict__vector_buckets_ref(multi), cdict__at_m));             \
+    *(count) = cdict__values_m ? cdict__values_m->cdict_multi__len_m : 0;      \
+    (cdict__values_m ? cdict_multi__data(cdict__values_m) : NULL);             \
+  })
+
+#define cdict_multi__count(multi, key)                                         \
+  ({                                                                           \
+    size_t cdict__count_m;                                                     \
+    cdict_multi__values((multi), (key), &cdict__count_m);                      \
+    (cdict__count_m);                                                          \
+  })
+
+/* removes the key with all its values */
+#define cdict_multi__remove(multi, key)                                        \
+  ({                                                                           \
+    (cdict__key(multi)) = (key);                                               \
+    size_t cdict__at_m = cdict__find_hinted_(                                  \
+        (multi), cdict__key_ref(multi), cdict__key(multi), SIZE_MAX);          \
+    if (cdict__at_m != SIZE_MAX) {                                             \
+      cdict_multi__release_(                                                   \
+          (multi), cdict__elem_val_ref(cdict_vector__index(                    \
+                       cdict__vector_buckets_ref(multi), cdict__at_m)));       \
+      cdict__remove_((multi), cdict__key_ref(multi), cdict__key(multi),        \
+                     cdict__vector_buckets_ref(multi));                        \
+    }                                                                          \
+    (cdict__at_m != SIZE_MAX);                                                 \
+  })
+
+/* Appends the values of every key of `src` (another multimap, not `dst`)
+ * to the same key of `dst`, copying the value arrays; false when one of
+ * them could not grow */
+#define cdict_multi__update(dst, src)                                          \
+  ({                                                                           \
+    bool cdict__all_m = true;                                                  \
+    cdict__reserve((dst), cdict__size(dst) + cdict__size(src));                \
+    for (size_t cdict__j_m = cdict__next_occupied_((src), 0);                  \
+         cdict__j_m < cdict__cap(src);                                         \
+         cdict__j_m = cdict__next_occupied_((src), cdict__j_m + 1)) {          \
+      __typeof__(cdict_vector__index(cdict__vector_buckets_ref(src), 0))       \
+          cdict__from_m =                                                      \
+              cdict_vector__index(cdict__vector_buckets_ref(src), cdict__j_m); \
+      __typeof__(&(src)->cdict__value_m) cdict__from_vals_m =                  \
+          cdict__elem_val_ref(cdict__from_m);                                  \
+      for (uint32_t cdict__v_m = 0;                                            \
+           cdict__v_m < cdict__from_vals_m->cdict_multi__len_m;                \
+           cdict__v_m++) {                                                     \
+        if (!cdict_multi__add(                                                 \
+                (dst), cdict__elem_key(cdict__from_m),                         \
+                cdict_multi__data(cdict__from_vals_m)[cdict__v_m])) {          \
+          cdict__all_m = false;                                                \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+    (cdict__all_m);                                                            \
+  })
+
+/* true when both multimaps hold the same keys with the same values in the
+ * same order; values are compared bytewise, not the array pointers */
+#define cdict_multi__equals(a, b)                                              \
+  ({                                                                           \
+    bool cdict__equal_m = cdict__size(a) == cdict__size(b);                    \
+    bool cdict__hinted_m = cdict__same_layout_((a), (b));                      \
+    for (size_t cdict__j_m = cdict__next_occupied_((a), 0);                    \
+         cdict__equal_m && cdict__j_m < cdict__cap(a);                         \
+         cdict__j_m = cdict__next_occupied_((a), cdict__j_m + 1)) {            \
+      __typeof__(cdict_vector__index(cdict__vector_buckets_ref(a), 0))         \
+          cdict__elem_m =                                                      \
+              cdict_vector__index(cdict__vector_buckets_ref(a), cdict__j_m);   \
+      size_t cdict__at_m = cdict__find_hinted_(                                \
+          (b), cdict__elem_key_ref(cdict__elem_m),                             \
+          cdict__elem_key(cdict__elem_m),                                      \
+          cdict__hinted_m ? cdict__j_m : SIZE_MAX);                            \
+      __typeof__(&(a)->cdict__value_m) cdict__a_vals_m =                       \
+          cdict__elem_val_ref(cdict__elem_m);                                  \
+      __typeof__(&(b)->cdict__value_m) cdict__b_vals_m =                       \
+          cdict__at_m == SIZE_MAX                                              \
+              ? NULL                                                           \
+              : cdict__elem_val_ref(cdict_vector__index(                       \
+                    cdict__vector_buckets_ref(b), cdict__at_m));               \
+      cdict__equal_m =                                                         \
+          cdict__b_vals_m != NULL &&                                           \
+          cdict__a_vals_m->cdict_multi__len_m ==                               \
+              cdict__b_vals_m->cdict_multi__len_m &&                           \
+          memcmp(cdict_multi__data(cdict__a_vals_m),                           \
+                 cdict_multi__data(cdict__b_vals_m),                           \
+                 cdict__a_vals_m->cdict_multi__len_m *                         \
+                     sizeof(*cdict__a_vals_m->cdict_multi__heap_m)) == 0;      \
+    }                                                                          \
+    (cdict__equal_m);                                                          \
+  })
+
+#define cdict_multi__release_all_(multi)                                       \
+  do {                                                                         \
+    for (size_t cdict__j_m = cdict__next_occupied_((multi), 0);                \
+         cdict__j_m < cdict__cap(multi);                                       \
+         cdict__j_m = cdict__next_occupied_((multi), cdict__j_m + 1)) {        \
+      cdict_multi__release_(                                                   \
+          (multi), cdict__elem_val_ref(cdict_vector__index(                    \
+                       cdict__vector_buckets_ref(multi), cdict__j_m)));        \
+    }                                                                          \
+  } while (0)
+
+#define cdict_multi__clear(multi)                                              \
+  do {                                                                         \
+    cdict_multi__release_all_(multi);                                          \
+    cdict__clear(multi);                                                       \
+  } while (0)
+
+#define cdict_multi__free(multi)                                               \
+  do {                                                                         \
+    cdict_multi__release_all_(multi);                                          \
+    cdict__free(multi);                                                        \
+  } while (0)
+
+/* Aggregation: in place updates of numeric values through `cdict__entry`,
+ * one probe per event instead of a get and an add. When a missing key cannot
+ * be added because the buckets could not grow, nothing is stored and the
+ * result is computed as for a new key. */
+
+/* adds `delta` to the value of `key` (0 when missing), returns the sum */
+#define cdict__incr(cdict, key, delta)                                         \
+  ({                                                                           \
+    __typeof__((cdict)->cdict__value_m) cdict__lost_m = {0};                   \
+    __typeof__(&(cdict)->cdict__value_m) cdict__slot_m =                       \
+        cdict__entry((cdict), (key));                                          \
+    (*(cdict__slot_m ? cdict__slot_m : &cdict__lost_m) += (delta));            \
+  })
+
+#define cdict__sum(cdict, key, value) cdict__incr((cdict), (key), (value))
+
+/* keeps the smaller of the stored value and `value`, returns it; a missing
+ * key takes `value` */
+#define cdict__min(cdict, key, value)                                          \
+  cdict__keep_((cdict), (key), (value), <)
+
+#define cdict__max(cdict, key, value)                                          \
+  cdict__keep_((cdict), (key), (value), >)
+
+#define cdict__keep_(cdict, key, value, op)                                    \
+  ({                                                                           \
+    __typeof__((cdict)->cdict__value_m) cdict__new_m = (value);                \
+    size_t cdict__size_m = cdict__size(cdict);                                 \
+    __typeof__(&(cdict)->cdict__value_m) cdict__slot_m =                       \
+        cdict__entry((cdict), (key));                                          \
+    if (!cdict__slot_m) {                                                      \
+      cdict__slot_m = &cdict__new_m;                                           \
+    } else if (cdict__size(cdict) != cdict__size_m ||                          \
+               cdict__new_m op(*cdict__slot_m)) {                              \
+      *cdict__slot_m = cdict__new_m;                                           \
+    }                                                                          \
+    (*cdict__slot_m);                                                          \
+  })
+
+/* Top k: a min-heap of bucket indices keyed by value keeps the k largest
+ * values seen so far, O(n log k) without sorting the whole dict. */
+
+#define cdict__top_val_(cdict, heap, i)                                        \
+  cdict__elem_val(                                                             \
+      cdict_vector__index(cdict__vector_buckets_ref(cdict), (heap)[(i)]))
+
+#define cdict__top_swap_(heap, i, j)                                           \
+  do {                                                                         \
+    size_t cdict__tmp_m = (heap)[(i)];                                         \
+    (heap)[(i)] = (heap)[(j)];                                                 \
+    (heap)[(j)] = cdict__tmp_m;                                                \
+  } while (0)
+
+#define cdict__top_sift_down_(cdict, heap, n, from)                            \
+  do {                                                                         \
+    size_t cdict__at_m = (from);                                               \
+    for (;;) {                                                                 \
+      size_t cdict__min_m = cdict__at_m;                                       \
+      size_t cdict__l_m = 2 * cdict__at_m + 1;                                 \
+      if (cdict__l_m < (n) && cdict__top_val_((cdict), (heap), cdict__l_m) <   \
+                                  cdict__top_val_((cdict), (heap),             \
+                                                  cdict__min_m)) {             \
+        cdict__min_m = cdict__l_m;                                             \
+      }                                                                        \
+      if (cdict__l_m + 1 < (n) &&                                              \
+          cdict__top_val_((cdict), (heap), cdict__l_m + 1) <                   \
+              cdict__top_val_((cdict), (heap), cdict__min_m)) {                \
+        cdict__min_m = cdict__l_m + 1;                                         \
+      }                                                                        \
+      if (cdict__min_m == cdict__at_m) {                                       \
+        break;                                                                 \
+      }                                                                        \
+      cdict__top_swap_((heap), cdict__at_m, cdict__min_m);                     \
+      cdict__at_m = cdict__min_m;                                              \
+    }                                                                          \
+  } while (0)
+
+/* writes the keys of the `k` largest values to `keys` and, unless NULL, the
+ * values to `vals`, largest first; returns how many were written, SIZE_MAX
+ * if the heap could not be allocated */
+#define cdict__top_k(cdict, k, keys, vals)                                     \
+  ({                                                                           \
+    size_t cdict__k_m = (k);                                                   \
+    size_t cdict__n_m = 0;                                                     \
+    __typeof__(&(cdict)->cdict__value_m) cdict__vals_m = (vals);               \
+    size_t *cdict__heap_m = (size_t *)cdict__allocator_alloc(                  \
+        cdict__allocator(cdict), cdict__k_m * sizeof(size_t));                 \
+    for (size_t cdict__j_m = cdict__next_occupied_((cdict), 0);                \
+         cdict__heap_m && cdict__k_m && cdict__j_m < cdict__cap(cdict);        \
+         cdict__j_m = cdict__next_occupied_((cdict), cdict__j_m + 1)) {        \
+      if (cdict__n_m < cdict__k_m) {                                           \
+        /* sift up */                                                          \
+        size_t cdict__at_m = cdict__n_m++;                                     \
+        cdict__heap_m[cdict__at_m] = cdict__j_m;                               \
+        while (cdict__at_m > 0 &&                                              \
+               cdict__top_val_((cdict), cdict__heap_m, cdict__at_m) <          \
+                   cdict__top_val_((cdict), cdict__heap_m,                     \
+                                   (cdict__at_m - 1) / 2)) {                   \
+          cdict__top_swap_(cdict__heap_m, cdict__at_m, (cdict__at_m - 1) / 2); \
+          cdict__at_m = (cdict__at_m - 1) / 2;                                 \
+        }                                                                      \
+      } else if (cdict__elem_val(cdict_vector__index(                          \
+                     cdict__vector_buckets_ref(cdict), cdict__j_m)) >          \
+                 cdict__top_val_((cdict), cdict__heap_m, 0)) {                 \
+        cdict__heap_m[0] = cdict__j_m;                                         \
+        cdict__top_sift_down_((cdict), cdict__heap_m, cdict__n_m, 0);          \
+      }                                                                        \
+    }                                                                          \
+    /* popping the minimum to the back leaves the heap sorted largest first */ \
+    for (size_t cdict__end_m = cdict__n_m; cdict__end_m > 1; cdict__end_m--) { \
+      cdict__top_swap_(cdict__heap_m, 0, cdict__end_m - 1);                    \
+      cdict__top_sift_down_((cdict), cdict__heap_m, cdict__end_m - 1, 0);      \
+    }                                                                          \
+    for (size_t cdict__i_m = 0; cdict__i_m < cdict__n_m; cdict__i_m++) {       \
+      __typeof__(cdict_vector__index(cdict__vector_buckets_ref(cdict), 0))     \
+          cdict__elem_m = cdict_vector__index(                                 \
+              cdict__vector_buckets_ref(cdict), cdict__heap_m[cdict__i_m]);    \
+      (keys)[cdict__i_m] = cdict__elem_key(cdict__elem_m);                     \
+      if (cdict__vals_m) {                                                     \
+        cdict__vals_m[cdict__i_m] = cdict__elem_val(cdict__elem_m);            \
+      }                                                                        \
+    }                                                                          \
+    cdict__allocator_free(cdict__allocator(cdict), cdict__heap_m,              \
+                          cdict__k_m * sizeof(size_t));                        \
+    (cdict__heap_m || !cdict__k_m ? cdict__n_m : SIZE_MAX);                    \
+  })
+
+/* Cursors: disjoint slices of the bucket array, so that several readers can
+ * walk one dict at the same time. The dict must not be modified while any
+ * cursor or parallel scan is in flight. */
+
+typedef struct cdict_Cursor {
+  size_t cdict_cursor__index_m;
+  size_t cdict_cursor__end_m;
+} cdict_Cursor;
+
+/* Bucket range of cursor `i` out of `k`; boundaries fall on bitmap words so
+ * that no two slices share one */
+static inline void cdict__partition_range(size_t cap, size_t k, size_t i,
+                                          cdict_Cursor *cursor) {
+  size_t words = (cap + 63) / 64;
+  size_t begin = (words * i / k) * 64;
+  size_t end = (words * (i + 1) / k) * 64;
+  cursor->cdict_cursor__index_m = begin < cap ? begin : cap;
+  cursor->cdict_cursor__end_m = end < cap ? end : cap;
+}
+
+/* Splits the buckets of `cdict` into `k` cursors written to `cursors` */
+#define cdict__partition(cdict, cursors, k)                                    \
+  do {                                                                         \
+    for (size_t cdict__i_m = 0; cdict__i_m < (size_t)(k); cdict__i_m++) {      \
+      cdict__partition_range(cdict__cap(cdict), (k), cdict__i_m,               \
+                             &(cursors)[cdict__i_m]);                          \
+    }                                                                          \
+  } while (0)
+
+/* Copies the next entry of the cursor's slice into `key` and `val` (pointers)
+ * and returns true, or returns false once the slice is exhausted */
+#define cdict_cursor__next(cdict, cursor, key, val)                            \
+  ({                                                                           \
+    size_t cdict__at_m = cdict__next_occupied(                                 \
+        cdict__occupied(cdict),                                                \
+        cdict_vector__elem(cdict__vector_buckets_ref(cdict)),                  \
+        sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),         \
+        (cursor)->cdict_cursor__index_m, (cursor)->cdict_cursor__end_m);       \
+    bool cdict__more_m = cdict__at_m < (cursor)->cdict_cursor__end_m;          \
+    if (cdict__more_m) {                                                       \
+      (*(key)) = cdict__elem_key(                                              \
+          cdict_vector__index(cdict__vector_buckets_ref(cdict), cdict__at_m)); \
+      (*(val)) = cdict__elem_val(                                              \
+          cdict_vector__index(cdict__vector_buckets_ref(cdict), cdict__at_m)); \
+    }                                                                          \
+    (cursor)->cdict_cursor__index_m = cdict__at_m + cdict__more_m;             \
+    (cdict__more_m);                                                           \
+  })
+
+#if CDICT__HAS_THREADS
+
+/* Layout of the buckets as seen by the parallel scans, which are not generic
+ * over the key and value types */
+typedef struct cdict_Scan {
+  const uint64_t *bits;
+  char *elems;
+  size_t elem_size;
+  size_t key_offset;
+  size_t val_offset;
+  size_t cap;
+  void (*each)(void *key, void *val, void *ctx);
+  void (*fold)(void *acc, void *key, void *val, void *ctx);
+  void *ctx;
+} cdict_Scan;
+
+typedef struct cdict_Scan_task {
+  const cdict_Scan *scan;
+  cdict_Cursor cursor;
+  void *acc;
+} cdict_Scan_task;
+
+static inline void *cdict__scan_run(void *arg) {
+  cdict_Scan_task *task = (cdict_Scan_task *)arg;
+  const cdict_Scan *scan = task->scan;
+  size_t i = task->cursor.cdict_cursor__index_m;
+  size_t end = task->cursor.cdict_cursor__end_m;
+  for (;;) {
+    i = cdict__next_occupied(scan->bits, scan->elems, scan->elem_size, i, end);
+    if (i >= end) {
+      break;
+    }
+    char *elem = scan->elems + i * scan->elem_size;
+    if (scan->fold) {
+      scan->fold(task->acc, elem + scan->key_offset, elem + scan->val_offset,
+                 scan->ctx);
+    } else {
+      scan->each(elem + scan->key_offset, elem + scan->val_offset, scan->ctx);
+    }
+    i++;
+  }
+  return NULL;
+}
+
+/* Runs `scan` on `nthreads` slices; the calling thread takes the first one.
+ * With `acc_size` > 0 each slice folds into its own copy of `result`, the
+ * partials are then merged into `result` in slice order with `combine`. */
+static inline bool cdict__scan_parallel(
+    const cdict_Scan *scan, size_t nthreads, void *result, size_t acc_size,
+    void (*combine)(void *acc, void *other, void *ctx)) {
+  if (nthreads == 0) {
+    nthreads = 1;
+  }
+  size_t words = (scan->cap + 63) / 64;
+  if (nthreads > words) {
+    nthreads = words ? words : 1;
+  }
+  cdict_Scan_task *tasks = (cdict_Scan_task *)calloc(nthreads, sizeof(*tasks));
+  pthread_t *threads = (pthread_t *)calloc(nthreads, sizeof(*threads));
+  char *partials = acc_size ? (char *)malloc(nthreads * acc_size) : NULL;
+  bool ok = tasks && threads && (acc_size == 0 || partials);
+  size_t started = 1;
+  if (ok) {
+    for (size_t i = 0; i < nthreads; i++) {
+      tasks[i].scan = scan;
+      cdict__partition_range(scan->cap, nthreads, i, &tasks[i].cursor);
+      if (acc_size) {
+        tasks[i].acc = partials + i * acc_size;
+        memcpy(tasks[i].acc, result, acc_size);
+      }
+    }
+    for (; started < nthreads; started++) {
+      if (pthread_create(&threads[started], NULL, cdict__scan_run,
+                         &tasks[started]) != 0) {
+        break;
+      }
+    }
+    cdict__scan_run(&tasks[0]);
+    /* slices whose thread could not be started run here */
+    for (size_t i = started; i < nthreads; i++) {
+      cdict__scan_run(&tasks[i]);
+    }
+    for (size_t i = 1; i < started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    if (acc_size) {
+      memcpy(result, tasks[0].acc, acc_size);
+      for (size_t i = 1; i < nthreads; i++) {
+        combine(result, tasks[i].acc, scan->ctx);
+      }
+    }
+  }
+  free(tasks);
+  free(threads);
+  free(partials);
+  return ok;
+}
+
+#define cdict__scan_of_(cdict, each_fn, fold_fn, context)                      \
+  ((cdict_Scan){                                                               \
+      .bits = cdict__occupied(cdict),                                          \
+      .elems = (char *)cdict_vector__elem(cdict__vector_buckets_ref(cdict)),   \
+      .elem_size =                                                             \
+          sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),       \
+      .key_offset = offsetof(                                                  \
+          __typeof__(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),   \
+          key),                                                                \
+      .val_offset = offsetof(                                                  \
+          __typeof__(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),   \
+          val),                                                                \
+      .cap = cdict__cap(cdict),                                                \
+      .each = (each_fn),                                                       \
+      .fold = (fold_fn),                                                       \
+      .ctx = (context)})
+
+/* Calls `fn(key, val, ctx)` for every entry from `nthreads` threads; `fn`
+ * runs concurrently, `ctx` is shared. Returns false if the scan could not be
+ * set up. */
+#define cdict__parallel_for_each(cdict, nthreads, fn, ctx)                     \
+  ({                                                                           \
+    cdict_Scan cdict__scan_m = cdict__scan_of_((cdict), (fn), NULL, (ctx));    \
+    cdict__scan_parallel(&cdict__scan_m, (nthreads), NULL, 0, NULL);           \
+  })
+
+/* Folds every entry with `fold(acc, key, val, ctx)` into per thread copies of
+ * `*result`, which holds the initial value, then merges them into `*result`
+ * with `combine(result, partial, ctx)` */
+#define cdict__parallel_reduce(cdict, nthreads, fold, combine, result, ctx)    \
+  ({                                                                           \
+    cdict_Scan cdict__scan_m = cdict__scan_of_((cdict), NULL, (fold), (ctx));  \
+    cdict__scan_parallel(&cdict__scan_m, (nthreads), (result),                 \
+                         sizeof(*(result)), (combine));                        \
+  })
+
+/* Group-by: every worker thread aggregates into its own row of `parts`
+ * dicts, a key going to the partition picked by the high bits of its hash
+ * under the group seed, so the same key lands in the same partition in every
+ * row. `cdict_group__merge` then runs one thread per partition, combining
+ * that partition across all rows: no locks, and every partition is merged
+ * exactly once. */
+
+/* Layout and hashing of a typed dict, for merges run by threads that are not
+ * generic over the key and value types */
+typedef struct cdict_Table {
+  uint64_t *bits;
+  char *elems;
+  size_t elem_size;
+  size_t key_offset;
+  size_t key_size;
+  size_t val_offset;
+  size_t cap;
+  size_t *size;
+  uint64_t seed;
+  cdict__u64 (*hash)(void *key, cdict__u64 (*hash)(void *, size_t));
+  bool (*compare)(void *self, void *other);
+  cdict_Bloom *bloom;
+  cdict_Counters *counters;
+} cdict_Table;
+
+/* same probe sequence as `cdict__slot_` */
+static inline size_t cdict__table_slot(const cdict_Table *table, void *key,
+                                       cdict__u64 *h1, bool *found,
+                                       size_t *psl) {
+  cdict__u64 h2;
+  if (table->hash) {
+    cdict__callback_seed = table->seed;
+    *h1 = table->hash(key, cdict__hash1_callback);
+    h2 = table->hash(key, cdict__hash2_callback);
+  } else {
+    *h1 = cdict__XXH64(key, table->key_size, table->seed);
+    h2 = cdict__XXH64_h(key, table->key_size, table->seed) | 1;
+  }
+  size_t cap = table->cap;
+  size_t slot = SIZE_MAX;
+  *found = false;
+  for (size_t i = 0; i < cap; i++) {
+    size_t at = cdict__double_hash_index(*h1, h2, i, cap);
+    char *elem = table->elems + at * table->elem_size;
+    int elem_psl = *(int *)elem;
+    if (elem_psl <= 0) {
+      if (slot == SIZE_MAX) {
+        slot = at;
+        *psl = i + 1;
+      }
+      if (elem_psl == 0) {
+        break;
+      }
+      continue;
+    }
+    void *other = elem + table->key_offset;
+    if (table->compare ? table->compare(other, key)
+                       : cdict__bytes_compare(other, key, table->key_size)) {
+      *found = true;
+      *psl = i + 1;
+      return at;
+    }
+  }
+  return slot;
+}
+
+/* Merges `src` into `dst`, which is presized for both; values of keys in
+ * both are merged with `combine(dst_val, src_val, ctx)` (kept without it) */
+static inline void cdict__table_merge(const cdict_Table *dst,
+                                      const cdict_Table *src,
+                                      void (*combine)(void *, void *, void *),
+                                      void *ctx) {
+  for (size_t i = cdict__next_occupied(src->bits, src->elems, src->elem_size,
+                                       0, src->cap);
+       i < src->cap; i = cdict__next_occupied(src->bits, src->elems,
+                                               src->elem_size, i + 1,
+                                               src->cap)) {
+    char *from = src->elems + i * src->elem_size;
+    cdict__u64 h1;
+    bool found;
+    size_t psl = 0;
+    size_t at =
+        cdict__table_slot(dst, from + src->key_offset, &h1, &found, &psl);
+    char *to = dst->elems + at * dst->elem_size;
+    if (found) {
+      if (combine) {
+        combine(to + dst->val_offset, from + src->val_offset, ctx);
+      }
+      continue;
+    }
+    memcpy(to, from, dst->elem_size);
+    *(int *)to = (int)psl;
+    if (psl > CDICT__RESEED_PSL) {
+      dst->counters->long_probe = true;
+    }
+    cdict__occupy(dst->bits, at);
+    if (cdict_bloom__enabled(dst->bloom)) {
+      cdict_bloom__add(dst->bloom, h1);
+    }
+    (*dst->size)++;
+  }
+}
+
+typedef struct cdict_Merge_task {
+  const cdict_Table *dst;
+  /* `count` sources, `stride` tables apart */
+  const cdict_Table *srcs;
+  size_t count;
+  size_t stride;
+  void (*combine)(void *, void *, void *);
+  void *ctx;
+} cdict_Merge_task;
+
+static inline void *cdict__merge_run(void *arg) {
+  cdict_Merge_task *task = (cdict_Merge_task *)arg;
+  for (size_t i = 0; i < task->count; i++) {
+    cdict__table_merge(task->dst, &task->srcs[i * task->stride],
+                       task->combine, task->ctx);
+  }
+  return NULL;
+}
+
+/* one thread per task, the calling thread takes the first one */
+static inline void cdict__merge_parallel(cdict_Merge_task *tasks, size_t n) {
+  pthread_t *threads = (pthread_t *)calloc(n, sizeof(*threads));
+  size_t started = 1;
+  for (; threads && started < n; started++) {
+    if (pthread_create(&threads[started], NULL, cdict__merge_run,
+                       &tasks[started]) != 0) {
+      break;
+    }
+  }
+  if (threads == NULL) {
+    started = 1;
+  }
+  cdict__merge_run(&tasks[0]);
+  /* tasks whose thread could not be started run here */
+  for (size_t i = started; i < n; i++) {
+    cdict__merge_run(&tasks[i]);
+  }
+  for (size_t i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+#define cdict__table_of_(cdict)                                                \
+  ((cdict_Table){                                                              \
+      .bits = cdict__occupied(cdict),                                          \
+      .elems = (char *)cdict_vector__elem(cdict__vector_buckets_ref(cdict)),   \
+      .elem_size =                                                             \
+          sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),       \
+      .key_offset = offsetof(                                                  \
+          __typeof__(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),   \
+          key),                                                                \
+      .key_size = sizeof(cdict__key(cdict)),                                   \
+      .val_offset = offsetof(                                                  \
+          __typeof__(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),   \
+          val),                                                                \
+      .cap = cdict__cap(cdict),                                                \
+      .size = &cdict__size(cdict),                                             \
+      .seed = cdict__seed(cdict),                                              \
+      .hash = (cdict__u64(*)(void *, cdict__u64(*)(void *, size_t)))           \
+          cdict__hash(cdict),                                                  \
+      .compare = (bool (*)(void *, void *))cdict__compare(cdict),              \
+      .bloom = cdict__bloom(cdict),                                            \
+      .counters = cdict__counters(cdict)})
+
+#define CDict_group(cdict_type_)                                               \
+  typedef struct {                                                             \
+    cdict_type_ *cdict_group__dicts_m;                                         \
+    size_t cdict_group__workers_m;                                             \
+    size_t cdict_group__parts_m;                                               \
+    uint64_t cdict_group__seed_m;                                              \
+  }
+
+#define cdict_group__parts(group) ((group)->cdict_group__parts_m)
+#define cdict_group__workers(group) ((group)->cdict_group__workers_m)
+
+#define cdict_group__dict_(group, worker, part)                                \
+  (&(group)->cdict_group__dicts_m[(worker) * cdict_group__parts(group) +       \
+                                  (part)])
+
+/* `workers` rows of `parts` dicts; returns false when out of memory */
+#define cdict_group__init(group, workers, parts)                               \
+  ({                                                                           \
+    cdict_group__workers(group) = (workers);                                   \
+    cdict_group__parts(group) = (parts);                                       \
+    (group)->cdict_group__seed_m = cdict__random_seed();                       \
+    size_t cdict__n_m =                                                        \
+        cdict_group__workers(group) * cdict_group__parts(group);               \
+    (group)->cdict_group__dicts_m =                                            \
+        calloc(cdict__n_m, sizeof(*(group)->cdict_group__dicts_m));            \
+    for (size_t cdict__i_m = 0;                                                \
+         (group)->cdict_group__dicts_m && cdict__i_m < cdict__n_m;             \
+         cdict__i_m++) {                                                       \
+      cdict__init(&(group)->cdict_group__dicts_m[cdict__i_m]);                 \
+    }                                                                          \
+    ((group)->cdict_group__dicts_m != NULL);                                   \
+  })
+
+#define cdict_group__each_dict_(group, dict_m)                                 \
+  for (__typeof__((group)->cdict_group__dicts_m) dict_m =                      \
+           (group)->cdict_group__dicts_m;                                      \
+       dict_m < (group)->cdict_group__dicts_m +                                \
+                    cdict_group__workers(group) * cdict_group__parts(group);   \
+       dict_m++)
+
+#define cdict_group__set_hash(group, hasher)                                   \
+  cdict_group__each_dict_((group), cdict__d_m) {                               \
+    cdict__set_hash(cdict__d_m, (hasher));                                     \
+  }
+
+#define cdict_group__set_comparator(group, comparator)                         \
+  cdict_group__each_dict_((group), cdict__d_m) {                               \
+    cdict__set_comparator(cdict__d_m, (comparator));                           \
+  }
+
+/* partition of the key in the `worker` row's key slot */
+#define cdict_group__partition_(group, row)                                    \
+  ({                                                                           \
+    cdict__u64 cdict__h_m;                                                     \
+    if (cdict__hash(row)) {                                                    \
+      cdict__callback_seed = (group)->cdict_group__seed_m;                     \
+      cdict__h_m =                                                             \
+          cdict__hash(row)(cdict__key_ref(row), cdict__hash1_callback);        \
+    } else {                                                                   \
+      cdict__h_m = cdict__XXH64(cdict__key_ref(row), sizeof(cdict__key(row)),  \
+                                (group)->cdict_group__seed_m);                 \
+    }                                                                          \
+    (size_t)(((unsigned __int128)cdict__h_m * cdict_group__parts(group)) >>    \
+             64);                                                              \
+  })
+
+/* dict of `worker`'s row holding the partition of `key`; only that worker
+ * may touch its row until the merge */
+#define cdict_group__part(group, worker, key)                                  \
+  ({                                                                           \
+    size_t cdict__worker_m = (worker);                                         \
+    __typeof__((group)->cdict_group__dicts_m) cdict__row_m =                   \
+        cdict_group__dict_((group), cdict__worker_m, 0);                       \
+    cdict__key(cdict__row_m) = (key);                                          \
+    cdict_group__dict_((group), cdict__worker_m,                               \
+                       cdict_group__partition_((group), cdict__row_m));        \
+  })
+
+/* `cdict__entry` in `worker`'s partition dict of `key` */
+#define cdict_group__entry(group, worker, key)                                 \
+  ({                                                                           \
+    __typeof__((group)->cdict_group__dicts_m) cdict__part_m =                  \
+        cdict_group__part((group), (worker), (key));                           \
+    __typeof__((group)->cdict_group__dicts_m) cdict__first_m =                 \
+        cdict_group__dict_((group), (worker), 0);                              \
+    cdict__entry(cdict__part_m, cdict__key(cdict__first_m));                   \
+  })
+
+/* Merges every partition across the rows with `combine(acc_val, val, ctx)`
+ * (NULL keeps the first value), one thread per partition. Partition `p` then
+ * sits in `cdict_group__result(group, p)`; the other rows are emptied. The
+ * largest partial of each partition is the destination, so only it is
+ * presized, on the calling thread. */
+#define cdict_group__merge(group, combine_fn, context)                         \
+  ({                                                                           \
+    size_t cdict__w_m = cdict_group__workers(group);                           \
+    size_t cdict__p_m = cdict_group__parts(group);                             \
+    cdict_Merge_task *cdict__tasks_m =                                         \
+        calloc(cdict__p_m, sizeof(*cdict__tasks_m));                           \
+    cdict_Table *cdict__tables_m =                                             \
+        calloc(cdict__w_m * cdict__p_m, sizeof(*cdict__tables_m));             \
+    bool cdict__ok_m = cdict__tasks_m && cdict__tables_m;                      \
+    for (size_t cdict__p_i = 0; cdict__ok_m && cdict__p_i < cdict__p_m;        \
+         cdict__p_i++) {                                                       \
+      size_t cdict__big_m = 0, cdict__total_m = 0;                             \
+      for (size_t cdict__w_i = 0; cdict__w_i < cdict__w_m; cdict__w_i++) {     \
+        size_t cdict__n_m =                                                    \
+            cdict__size(cdict_group__dict_((group), cdict__w_i, cdict__p_i));  \
+        cdict__total_m += cdict__n_m;                                          \
+        if (cdict__n_m > cdict__size(cdict_group__dict_(                       \
+                             (group), cdict__big_m, cdict__p_i))) {            \
+          cdict__big_m = cdict__w_i;                                           \
+        }                                                                      \
+      }                                                                        \
+      __typeof__(*(group)->cdict_group__dicts_m) cdict__tmp_m =                \
+          *cdict_group__dict_((group), 0, cdict__p_i);                         \
+      *cdict_group__dict_((group), 0, cdict__p_i) =                            \
+          *cdict_group__dict_((group), cdict__big_m, cdict__p_i);              \
+      *cdict_group__dict_((group), cdict__big_m, cdict__p_i) = cdict__tmp_m;   \
+      /* the merge threads write into the presized table, never growing it */ \
+      cdict__ok_m = cdict__reserve(cdict_group__dict_((group), 0, cdict__p_i), \
+                                   cdict__total_m);                            \
+      for (size_t cdict__w_i = 0; cdict__w_i < cdict__w_m; cdict__w_i++) {     \
+        cdict__tables_m[cdict__w_i * cdict__p_m + cdict__p_i] =                \
+            cdict__table_of_(                                                  \
+                cdict_group__dict_((group), cdict__w_i, cdict__p_i));          \
+      }                                                                        \
+      cdict__tasks_m[cdict__p_i] = (cdict_Merge_task){                         \
+          .dst = &cdict__tables_m[cdict__p_i],                                 \
+          .srcs = &cdict__tables_m[cdict__p_m + cdict__p_i],                   \
+          .count = cdict__w_m - 1,                                             \
+          .stride = cdict__p_m,                                                \
+          .combine = (combine_fn),                                             \
+          .ctx = (context)};                                                   \
+    }                                                                          \
+    if (cdict__ok_m) {                                                         \
+      cdict__merge_parallel(cdict__tasks_m, cdict__p_m);                       \
+      for (size_t cdict__p_i = 0; cdict__p_i < cdict__p_m; cdict__p_i++) {     \
+        cdict__reseed_if_long_(cdict_group__dict_((group), 0, cdict__p_i));    \
+      }                                                                        \
+      for (size_t cdict__i_m = cdict__p_m;                                     \
+           cdict__i_m < cdict__w_m * cdict__p_m;                               \
+           cdict__i_m++) {                                                     \
+        cdict__clear(&(group)->cdict_group__dicts_m[cdict__i_m]);              \
+      }                                                                        \
+    }                                                                          \
+    free(cdict__tasks_m);                                                      \
+    free(cdict__tables_m);                                                     \
+    (cdict__ok_m);                                                             \
+  })
+
+/* merged dict of partition `part` */
+#define cdict_group__result(group, part) cdict_group__dict_((group), 0, (part))
+
+#define cdict_group__free(group)                                               \
+  do {                                                                         \
+    if ((group)->cdict_group__dicts_m) {                                       \
+      cdict_group__each_dict_((group), cdict__d_m) {                           \
+        cdict__free(cdict__d_m);                                               \
+      }                                                                        \
+    }                                                                          \
+    free((group)->cdict_group__dicts_m);                                       \
+    (group)->cdict_group__dicts_m = NULL;                                      \
+  } while (0)
+
+#endif /* CDICT__HAS_THREADS */
+
+/* CDict_small: up to `cdict_small_cap_` entries stored inline and found by a
+ * linear scan, for the many dicts that only ever hold a handful of entries.
+ * The header is just the inline arrays, a count and two pointers; the first
+ * add past the inline capacity moves everything to a dict of `cdict_type_`
+ * transparently, allocated with the small dict's allocator. Keys are
+ * compared and hashed bytewise, with no custom comparator or hasher, so key
+ * types must not have padding bytes. */
+
+#define CDict_small(cdict_type_, cdict_small_cap_)                             \
+  typedef struct {                                                             \
+    __typeof__(((cdict_type_ *)0)->cdict__key_m)                               \
+        cdict_small__keys_m[cdict_small_cap_];                                 \
+    __typeof__(((cdict_type_ *)0)->cdict__value_m)                             \
+        cdict_small__vals_m[cdict_small_cap_];                                 \
+    uint32_t cdict_small__size_m;                                              \
+    cdict_type_ *cdict_small__table_m;                                         \
+    const cdict_Allocator *cdict_small__allocator_m;                           \
+  }
+
+#define cdict_small__cap(small)                                                \
+  (sizeof((small)->cdict_small__keys_m) /                                      \
+   sizeof(*((small)->cdict_small__keys_m)))
+
+/* NULL while the entries are inline */
+#define cdict_small__table(small) ((small)->cdict_small__table_m)
+
+#define cdict_small__key_at(small, i) (((small)->cdict_small__keys_m)[(i)])
+#define cdict_small__val_at(small, i) (((small)->cdict_small__vals_m)[(i)])
+
+#define cdict_small__size(small)                                               \
+  ((cdict_small__table(small)) ? cdict__size(cdict_small__table(small))        \
+                               : (size_t)((small)->cdict_small__size_m))
+
+#define cdict_small__init(small) cdict_small__init_with_allocator((small), NULL)
+
+/* `allocator` backs the upgraded dict and its buckets */
+#define cdict_small__init_with_allocator(small, allocator)                     \
+  do {                                                                         \
+    ((small)->cdict_small__size_m) = 0;                                        \
+    (cdict_small__table(small)) = NULL;                                        \
+    ((small)->cdict_small__allocator_m) = (allocator);                         \
+  } while (0)
+
+/* inline slot of the key or the inline size when absent */
+#define cdict_small__index_(small, ref)                                        \
+  ({                                                                           \
+    size_t cdict__i_m = 0;                                                     \
+    for (; cdict__i_m < ((small)->cdict_small__size_m); cdict__i_m++) {        \
+      if (cdict__bytes_compare(&cdict_small__key_at((small), cdict__i_m),      \
+                               (ref), sizeof(*(ref)))) {                       \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+    (cdict__i_m);                                                              \
+  })
+
+/* false when the dict could not be allocated, the entries stay inline */      \
+#define cdict_small__upgrade_(small)                                           \
+  ({                                                                           \
+    const cdict_Allocator *cdict__small_alloc_m =                              \
+        ((small)->cdict_small__allocator_m);                                   \
+    __typeof__(cdict_small__table(small)) cdict__table_m =                     \
+        cdict__allocator_alloc(cdict__small_alloc_m,                           \
+                               sizeof(*(cdict_small__table(small))));          \
+    bool cdict__upgraded_m = cdict__table_m != NULL;                           \
+    if (cdict__upgraded_m) {                                                   \
+      cdict__init_with_allocator(cdict__table_m, cdict__small_alloc_m);        \
+      cdict__upgraded_m =                                                      \
+          cdict__reserve(cdict__table_m, 2 * cdict_small__cap(small));         \
+      if (!cdict__upgraded_m) {                                                \
+        cdict__allocator_free(cdict__small_alloc_m, cdict__table_m,            \
+                              sizeof(*cdict__table_m));                        \
+      }                                                                        \
+    }                                                                          \
+    if (cdict__upgraded_m) {                                                   \
+      /* presized, these adds cannot fail */                                   \
+      for (size_t cdict__j_m = 0; cdict__j_m < ((small)->cdict_small__size_m); \
+           cdict__j_m++) {                                                     \
+        cdict__add(cdict__table_m, cdict_small__key_at((small), cdict__j_m),   \
+                   cdict_small__val_at((small), cdict__j_m));                  \
+      }                                                                        \
+      (cdict_small__table(small)) = cdict__table_m;                            \
+      ((small)->cdict_small__size_m) = 0;                                      \
+    }                                                                          \
+    (cdict__upgraded_m);                                                       \
+  })
+
+/* false when the upgrade or the upgraded dict could not allocate, the small   \
+ * dict is then unchanged */                                                   \
+#define cdict_small__add(small, key, val)                                      \
+  ({                                                                           \
+    __typeof__(cdict_small__key_at((small), 0)) cdict__key_m = (key);          \
+    bool cdict__added_m = true;                                                \
+    bool cdict__inline_m = false;                                              \
+    if (cdict_small__table(small) == NULL) {                                   \
+      size_t cdict__index_m = cdict_small__index_((small), &cdict__key_m);     \
+      if (cdict__index_m < cdict_small__cap(small)) {                          \
+        cdict_small__key_at((small), cdict__index_m) = cdict__key_m;           \
+        cdict_small__val_at((small), cdict__index_m) = (val);                  \
+        if (cdict__index_m == ((small)->cdict_small__size_m)) {                \
+          ((small)->cdict_small__size_m)++;                                    \
+        }                                                                      \
+        cdict__inline_m = true;                                                \
+      } else {                                                                 \
+        cdict__added_m = cdict_small__upgrade_(small);                         \
+      }                                                                        \
+    }                                                                          \
+    if (cdict__added_m && !cdict__inline_m) {                                  \
+      cdict__added_m =                                                         \
+          cdict__add(cdict_small__table(small), cdict__key_m, (val));          \
+    }                                                                          \
+    (cdict__added_m);                                                          \
+  })
+
+#define cdict_small__get(small, key, buffer)                                   \
+  ({                                                                           \
+    __typeof__(cdict_small__key_at((small), 0)) cdict__key_m = (key);          \
+    bool cdict__found_m = false;                                               \
+    if (cdict_small__table(small)) {                                           \
+      cdict__found_m =                                                         \
+          cdict__get(cdict_small__table(small), cdict__key_m, (buffer));       \
+    } else {                                                                   \
+      size_t cdict__index_m = cdict_small__index_((small), &cdict__key_m);     \
+      if (cdict__index_m < ((small)->cdict_small__size_m)) {                   \
+        (*(buffer)) = cdict_small__val_at((small), cdict__index_m);            \
+        cdict__found_m = true;                                                 \
+      }                                                                        \
+    }                                                                          \
+    (cdict__found_m);                                                          \
+  })
+
+#define cdict_small__contains(small, key)                                      \
+  ({                                                                           \
+    __typeof__(cdict_small__key_at((small), 0)) cdict__key_m = (key);          \
+    ((cdict_small__table(small))                                               \
+         ? cdict__contains(cdict_small__table(small), cdict__key_m)            \
+         : (cdict_small__index_((small), &cdict__key_m) <                      \
+            ((small)->cdict_small__size_m)));                                  \
+  })
+
+/* the last inline entry fills the hole */
+#define cdict_small__remove(small, key)                                        \
+  ({                                                                           \
+    __typeof__(cdict_small__key_at((small), 0)) cdict__key_m = (key);          \
+    bool cdict__found_m = false;                                               \
+    if (cdict_small__table(small)) {                                           \
+      cdict__found_m = cdict__remove(cdict_small__table(small), cdict__key_m); \
+    } else {                                                                   \
+      size_t cdict__index_m = cdict_small__index_((small), &cdict__key_m);     \
+      if (cdict__index_m < ((small)->cdict_small__size_m)) {                   \
+        size_t cdict__last_m = --((small)->cdict_small__size_m);               \
+        cdict_small__key_at((small), cdict__index_m) =                         \
+            cdict_small__key_at((small), cdict__last_m);                       \
+        cdict_small__val_at((small), cdict__index_m) =                         \
+            cdict_small__val_at((small), cdict__last_m);                       \
+        cdict__found_m = true;                                                 \
+      }                                                                        \
+    }                                                                          \
+    (cdict__found_m);                                                          \
+  })
+
+#define cdict_small__free(small)                                               \
+  do {                                                                         \
+    if (cdict_small__table(small)) {                                           \
+      cdict__free(cdict_small__table(small));                                  \
+      cdict__allocator_free(((small)->cdict_small__allocator_m),               \
+                            cdict_small__table(small),                         \
+                            sizeof(*cdict_small__table(small)));               \
+    }                                                                          \
+    cdict_small__init_with_allocator((small),                                  \
+                                     ((small)->cdict_small__allocator_m));     \
+  } while (0)
+
+/* CDict_frozen: immutable dict built by `cdict__freeze` on a minimal perfect
+ * hash (CHD, compress hash and displace). Keys are grouped into buckets of
+ * about CDICT__FROZEN_BUCKET_SIZE keys; every bucket gets a displacement
+ * (d0, d1) placing each of its keys at (f1 + d0 * f2 + d1) mod n.
+ * Trying d0 first steps each key by its own f2, which avoids the clustering
+ * a linear d1 sweep runs into; single key buckets, placed last, take the
+ * remaining free slots directly through d1. When two keys of a bucket end up
+ * with the same (f1, f2) the build is retried with another salt.
+ * Key/value pairs live in a dense array of exactly `size` slots, and a lookup
+ * is one displacement read plus one slot compare, no probing. */
+
+#ifndef CDICT__FROZEN_BUCKET_SIZE
+#define CDICT__FROZEN_BUCKET_SIZE 4
+#endif
+
+#define CDICT__FROZEN_D0_WINDOW 256
+#define CDICT__FROZEN_MAX_SALTS 64
+
+#define cdict__chd_taken(taken, i) (((taken)[(i) >> 6] >> ((i)&63)) & 1)
+#define cdict__chd_take(taken, i) ((taken)[(i) >> 6] |= (1ULL << ((i)&63)))
+
+#define cdict__chd_mix(hash, salt)                                             \
+  cdict__XXH64_avalanche((hash) ^ ((salt)*cdict__XXH_PRIME64_1))
+
+/* maps a 64 bit hash onto [0, n) with a multiply instead of a division */
+#define cdict__chd_range(hash, n)                                              \
+  ((size_t)(((unsigned __int128)(hash) * (n)) >> 64))
+
+#define cdict__chd_bucket(h2, nbuckets) cdict__chd_range((h2), (nbuckets))
+#define cdict__chd_f1(h1, n) cdict__chd_range((h1), (n))
+#define cdict__chd_f2(h2, n)                                                   \
+  (((n) > 1) ? cdict__chd_range(((h2) << 32) | ((h2) >> 32), (n)-1) + 1 : 0)
+
+/* disp packs d1 * CDICT__FROZEN_D0_WINDOW + d0 */
+#define cdict__chd_position(f1, f2, disp, n)                                   \
+  (((f1) + ((disp) % CDICT__FROZEN_D0_WINDOW) * (f2) +                         \
+    ((disp) / CDICT__FROZEN_D0_WINDOW)) %                                      \
+   (n))
+
+/* One build attempt with `salt`; `members`, `order`, `taken` and `positions`
+ * are scratch space. */
+static inline bool cdict__chd_try(const cdict__u64 *h1, const cdict__u64 *h2,
+                                  size_t n, size_t nbuckets, uint64_t salt,
+                                  size_t *slots, uint64_t *disp, size_t *start,
+                                  size_t *members, size_t *order,
+                                  uint64_t *taken, size_t *positions) {
+  size_t max_size = 0;
+  memset(disp, 0, nbuckets * sizeof(uint64_t));
+  memset(start, 0, (nbuckets + 1) * sizeof(size_t));
+  memset(taken, 0, (n / 64 + 1) * sizeof(uint64_t));
+
+  /* keys grouped by bucket (counting sort), `order` is the fill cursor */
+  for (size_t i = 0; i < n; i++) {
+    start[cdict__chd_bucket(cdict__chd_mix(h2[i], salt), nbuckets) + 1]++;
+  }
+  for (size_t b = 0; b < nbuckets; b++) {
+    size_t size = start[b + 1];
+    max_size = (size > max_size) ? size : max_size;
+    start[b + 1] += start[b];
+    order[b] = start[b];
+  }
+  for (size_t i = 0; i < n; i++) {
+    members[order[cdict__chd_bucket(cdict__chd_mix(h2[i], salt),
+                                    nbuckets)]++] = i;
+  }
+
+  /* largest buckets first, while the table is still empty */
+  size_t placed = 0;
+  for (size_t size = max_size; size > 0; size--) {
+    for (size_t b = 0; b < nbuckets; b++) {
+      if (start[b + 1] - start[b] == size) {
+        order[placed++] = b;
+      }
+    }
+  }
+
+  size_t *steps = positions + n + 1;
+  size_t free_slot = 0;
+  for (size_t o = 0; o < placed; o++) {
+    size_t b = order[o];
+    size_t *bucket = members + start[b];
+    size_t size = start[b + 1] - start[b];
+    if (size == 1) {
+      while (cdict__chd_taken(taken, free_slot)) {
+        free_slot++;
+      }
+      size_t f1 = cdict__chd_f1(cdict__chd_mix(h1[bucket[0]], salt), n);
+      disp[b] = (uint64_t)((free_slot + n - f1) % n) * CDICT__FROZEN_D0_WINDOW;
+      cdict__chd_take(taken, free_slot);
+      slots[bucket[0]] = free_slot;
+      continue;
+    }
+    /* A small d0 window per d1, so that a bad f2 orbit is left early.
+     * Positions step by f2 as d0 grows, no division in the inner loop. */
+    size_t window = (n < CDICT__FROZEN_D0_WINDOW) ? n : CDICT__FROZEN_D0_WINDOW;
+    bool found = false;
+    for (size_t d1 = 0; !found && d1 < n; d1++) {
+      for (size_t j = 0; j < size; j++) {
+        steps[j] = cdict__chd_f2(cdict__chd_mix(h2[bucket[j]], salt), n);
+        positions[j] =
+            (cdict__chd_f1(cdict__chd_mix(h1[bucket[j]], salt), n) + d1) % n;
+      }
+      for (size_t d0 = 0; !found && d0 < window; d0++) {
+        found = true;
+        for (size_t j = 0; found && j < size; j++) {
+          found = !cdict__chd_taken(taken, positions[j]);
+          for (size_t k = 0; found && k < j; k++) {
+            found = positions[k] != positions[j];
+          }
+        }
+        if (found) {
+          disp[b] = (uint64_t)d1 * CDICT__FROZEN_D0_WINDOW + d0;
+          for (size_t j = 0; j < size; j++) {
+            cdict__chd_take(taken, positions[j]);
+            slots[bucket[j]] = positions[j];
+          }
+          break;
+        }
+        for (size_t j = 0; j < size; j++) {
+          positions[j] += steps[j];
+          positions[j] -= (positions[j] >= n) ? n : 0;
+        }
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Builds displacements for `n` keys given their two hashes, writes the slot of
+ * key i to `slots[i]` and the salt that worked to `*salt`. Returns NULL when
+ * no salt works, e.g. a custom hash returns equal hashes for distinct keys. */
+static inline uint64_t *cdict__chd_build(const cdict__u64 *h1,
+                                         const cdict__u64 *h2, size_t n,
+                                         size_t nbuckets, size_t *slots,
+                                         uint64_t *salt) {
+  uint64_t *disp = (uint64_t *)malloc(nbuckets * sizeof(uint64_t));
+  size_t *start = (size_t *)malloc((nbuckets + 1) * sizeof(size_t));
+  size_t *members = (size_t *)malloc((n + 1) * sizeof(size_t));
+  size_t *order = (size_t *)malloc(nbuckets * sizeof(size_t));
+  /* bitset keeps the free-slot checks cache resident */
+  uint64_t *taken = (uint64_t *)malloc((n / 64 + 1) * sizeof(uint64_t));
+  size_t *positions = (size_t *)malloc((n + 1) * 2 * sizeof(size_t));
+  bool ok = disp && start && members && order && taken && positions;
+  bool built = false;
+  for (*salt = 0; ok && !built && *salt < CDICT__FROZEN_MAX_SALTS; (*salt)++) {
+    built = cdict__chd_try(h1, h2, n, nbuckets, *salt, slots, disp, start,
+                           members, order, taken, positions);
+  }
+  (*salt)--;
+
+  free(start);
+  free(members);
+  free(order);
+  free(taken);
+  free(positions);
+  if (!built) {
+    free(disp);
+    return NULL;
+  }
+  return disp;
+}
+
+#define CDict_frozen(cdict_type_)                                              \
+  typedef struct cdict_frozen_##cdict_type_ {                                  \
+    struct {                                                                   \
+      __typeof__(((cdict_type_ *)0)->cdict__key_m) key;                        \
+      __typeof__(((cdict_type_ *)0)->cdict__value_m) val;                      \
+    } * cdict_frozen__entries_m;                                               \
+    uint64_t *cdict_frozen__disp_m;                                            \
+    size_t cdict_frozen__nbuckets_m;                                           \
+    uint64_t cdict_frozen__salt_m;                                             \
+    size_t cdict__bucket_size_m;                                               \
+    uint64_t cdict__seed_m;                                                    \
+    __typeof__(((cdict_type_ *)0)->cdict__key_m) cdict__key_m;                 \
+    __typeof__(((cdict_type_ *)0)->cdict__compare_m) cdict__compare_m;         \
+    __typeof__(((cdict_type_ *)0)->cdict__hash_m) cdict__hash_m;               \
+  }
+
+#define cdict_frozen__size(frozen) cdict__size(frozen)
+#define cdict_frozen__salt(frozen) ((frozen)->cdict_frozen__salt_m)
+#define cdict_frozen__key_at(frozen, i)                                        \
+  (((frozen)->cdict_frozen__entries_m)[(i)].key)
+#define cdict_frozen__val_at(frozen, i)                                        \
+  (((frozen)->cdict_frozen__entries_m)[(i)].val)
+
+#define cdict_frozen__free(frozen)                                             \
+  do {                                                                         \
+    free((frozen)->cdict_frozen__entries_m);                                   \
+    free((frozen)->cdict_frozen__disp_m);                                      \
+    (frozen)->cdict_frozen__entries_m = NULL;                                  \
+    (frozen)->cdict_frozen__disp_m = NULL;                                     \
+    cdict__set_size((frozen), 0);                                              \
+  } while (0)
+
+/* Builds `frozen` from the live entries of `cdict`, which stays untouched.
+ * Returns false (and leaves `frozen` empty) when allocation or the perfect
+ * hash construction fails. */
+#define cdict__freeze(cdict, frozen)                                           \
+  ({                                                                           \
+    size_t cdict__n_m = cdict__size(cdict);                                    \
+    (frozen)->cdict__seed_m = cdict__seed(cdict);                              \
+    (frozen)->cdict__compare_m = cdict__compare(cdict);                        \
+    (frozen)->cdict__hash_m = cdict__hash(cdict);                              \
+    (frozen)->cdict_frozen__nbuckets_m =                                       \
+        (cdict__n_m / CDICT__FROZEN_BUCKET_SIZE) + 1;                          \
+    cdict__set_size((frozen), cdict__n_m);                                     \
+    (frozen)->cdict_frozen__entries_m = malloc(                                \
+        (cdict__n_m + 1) * sizeof(*((frozen)->cdict_frozen__entries_m)));      \
+    (frozen)->cdict_frozen__disp_m = NULL;                                     \
+    cdict__u64 *cdict__h1s_m = malloc((cdict__n_m + 1) * sizeof(cdict__u64));  \
+    cdict__u64 *cdict__h2s_m = malloc((cdict__n_m + 1) * sizeof(cdict__u64));  \
+    size_t *cdict__slots_m = malloc((cdict__n_m + 1) * sizeof(size_t));        \
+    bool cdict__ok_m = (frozen)->cdict_frozen__entries_m && cdict__h1s_m &&    \
+                       cdict__h2s_m && cdict__slots_m;                         \
+    size_t cdict__count_m = 0;                                                 \
+    for (size_t cdict__i_m = 0; cdict__ok_m && cdict__i_m < cdict__cap(cdict); \
+         cdict__i_m++) {                                                       \
+      if (cdict__elem_psl(cdict_vector__index(                                 \
+              cdict__vector_buckets_ref(cdict), cdict__i_m)) <= 0) {           \
+        continue;                                                              \
+      }                                                                        \
+      cdict__key(frozen) = cdict__elem_key(                                    \
+          cdict_vector__index(cdict__vector_buckets_ref(cdict), cdict__i_m));  \
+      cdict__u64 cdict__h1_m = cdict__h1hash((frozen), cdict__key_ref(frozen), \
+                                             cdict__key(frozen));              \
+      cdict__u64 cdict__h2_m = cdict__h2hash((frozen), cdict__key_ref(frozen), \
+                                             cdict__key(frozen));              \
+      cdict__h1s_m[cdict__count_m] = cdict__h1_m;                              \
+      cdict__h2s_m[cdict__count_m] = cdict__h2_m;                              \
+      cdict__count_m++;                                                        \
+    }                                                                          \
+    if (cdict__ok_m) {                                                         \
+      (frozen)->cdict_frozen__disp_m = cdict__chd_build(                       \
+          cdict__h1s_m, cdict__h2s_m, cdict__n_m,                              \
+          (frozen)->cdict_frozen__nbuckets_m, cdict__slots_m,                  \
+          &((frozen)->cdict_frozen__salt_m));                                  \
+      cdict__ok_m = (frozen)->cdict_frozen__disp_m != NULL;                    \
+    }                                                                          \
+    cdict__count_m = 0;                                                        \
+    for (size_t cdict__i_m = 0; cdict__ok_m && cdict__i_m < cdict__cap(cdict); \
+         cdict__i_m++) {                                                       \
+      if (cdict__elem_psl(cdict_vector__index(                                 \
+              cdict__vector_buckets_ref(cdict), cdict__i_m)) <= 0) {           \
+        continue;                                                              \
+      }                                                                        \
+      size_t cdict__slot_m = cdict__slots_m[cdict__count_m++];                 \
+      cdict_frozen__key_at((frozen), cdict__slot_m) = cdict__elem_key(         \
+          cdict_vector__index(cdict__vector_buckets_ref(cdict), cdict__i_m));  \
+      cdict_frozen__val_at((frozen), cdict__slot_m) = cdict__elem_val(         \
+          cdict_vector__index(cdict__vector_buckets_ref(cdict), cdict__i_m));  \
+    }                                                                          \
+    free(cdict__h1s_m);                                                        \
+    free(cdict__h2s_m);                                                        \
+    free(cdict__slots_m);                                                      \
+    if (!cdict__ok_m) {                                                        \
+      cdict_frozen__free(frozen);                                              \
+    }                                                                          \
+    (cdict__ok_m);                                                             \
+  })
+
+/* slot of the key or `size` when absent */
+#define cdict_frozen__index_(frozen, ref, key)                                 \
+  ({                                                                           \
+    size_t cdict__n_m = cdict__size(frozen);                                   \
+    size_t cdict__slot_m = cdict__n_m;                                         \
+    if (cdict__n_m > 0) {                                                      \
+      cdict__u64 cdict__h1_m = cdict__h1hash((frozen), (ref), (key));          \
+      cdict__u64 cdict__h2_m = cdict__h2hash((frozen), (ref), (key));          \
+      cdict__h1_m = cdict__chd_mix(cdict__h1_m, cdict_frozen__salt(frozen));   \
+      cdict__h2_m = cdict__chd_mix(cdict__h2_m, cdict_frozen__salt(frozen));   \
+      uint64_t cdict__disp_m = ((frozen)->cdict_frozen__disp_m)[               \
+          cdict__chd_bucket(cdict__h2_m, (frozen)->cdict_frozen__nbuckets_m)]; \
+      size_t cdict__position_m = (size_t)cdict__chd_position(                  \
+          cdict__chd_f1(cdict__h1_m, cdict__n_m),                              \
+          cdict__chd_f2(cdict__h2_m, cdict__n_m), cdict__disp_m,               \
+          cdict__n_m);                                                         \
+      bool cdict__matches_m =                                                  \
+          (cdict__compare(frozen))                                             \
+              ? (cdict__compare(frozen))(                                      \
+                    &cdict_frozen__key_at((frozen), cdict__position_m), (ref)) \
+              : cdict__bytes_compare(                                          \
+                    &cdict_frozen__key_at((frozen), cdict__position_m), (ref), \
+                    sizeof(key));                                              \
+      if (cdict__matches_m) {                                                  \
+        cdict__slot_m = cdict__position_m;                                     \
+      }                                                                        \
+    }                                                                          \
+    (cdict__slot_m);                                                           \
+  })
+
+#define cdict_frozen__get(frozen, key, buffer)                                 \
+  ({                                                                           \
+    (cdict__key(frozen) = (key));                                              \
+    size_t cdict__slot_m = cdict_frozen__index_(                               \
+        (frozen), cdict__key_ref(frozen), cdict__key(frozen));                 \
+    bool cdict__found_m = cdict__slot_m < cdict__size(frozen);                 \
+    if (cdict__found_m) {                                                      \
+      (*(buffer)) = cdict_frozen__val_at((frozen), cdict__slot_m);             \
+    }                                                                          \
+    (cdict__found_m);                                                          \
+  })
+
+#define cdict_frozen__contains(frozen, key)                                    \
+  ({                                                                           \
+    (cdict__key(frozen) = (key));                                              \
+    (cdict_frozen__index_((frozen), cdict__key_ref(frozen),                    \
+                          cdict__key(frozen)) < cdict__size(frozen));          \
+  })
+
+#define cdict__flat_key_ref(buckets, i) (&((buckets)[(i)].key))
+
+/* Probe loop of the tables below that keep their own flat bucket arrays;
+ * `psl_member` is the member path of the psl inside a bucket. Returns whether
+ * the key was found and sets `*slot` to its bucket, or otherwise to the first
+ * free bucket on its probe sequence (UINT32_MAX when there is none). */
+#define cdict__probe_(cdict, buckets, cap, psl_member, ref, key, slot)         \
+  ({                                                                           \
+    bool cdict__found_m = false;                                               \
+    size_t cdict__cap_m = (cap);                                               \
+    *(slot) = UINT32_MAX;                                                      \
+    if (cdict__cap_m > 0) {                                                    \
+      cdict__u64 cdict__h1_m = cdict__h1hash((cdict), (ref), (key));           \
+      cdict__u64 cdict__h2_m = cdict__h2hash((cdict), (ref), (key));           \
+      for (size_t cdict__i_m = 0; cdict__i_m < cdict__cap_m; cdict__i_m++) {   \
+        uint32_t cdict__index_m = (uint32_t)cdict__double_hash_index(          \
+            cdict__h1_m, cdict__h2_m, cdict__i_m, cdict__cap_m);               \
+        int cdict__psl_m = (buckets)[cdict__index_m] psl_member;               \
+        if (cdict__psl_m <= 0) {                                               \
+          if (*(slot) == UINT32_MAX) {                                         \
+            *(slot) = cdict__index_m;                                          \
+          }                                                                    \
+          if (cdict__psl_m == 0) {                                             \
+            break;                                                             \
+          }                                                                    \
+          continue;                                                            \
+        }                                                                      \
+        bool cdict__matches_m =                                                \
+            (cdict__compare(cdict))                                            \
+                ? (cdict__compare(cdict))(                                     \
+                      cdict__flat_key_ref((buckets), cdict__index_m), (ref))   \
+                : cdict__bytes_compare(                                        \
+                      cdict__flat_key_ref((buckets), cdict__index_m), (ref),   \
+                      sizeof(key));                                            \
+        if (cdict__matches_m) {                                                \
+          *(slot) = cdict__index_m;                                            \
+          cdict__found_m = true;                                               \
+          break;                                                               \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+    (cdict__found_m);                                                          \
+  })
+
+/* CDict_lru: bounded cache keeping at most `cdict_lru_capacity_` entries. The
+ * recency list is threaded through the buckets as slot indices, so a hit is a
+ * single probe that also relinks the entry at the front, and a full add
+ * evicts the tail (least recently used) entry. Removed and evicted entries
+ * leave tombstones; the table is rehashed in recency order once they pile up.
+ */
+
+#define CDICT_LRU__NONE UINT32_MAX
+
+typedef struct cdict_Lru_link {
+  int cdict__psl_m;
+  uint32_t cdict_lru__prev_m; /* towards the most recently used */
+  uint32_t cdict_lru__next_m; /* towards the least recently used */
+} cdict_Lru_link;
+
+typedef struct cdict_Lru_list {
+  size_t cdict_lru__cap_m;
+  size_t cdict_lru__tombstones_m;
+  uint32_t cdict_lru__head_m;
+  uint32_t cdict_lru__tail_m;
+} cdict_Lru_list;
+
+#define cdict_lru__link_at(buckets, elem_size, i)                              \
+  ((cdict_Lru_link *)((char *)(buckets) + (size_t)(i) * (elem_size)))
+
+static inline void cdict_lru__unlink(cdict_Lru_list *list, void *buckets,
+                                     size_t elem_size, uint32_t i) {
+  cdict_Lru_link *link = cdict_lru__link_at(buckets, elem_size, i);
+  if (link->cdict_lru__prev_m != CDICT_LRU__NONE) {
+    cdict_lru__link_at(buckets, elem_size, link->cdict_lru__prev_m)
+        ->cdict_lru__next_m = link->cdict_lru__next_m;
+  } else {
+    list->cdict_lru__head_m = link->cdict_lru__next_m;
+  }
+  if (link->cdict_lru__next_m != CDICT_LRU__NONE) {
+    cdict_lru__link_at(buckets, elem_size, link->cdict_lru__next_m)
+        ->cdict_lru__prev_m = link->cdict_lru__prev_m;
+  } else {
+    list->cdict_lru__tail_m = link->cdict_lru__prev_m;
+  }
+}
+
+static inline void cdict_lru__push_front(cdict_Lru_list *list, void *buckets,
+                                         size_t elem_size, uint32_t i) {
+  cdict_Lru_link *link = cdict_lru__link_at(buckets, elem_size, i);
+  link->cdict_lru__prev_m = CDICT_LRU__NONE;
+  link->cdict_lru__next_m = list->cdict_lru__head_m;
+  if (list->cdict_lru__head_m != CDICT_LRU__NONE) {
+    cdict_lru__link_at(buckets, elem_size, list->cdict_lru__head_m)
+        ->cdict_lru__prev_m = i;
+  } else {
+    list->cdict_lru__tail_m = i;
+  }
+  list->cdict_lru__head_m = i;
+}
+
+static inline void cdict_lru__promote(cdict_Lru_list *list, void *buckets,
+                                      size_t elem_size, uint32_t i) {
+  if (list->cdict_lru__head_m != i) {
+    cdict_lru__unlink(list, buckets, elem_size, i);
+    cdict_lru__push_front(list, buckets, elem_size, i);
+  }
+}
+
+/* live entries stay under half of the buckets */
+static inline size_t cdict_lru__table_cap(size_t capacity) {
+  size_t cap = 8;
+  while (cap < 2 * capacity) {
+    cap *= 2;
+  }
+  return cap;
+}
+
+#define CDict_lru(cdict_key_type_, cdict_value_type_, cdict_lru_capacity_)     \
+  typedef struct {                                                             \
+    struct {                                                                   \
+      cdict_Lru_link cdict_lru__link_m;                                        \
+      cdict_key_type_ key;                                                     \
+      cdict_value_type_ val;                                                   \
+    } * cdict_lru__buckets_m;                                                  \
+    cdict_Lru_list cdict_lru__list_m;                                          \
+    char (*cdict_lru__capacity_m)[cdict_lru_capacity_];                        \
+    size_t cdict__bucket_size_m;                                               \
+    uint64_t cdict__seed_m;                                                    \
+    cdict_key_type_ cdict__key_m;                                              \
+    const cdict_Allocator *cdict__allocator_m;                                 \
+    void (*cdict_lru__evict_m)(cdict_key_type_ * key,                          \
+                               cdict_value_type_ * val, void *ctx);            \
+    void *cdict_lru__evict_ctx_m;                                              \
+    bool (*cdict__compare_m)(cdict_key_type_ * self, cdict_key_type_ *other);  \
+    cdict__u64 (*cdict__hash_m)(cdict_key_type_ * self,                        \
+                                cdict__u64 (*hash)(void *, size_t));           \
+  }
+
+#define cdict_lru__capacity(lru) (sizeof(*((lru)->cdict_lru__capacity_m)))
+#define cdict_lru__size(lru) cdict__size(lru)
+#define cdict_lru__buckets(lru) ((lru)->cdict_lru__buckets_m)
+#define cdict_lru__list(lru) (&((lru)->cdict_lru__list_m))
+#define cdict_lru__cap(lru) (cdict_lru__list(lru)->cdict_lru__cap_m)
+#define cdict_lru__elem_size(lru) (sizeof(*cdict_lru__buckets(lru)))
+#define cdict_lru__psl_at(lru, i)                                              \
+  (cdict_lru__buckets(lru)[(i)].cdict_lru__link_m.cdict__psl_m)
+
+/* most and least recently used entries, CDICT_LRU__NONE when empty */
+#define cdict_lru__head(lru) (cdict_lru__list(lru)->cdict_lru__head_m)
+#define cdict_lru__tail(lru) (cdict_lru__list(lru)->cdict_lru__tail_m)
+#define cdict_lru__next(lru, i)                                                \
+  (cdict_lru__buckets(lru)[(i)].cdict_lru__link_m.cdict_lru__next_m)
+#define cdict_lru__key_at(lru, i) (cdict_lru__buckets(lru)[(i)].key)
+#define cdict_lru__val_at(lru, i) (cdict_lru__buckets(lru)[(i)].val)
+
+#define cdict_lru__init(lru) cdict_lru__init_with_allocator((lru), NULL)
+
+/* Nothing is allocated until the first `cdict_lru__add` */
+#define cdict_lru__init_with_allocator(lru, allocator)                         \
+  do {                                                                         \
+    cdict_lru__buckets(lru) = NULL;                                            \
+    memset(cdict_lru__list(lru), 0, sizeof(*cdict_lru__list(lru)));            \
+    cdict_lru__head(lru) = CDICT_LRU__NONE;                                    \
+    cdict_lru__tail(lru) = CDICT_LRU__NONE;                                    \
+    cdict__set_size((lru), 0);                                                 \
+    cdict__set_seed((lru), cdict__random_seed());                              \
+    cdict__set_comparator((lru), (NULL));                                      \
+    cdict__set_hash((lru), (NULL));                                            \
+    (cdict__allocator(lru)) = (allocator);                                     \
+    cdict_lru__set_evict((lru), NULL, NULL);                                   \
+  } while (0)
+
+/* `callback(&key, &val, ctx)` runs for every entry pushed out by an add */
+#define cdict_lru__set_evict(lru, callback, ctx)                               \
+  do {                                                                         \
+    ((lru)->cdict_lru__evict_m) = (callback);                                  \
+    ((lru)->cdict_lru__evict_ctx_m) = (ctx);                                   \
+  } while (0)
+
+#define cdict_lru__index_(lru, ref, key, slot)                                 \
+  cdict__probe_((lru), cdict_lru__buckets(lru), cdict_lru__cap(lru),           \
+                .cdict_lru__link_m.cdict__psl_m, (ref), (key), (slot))
+
+/* Moves the live entries into fresh buckets, oldest first so that the
+ * recency order survives, and drops the tombstones */
+#define cdict_lru__rehash_(lru, cap)                                           \
+  do {                                                                         \
+    size_t cdict__new_cap_m = (cap);                                           \
+    __typeof__(cdict_lru__buckets(lru)) cdict__old_m =                         \
+        cdict_lru__buckets(lru);                                               \
+    size_t cdict__old_cap_m = cdict_lru__cap(lru);                             \
+    uint32_t cdict__from_m = cdict_lru__tail(lru);                             \
+    __typeof__(cdict_lru__buckets(lru)) cdict__new_m =                         \
+        cdict__allocator_zalloc(cdict__allocator(lru),                         \
+                                cdict__new_cap_m * cdict_lru__elem_size(lru)); \
+    if (cdict__new_m != NULL) {                                                \
+      cdict_lru__buckets(lru) = cdict__new_m;                                  \
+      cdict_lru__cap(lru) = cdict__new_cap_m;                                  \
+      cdict_lru__list(lru)->cdict_lru__tombstones_m = 0;                       \
+      cdict_lru__head(lru) = CDICT_LRU__NONE;                                  \
+      cdict_lru__tail(lru) = CDICT_LRU__NONE;                                  \
+      while (cdict__from_m != CDICT_LRU__NONE) {                               \
+        uint32_t cdict__slot_m;                                                \
+        cdict_lru__index_((lru), &cdict__old_m[cdict__from_m].key,             \
+                          cdict__old_m[cdict__from_m].key, &cdict__slot_m);    \
+        cdict__new_m[cdict__slot_m] = cdict__old_m[cdict__from_m];             \
+        cdict_lru__push_front(cdict_lru__list(lru), cdict__new_m,              \
+                              cdict_lru__elem_size(lru), cdict__slot_m);       \
+        cdict__from_m = cdict__old_m[cdict__from_m]                            \
+                            .cdict_lru__link_m.cdict_lru__prev_m;              \
+      }                                                                        \
+      cdict__allocator_free(cdict__allocator(lru), cdict__old_m,               \
+                            cdict__old_cap_m * cdict_lru__elem_size(lru));     \
+    }                                                                          \
+  } while (0)
+
+#define cdict_lru__drop_(lru, slot)                                            \
+  do {                                                                         \
+    cdict_lru__unlink(cdict_lru__list(lru), cdict_lru__buckets(lru),           \
+                      cdict_lru__elem_size(lru), (slot));                      \
+    cdict_lru__psl_at((lru), (slot)) = -1;                                     \
+    cdict_lru__list(lru)->cdict_lru__tombstones_m++;                           \
+    cdict__set_size((lru), cdict__size(lru) - 1);                              \
+  } while (0)
+
+#define cdict_lru__evict_(lru)                                                 \
+  do {                                                                         \
+    uint32_t cdict__victim_m = cdict_lru__tail(lru);                           \
+    if ((lru)->cdict_lru__evict_m) {                                           \
+      ((lru)->cdict_lru__evict_m)(&cdict_lru__key_at((lru), cdict__victim_m),  \
+                                  &cdict_lru__val_at((lru), cdict__victim_m),  \
+                                  (lru)->cdict_lru__evict_ctx_m);              \
+    }                                                                          \
+    cdict_lru__drop_((lru), cdict__victim_m);                                  \
+  } while (0)
+
+/* Inserts or updates the key as the most recently used entry, evicting the
+ * least recently used one when the cache is full */
+#define cdict_lru__add(lru, key, val)                                          \
+  do {                                                                         \
+    if (cdict_lru__buckets(lru) == NULL ||                                     \
+        (cdict__size(lru) + cdict_lru__list(lru)->cdict_lru__tombstones_m +    \
+         1) * 4 >                                                              \
+            cdict_lru__cap(lru) * 3) {                                         \
+      cdict_lru__rehash_((lru),                                                \
+                         cdict_lru__table_cap(cdict_lru__capacity(lru)));      \
+    }                                                                          \
+    (cdict__key(lru)) = (key);                                                 \
+    uint32_t cdict__slot_m;                                                    \
+    bool cdict__found_m = cdict_lru__index_((lru), cdict__key_ref(lru),        \
+                                            cdict__key(lru), &cdict__slot_m);  \
+    if (cdict__found_m) {                                                      \
+      cdict_lru__val_at((lru), cdict__slot_m) = (val);                         \
+      cdict_lru__promote(cdict_lru__list(lru), cdict_lru__buckets(lru),        \
+                         cdict_lru__elem_size(lru), cdict__slot_m);            \
+    } else if (cdict__slot_m != CDICT_LRU__NONE) {                             \
+      if (cdict__size(lru) >= cdict_lru__capacity(lru)) {                      \
+        cdict_lru__evict_(lru);                                                \
+      }                                                                        \
+      if (cdict_lru__psl_at((lru), cdict__slot_m) == -1) {                     \
+        cdict_lru__list(lru)->cdict_lru__tombstones_m--;                       \
+      }                                                                        \
+      cdict_lru__key_at((lru), cdict__slot_m) = cdict__key(lru);               \
+      cdict_lru__val_at((lru), cdict__slot_m) = (val);                         \
+      cdict_lru__psl_at((lru), cdict__slot_m) = 1;                             \
+      cdict_lru__push_front(cdict_lru__list(lru), cdict_lru__buckets(lru),     \
+                            cdict_lru__elem_size(lru), cdict__slot_m);         \
+      cdict__set_size((lru), cdict__size(lru) + 1);                            \
+    }                                                                          \
+  } while (0)
+
+/* a hit becomes the most recently used entry */
+#define cdict_lru__get(lru, key, buffer)                                       \
+  ({                                                                           \
+    (cdict__key(lru)) = (key);                                                 \
+    uint32_t cdict__slot_m;                                                    \
+    bool cdict__found_m = cdict_lru__index_((lru), cdict__key_ref(lru),        \
+                                            cdict__key(lru), &cdict__slot_m);  \
+    if (cdict__found_m) {                                                      \
+      cdict_lru__promote(cdict_lru__list(lru), cdict_lru__buckets(lru),        \
+                         cdict_lru__elem_size(lru), cdict__slot_m);            \
+      (*(buffer)) = cdict_lru__val_at((lru), cdict__slot_m);                   \
+    }                                                                          \
+    (cdict__found_m);                                                          \
+  })
+
+/* like `cdict_lru__get` without touching the recency order */
+#define cdict_lru__peek(lru, key, buffer)                                      \
+  ({                                                                           \
+    (cdict__key(lru)) = (key);                                                 \
+    uint32_t cdict__slot_m;                                                    \
+    bool cdict__found_m = cdict_lru__index_((lru), cdict__key_ref(lru),        \
+                                            cdict__key(lru), &cdict__slot_m);  \
+    if (cdict__found_m) {                                                      \
+      (*(buffer)) = cdict_lru__val_at((lru), cdict__slot_m);                   \
+    }                                                                          \
+    (cdict__found_m);                                                          \
+  })
+
+#define cdict_lru__contains(lru, key)                                          \
+  ({                                                                           \
+    (cdict__key(lru)) = (key);                                                 \
+    uint32_t cdict__slot_m;                                                    \
+    cdict_lru__index_((lru), cdict__key_ref(lru), cdict__key(lru),             \
+                      &cdict__slot_m);                                         \
+  })
+
+/* the evict callback is not called for explicit removals */
+#define cdict_lru__remove(lru, key)                                            \
+  ({                                                                           \
+    (cdict__key(lru)) = (key);                                                 \
+    uint32_t cdict__slot_m;                                                    \
+    bool cdict__found_m = cdict_lru__index_((lru), cdict__key_ref(lru),        \
+                                            cdict__key(lru), &cdict__slot_m);  \
+    if (cdict__found_m) {                                                      \
+      cdict_lru__drop_((lru), cdict__slot_m);                                  \
+    }                                                                          \
+    (cdict__found_m);                                                          \
+  })
+
+#define cdict_lru__free(lru)                                                   \
+  do {                                                                         \
+    cdict__allocator_free(cdict__allocator(lru), cdict_lru__buckets(lru),      \
+                          cdict_lru__cap(lru) * cdict_lru__elem_size(lru));    \
+    cdict_lru__buckets(lru) = NULL;                                            \
+    memset(cdict_lru__list(lru), 0, sizeof(*cdict_lru__list(lru)));            \
+    cdict_lru__head(lru) = CDICT_LRU__NONE;                                    \
+    cdict_lru__tail(lru) = CDICT_LRU__NONE;                                    \
+    cdict__set_size((lru), 0);                                                 \
+  } while (0)
+
+/* CDict_ttl: dict whose entries carry a deadline. Expired entries read as
+ * absent and are reclaimed on sight by lookups; `cdict_ttl__expire_step`
+ * reaps the rest incrementally, a bounded number of buckets per call, instead
+ * of sweeping the whole table at once. */
+
+static inline uint64_t cdict__now_ms(void) {
+  struct timespec ts;
+#if CDICT__HAS_MMAP
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+  timespec_get(&ts, TIME_UTC);
+#endif
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* deadline 0 never expires */
+#define cdict_ttl__expired(deadline, now)                                      \
+  ((deadline) != 0 && (deadline) <= (now))
+
+#define CDict_ttl(cdict_key_type_, cdict_value_type_)                          \
+  typedef struct {                                                             \
+    struct {                                                                   \
+      int cdict__psl_m;                                                        \
+      uint64_t cdict_ttl__deadline_m;                                          \
+      cdict_key_type_ key;                                                     \
+      cdict_value_type_ val;                                                   \
+    } * cdict_ttl__buckets_m;                                                  \
+    size_t cdict_ttl__cap_m;                                                   \
+    size_t cdict_ttl__tombstones_m;                                            \
+    size_t cdict_ttl__cursor_m;                                                \
+    size_t cdict__bucket_size_m;                                               \
+    const cdict_Config *cdict__config_m;                                       \
+    uint64_t cdict__seed_m;                                                    \
+    cdict_key_type_ cdict__key_m;                                              \
+    const cdict_Allocator *cdict__allocator_m;                                 \
+    bool (*cdict__compare_m)(cdict_key_type_ * self, cdict_key_type_ *other);  \
+    cdict__u64 (*cdict__hash_m)(cdict_key_type_ * self,                        \
+                                cdict__u64 (*hash)(void *, size_t));           \
+  }
+
+/* includes expired entries that were not reclaimed yet */
+#define cdict_ttl__size(ttl) cdict__size(ttl)
+#define cdict_ttl__buckets(ttl) ((ttl)->cdict_ttl__buckets_m)
+#define cdict_ttl__cap(ttl) ((ttl)->cdict_ttl__cap_m)
+#define cdict_ttl__elem_size(ttl) (sizeof(*cdict_ttl__buckets(ttl)))
+#define cdict_ttl__psl_at(ttl, i) (cdict_ttl__buckets(ttl)[(i)].cdict__psl_m)
+#define cdict_ttl__key_at(ttl, i) (cdict_ttl__buckets(ttl)[(i)].key)
+#define cdict_ttl__val_at(ttl, i) (cdict_ttl__buckets(ttl)[(i)].val)
+#define cdict_ttl__deadline_at(ttl, i)                                         \
+  (cdict_ttl__buckets(ttl)[(i)].cdict_ttl__deadline_m)
+
+#define cdict_ttl__init(ttl) cdict_ttl__init_with_allocator((ttl), NULL)
+
+/* Nothing is allocated until the first `cdict_ttl__add` */
+#define cdict_ttl__init_with_allocator(ttl, allocator)                         \
+  do {                                                                         \
+    cdict_ttl__buckets(ttl) = NULL;                                            \
+    cdict_ttl__cap(ttl) = 0;                                                   \
+    ((ttl)->cdict_ttl__tombstones_m) = 0;                                      \
+    ((ttl)->cdict_ttl__cursor_m) = 0;                                          \
+    cdict__set_size((ttl), 0);                                                 \
+    cdict__set_config((ttl), (NULL));                                          \
+    cdict__set_seed((ttl), cdict__random_seed());                              \
+    cdict__set_comparator((ttl), (NULL));                                      \
+    cdict__set_hash((ttl), (NULL));                                            \
+    (cdict__allocator(ttl)) = (allocator);                                     \
+  } while (0)
+
+#define cdict_ttl__index_(ttl, ref, key, slot)                                 \
+  cdict__probe_((ttl), cdict_ttl__buckets(ttl), cdict_ttl__cap(ttl),           \
+                .cdict__psl_m, (ref), (key), (slot))
+
+#define cdict_ttl__drop_(ttl, slot)                                            \
+  do {                                                                         \
+    cdict_ttl__psl_at((ttl), (slot)) = -1;                                     \
+    ((ttl)->cdict_ttl__tombstones_m)++;                                        \
+    cdict__set_size((ttl), cdict__size(ttl) - 1);                              \
+  } while (0)
+
+/* Moves the live entries into `cap` fresh buckets; expired entries and
+ * tombstones are left behind */
+#define cdict_ttl__rehash_(ttl, cap)                                           \
+  do {                                                                         \
+    size_t cdict__new_cap_m = (cap);                                           \
+    __typeof__(cdict_ttl__buckets(ttl)) cdict__old_m =                         \
+        cdict_ttl__buckets(ttl);                                               \
+    size_t cdict__old_cap_m = cdict_ttl__cap(ttl);                             \
+    __typeof__(cdict_ttl__buckets(ttl)) cdict__new_m =                         \
+        cdict__allocator_zalloc(cdict__allocator(ttl),                         \
+                                cdict__new_cap_m * cdict_ttl__elem_size(ttl)); \
+    if (cdict__new_m != NULL) {                                                \
+      uint64_t cdict__now_m = cdict__now_ms();                                 \
+      cdict_ttl__buckets(ttl) = cdict__new_m;                                  \
+      cdict_ttl__cap(ttl) = cdict__new_cap_m;                                  \
+      ((ttl)->cdict_ttl__tombstones_m) = 0;                                    \
+      ((ttl)->cdict_ttl__cursor_m) = 0;                                        \
+      cdict__set_size((ttl), 0);                                               \
+      for (size_t cdict__j_m = 0; cdict__j_m < cdict__old_cap_m;               \
+           cdict__j_m++) {                                                     \
+        if (cdict__old_m[cdict__j_m].cdict__psl_m <= 0 ||                      \
+            cdict_ttl__expired(cdict__old_m[cdict__j_m].cdict_ttl__deadline_m, \
+                               cdict__now_m)) {                                \
+          continue;                                                            \
+        }                                                                      \
+        uint32_t cdict__slot_m;                                                \
+        cdict_ttl__index_((ttl), &cdict__old_m[cdict__j_m].key,                \
+                          cdict__old_m[cdict__j_m].key, &cdict__slot_m);       \
+        cdict__new_m[cdict__slot_m] = cdict__old_m[cdict__j_m];                \
+        cdict__set_size((ttl), cdict__size(ttl) + 1);                          \
+      }                                                                        \
+      cdict__allocator_free(cdict__allocator(ttl), cdict__old_m,               \
+                            cdict__old_cap_m * cdict_ttl__elem_size(ttl));     \
+    }                                                                          \
+  } while (0)
+
+/* Inserts or replaces the key, which expires `ttl_ms` milliseconds from now;
+ * a `ttl_ms` of 0 never expires */
+#define cdict_ttl__add(ttl, key, val, ttl_ms)                                  \
+  do {                                                                         \
+    if ((cdict_ttl__cap(ttl) == 0) ||                                          \
+        ((double)(cdict__size(ttl) + ((ttl)->cdict_ttl__tombstones_m) + 1) /   \
+         cdict_ttl__cap(ttl)) >= (cdict__max_load_factor(ttl))) {              \
+      /* mostly tombstones: rebuild in place instead of growing */             \
+      cdict_ttl__rehash_(                                                      \
+          (ttl), (cdict_ttl__cap(ttl) == 0)                                    \
+                     ? (CDICT__INITIAL_CAP)                                    \
+                     : (((ttl)->cdict_ttl__tombstones_m) > cdict__size(ttl))   \
+                           ? cdict_ttl__cap(ttl)                               \
+                           : cdict_ttl__cap(ttl) * 2);                         \
+    }                                                                          \
+    uint64_t cdict__ttl_ms_m = (ttl_ms);                                       \
+    (cdict__key(ttl)) = (key);                                                 \
+    uint32_t cdict__slot_m;                                                    \
+    bool cdict__found_m = cdict_ttl__index_((ttl), cdict__key_ref(ttl),        \
+                                            cdict__key(ttl), &cdict__slot_m);  \
+    if (cdict__slot_m != UINT32_MAX) {                                         \
+      if (!cdict__found_m) {                                                   \
+        if (cdict_ttl__psl_at((ttl), cdict__slot_m) == -1) {                   \
+          ((ttl)->cdict_ttl__tombstones_m)--;                                  \
+        }                                                                      \
+        cdict_ttl__psl_at((ttl), cdict__slot_m) = 1;                           \
+        cdict_ttl__key_at((ttl), cdict__slot_m) = cdict__key(ttl);             \
+        cdict__set_size((ttl), cdict__size(ttl) + 1);                          \
+      }                                                                        \
+      cdict_ttl__val_at((ttl), cdict__slot_m) = (val);                         \
+      cdict_ttl__deadline_at((ttl), cdict__slot_m) =                           \
+          cdict__ttl_ms_m ? cdict__now_ms() + cdict__ttl_ms_m : 0;             \
+    }                                                                          \
+  } while (0)
+
+/* slot of the unexpired key or UINT32_MAX; an expired match is reclaimed */
+#define cdict_ttl__lookup_(ttl, key)                                           \
+  ({                                                                           \
+    (cdict__key(ttl)) = (key);                                                 \
+    uint32_t cdict__slot_m;                                                    \
+    bool cdict__found_m = cdict_ttl__index_((ttl), cdict__key_ref(ttl),        \
+                                            cdict__key(ttl), &cdict__slot_m);  \
+    if (!cdict__found_m) {                                                     \
+      cdict__slot_m = UINT32_MAX;                                              \
+    } else if (cdict_ttl__expired(                                             \
+                   cdict_ttl__deadline_at((ttl), cdict__slot_m),               \
+                   cdict__now_ms())) {                                         \
+      cdict_ttl__drop_((ttl), cdict__slot_m);                                  \
+      cdict__slot_m = UINT32_MAX;                                              \
+    }                                                                          \
+    (cdict__slot_m);                                                           \
+  })
+
+#define cdict_ttl__get(ttl, key, buffer)                                       \
+  ({                                                                           \
+    uint32_t cdict__hit_m = cdict_ttl__lookup_((ttl), (key));                  \
+    if (cdict__hit_m != UINT32_MAX) {                                          \
+      (*(buffer)) = cdict_ttl__val_at((ttl), cdict__hit_m);                    \
+    }                                                                          \
+    (cdict__hit_m != UINT32_MAX);                                              \
+  })
+
+#define cdict_ttl__contains(ttl, key)                                          \
+  (cdict_ttl__lookup_((ttl), (key)) != UINT32_MAX)
+
+/* returns whether a live entry was removed */
+#define cdict_ttl__remove(ttl, key)                                            \
+  ({                                                                           \
+    uint32_t cdict__hit_m = cdict_ttl__lookup_((ttl), (key));                  \
+    if (cdict__hit_m != UINT32_MAX) {                                          \
+      cdict_ttl__drop_((ttl), cdict__hit_m);                                   \
+    }                                                                          \
+    (cdict__hit_m != UINT32_MAX);                                              \
+  })
+
+/* Visits the next `budget` buckets, wrapping around, and reclaims the expired
+ * entries among them; returns how many were reclaimed */
+#define cdict_ttl__expire_step(ttl, budget)                                    \
+  ({                                                                           \
+    size_t cdict__reaped_m = 0;                                                \
+    size_t cdict__budget_m = (budget);                                         \
+    size_t cdict__cap_m = cdict_ttl__cap(ttl);                                 \
+    if (cdict__budget_m > cdict__cap_m) {                                      \
+      cdict__budget_m = cdict__cap_m;                                          \
+    }                                                                          \
+    uint64_t cdict__now_m = cdict__now_ms();                                   \
+    size_t cdict__cursor_m = ((ttl)->cdict_ttl__cursor_m);                     \
+    for (size_t cdict__j_m = 0; cdict__j_m < cdict__budget_m; cdict__j_m++) {  \
+      if (cdict_ttl__psl_at((ttl), cdict__cursor_m) > 0 &&                     \
+          cdict_ttl__expired(cdict_ttl__deadline_at((ttl), cdict__cursor_m),   \
+                             cdict__now_m)) {                                  \
+        cdict_ttl__drop_((ttl), cdict__cursor_m);                              \
+        cdict__reaped_m++;                                                     \
+      }                                                                        \
+      cdict__cursor_m = (cdict__cursor_m + 1) & (cdict__cap_m - 1);            \
+    }                                                                          \
+    ((ttl)->cdict_ttl__cursor_m) = cdict__cursor_m;                            \
+    (cdict__reaped_m);                                                         \
+  })
+
+#define cdict_ttl__free(ttl)                                                   \
+  do {                                                                         \
+    cdict__allocator_free(cdict__allocator(ttl), cdict_ttl__buckets(ttl),      \
+                          cdict_ttl__cap(ttl) * cdict_ttl__elem_size(ttl));    \
+    cdict_ttl__init_with_allocator((ttl), cdict__allocator(ttl));              \
+  } while (0)
+
+/* CDict_compact: insertion ordered dict in the style of CPython's compact
+ * dict. Entries live densely in insertion order and the hash index only holds
+ * entry numbers, 1, 2, 4 or 8 bytes wide depending on the capacity, so empty
+ * buckets cost a few bytes instead of a whole entry and iteration is a linear
+ * scan over the entries. Removed entries stay as holes until the next
+ * rebuild. */
+
+/* index slots: 0 empty, 1 removed, otherwise entry number + 2 */
+#define CDICT_COMPACT__EMPTY 0
+#define CDICT_COMPACT__DUMMY 1
+
+/* stored entry hashes have the top bit set, a zero hash marks a hole */
+#define cdict_compact__tag(hash) ((hash) | (1ULL << 63))
+
+static inline size_t cdict_compact__width(size_t index_cap) {
+  if (index_cap <= UINT8_MAX) {
+    return 1;
+  }
+  if (index_cap <= UINT16_MAX) {
+    return 2;
+  }
+  if (index_cap <= UINT32_MAX) {
+    return 4;
+  }
+  return 8;
+}
+
+static inline size_t cdict_compact__slot(const void *index, size_t width,
+                                         size_t i) {
+  switch (width) {
+  case 1:
+    return ((const uint8_t *)index)[i];
+  case 2:
+    return ((const uint16_t *)index)[i];
+  case 4:
+    return ((const uint32_t *)index)[i];
+  default:
+    return ((const uint64_t *)index)[i];
+  }
+}
+
+static inline void cdict_compact__set_slot(void *index, size_t width, size_t i,
+                                           size_t value) {
+  switch (width) {
+  case 1:
+    ((uint8_t *)index)[i] = (uint8_t)value;
+    break;
+  case 2:
+    ((uint16_t *)index)[i] = (uint16_t)value;
+    break;
+  case 4:
+    ((uint32_t *)index)[i] = (uint32_t)value;
+    break;
+  default:
+    ((uint64_t *)index)[i] = (uint64_t)value;
+    break;
+  }
+}
+
+/* the stride of the probe sequence is derived from the stored hash */
+#define cdict_compact__probe(hash, i, cap)                                     \
+  cdict__double_hash_index((hash), (((hash) >> 32) | 1), (i), (cap))
+
+/* index slot for a hash known to be absent, e.g. while rebuilding */
+static inline size_t cdict_compact__free_slot(const void *index, size_t width,
+                                              size_t cap, cdict__u64 hash) {
+  size_t i = 0;
+  size_t slot = cdict_compact__probe(hash, i, cap);
+  while (cdict_compact__slot(index, width, slot) > CDICT_COMPACT__DUMMY) {
+    i++;
+    slot = cdict_compact__probe(hash, i, cap);
+  }
+  return slot;
+}
+
+#define CDict_compact(cdict_key_type_, cdict_value_type_)                      \
+  typedef struct {                                                             \
+    struct {                                                                   \
+      cdict__u64 cdict_compact__hash_m;                                        \
+      cdict_key_type_ key;                                                     \
+      cdict_value_type_ val;                                                   \
+    } * cdict_compact__entries_m;                                              \
+    void *cdict_compact__index_m;                                              \
+    size_t cdict_compact__index_cap_m;                                         \
+    size_t cdict_compact__width_m;                                             \
+    size_t cdict_compact__used_m;                                              \
+    size_t cdict__bucket_size_m;                                               \
+    uint64_t cdict__seed_m;                                                    \
+    cdict_key_type_ cdict__key_m;                                              \
+    const cdict_Allocator *cdict__allocator_m;                                 \
+    bool (*cdict__compare_m)(cdict_key_type_ * self, cdict_key_type_ *other);  \
+    cdict__u64 (*cdict__hash_m)(cdict_key_type_ * self,                        \
+                                cdict__u64 (*hash)(void *, size_t));           \
+  }
+
+#define cdict_compact__size(compact) cdict__size(compact)
+#define cdict_compact__entries(compact) ((compact)->cdict_compact__entries_m)
+#define cdict_compact__index(compact) ((compact)->cdict_compact__index_m)
+#define cdict_compact__index_cap(compact)                                      \
+  ((compact)->cdict_compact__index_cap_m)
+#define cdict_compact__width_of(compact) ((compact)->cdict_compact__width_m)
+#define cdict_compact__entry_size(compact)                                     \
+  (sizeof(*cdict_compact__entries(compact)))
+
+/* two thirds of the index, as in CPython */
+#define cdict_compact__usable(index_cap) (((index_cap)*2) / 3)
+
+/* entries [0, end) include holes left by removals, see `cdict_compact__next` */
+#define cdict_compact__end(compact) ((compact)->cdict_compact__used_m)
+#define cdict_compact__hash_at(compact, i)                                     \
+  (cdict_compact__entries(compact)[(i)].cdict_compact__hash_m)
+#define cdict_compact__key_at(compact, i)                                      \
+  (cdict_compact__entries(compact)[(i)].key)
+#define cdict_compact__val_at(compact, i)                                      \
+  (cdict_compact__entries(compact)[(i)].val)
+
+/* first live entry at or after `i`, `cdict_compact__end` when there is none */
+#define cdict_compact__next(compact, i)                                        \
+  ({                                                                           \
+    size_t cdict__i_m = (i);                                                   \
+    while (cdict__i_m < cdict_compact__end(compact) &&                         \
+           cdict_compact__hash_at((compact), cdict__i_m) == 0) {               \
+      cdict__i_m++;                                                            \
+    }                                                                          \
+    (cdict__i_m);                                                              \
+  })
+
+#define cdict_compact__init(compact)                                           \
+  cdict_compact__init_with_allocator((compact), NULL)
+
+/* Nothing is allocated until the first `cdict_compact__add` */
+#define cdict_compact__init_with_allocator(compact, allocator)                 \
+  do {                                                                         \
+    cdict_compact__entries(compact) = NULL;                                    \
+    cdict_compact__index(compact) = NULL;                                      \
+    cdict_compact__index_cap(compact) = 0;                                     \
+    cdict_compact__width_of(compact) = 1;                                      \
+    ((compact)->cdict_compact__used_m) = 0;                                    \
+    cdict__set_size((compact), 0);                                             \
+    cdict__set_seed((compact), cdict__random_seed());                          \
+    cdict__set_comparator((compact), (NULL));                                  \
+    cdict__set_hash((compact), (NULL));                                        \
+    (cdict__allocator(compact)) = (allocator);                                 \
+  } while (0)
+
+/* Entry number of the key or SIZE_MAX; `*slot` is set to its index slot, or
+ * otherwise to the first reusable slot of its probe sequence */
+#define cdict_compact__lookup_(compact, ref, key, hash, slot)                  \
+  ({                                                                           \
+    size_t cdict__entry_m = SIZE_MAX;                                          \
+    size_t cdict__cap_m = cdict_compact__index_cap(compact);                   \
+    *(slot) = SIZE_MAX;                                                        \
+    for (size_t cdict__i_m = 0; cdict__i_m < cdict__cap_m; cdict__i_m++) {     \
+      size_t cdict__at_m =                                                     \
+          cdict_compact__probe((hash), cdict__i_m, cdict__cap_m);              \
+      size_t cdict__value_m =                                                  \
+          cdict_compact__slot(cdict_compact__index(compact),                   \
+                              cdict_compact__width_of(compact), cdict__at_m);  \
+      if (cdict__value_m <= CDICT_COMPACT__DUMMY) {                            \
+        if (*(slot) == SIZE_MAX) {                                             \
+          *(slot) = cdict__at_m;                                               \
+        }                                                                      \
+        if (cdict__value_m == CDICT_COMPACT__EMPTY) {                          \
+          break;                                                               \
+        }                                                                      \
+        continue;                                                              \
+      }                                                                        \
+      cdict__value_m -= 2;                                                     \
+      if (cdict_compact__hash_at((compact), cdict__value_m) != (hash)) {       \
+        continue;                                                              \
+      }                                                                        \
+      bool cdict__matches_m =                                                  \
+          (cdict__compare(compact))                                            \
+              ? (cdict__compare(compact))(                                     \
+                    &cdict_compact__key_at((compact), cdict__value_m), (ref))  \
+              : cdict__bytes_compare(                                          \
+                    &cdict_compact__key_at((compact), cdict__value_m), (ref),  \
+                    sizeof(key));                                              \
+      if (cdict__matches_m) {                                                  \
+        *(slot) = cdict__at_m;                                                 \
+        cdict__entry_m = cdict__value_m;                                       \
+        break;                                                                 \
+      }                                                                        \
+    }                                                                          \
+    (cdict__entry_m);                                                          \
+  })
+
+/* Closes the holes, keeping the insertion order, and rebuilds the index with
+ * `index_cap` slots from the stored hashes; no key is hashed again. Both
+ * arrays are allocated first: false, with the dict unchanged, when either
+ * fails. The entries are reallocated in place when all of them still fit,
+ * otherwise the live ones are copied to a new array. */
+#define cdict_compact__rebuild_(compact, index_cap)                            \
+  ({                                                                           \
+    size_t cdict__new_cap_m = (index_cap);                                     \
+    size_t cdict__width_m = cdict_compact__width(cdict__new_cap_m);            \
+    size_t cdict__old_bytes_m =                                                \
+        cdict_compact__usable(cdict_compact__index_cap(compact)) *             \
+        cdict_compact__entry_size(compact);                                    \
+    size_t cdict__new_bytes_m = cdict_compact__usable(cdict__new_cap_m) *      \
+                                cdict_compact__entry_size(compact);            \
+    bool cdict__in_place_m =                                                   \
+        cdict_compact__usable(cdict__new_cap_m) >= cdict_compact__end(compact);\
+    void *cdict__index_m = cdict__allocator_zalloc(                            \
+        cdict__allocator(compact), cdict__new_cap_m * cdict__width_m);         \
+    __typeof__(cdict_compact__entries(compact)) cdict__entries_m = NULL;       \
+    if (cdict__index_m != NULL && cdict__in_place_m) {                         \
+      cdict__entries_m = cdict__allocator_realloc(                             \
+          cdict__allocator(compact), cdict_compact__entries(compact),          \
+          cdict__old_bytes_m, cdict__new_bytes_m);                             \
+    } else if (cdict__index_m != NULL) {                                       \
+      cdict__entries_m = cdict__allocator_alloc(cdict__allocator(compact),     \
+                                                cdict__new_bytes_m);           \
+    }                                                                          \
+    bool cdict__rebuilt_m = cdict__entries_m != NULL;                          \
+    if (!cdict__rebuilt_m) {                                                   \
+      cdict__allocator_free(cdict__allocator(compact), cdict__index_m,         \
+                            cdict__new_cap_m * cdict__width_m);                \
+    } else {                                                                   \
+      __typeof__(cdict__entries_m) cdict__from_m =                             \
+          cdict__in_place_m ? cdict__entries_m                                 \
+                            : cdict_compact__entries(compact);                 \
+      size_t cdict__live_m = 0;                                                \
+      for (size_t cdict__j_m = 0; cdict__j_m < cdict_compact__end(compact);    \
+           cdict__j_m++) {                                                     \
+        if (cdict__from_m[cdict__j_m].cdict_compact__hash_m != 0) {            \
+          cdict__entries_m[cdict__live_m++] = cdict__from_m[cdict__j_m];       \
+        }                                                                      \
+      }                                                                        \
+      if (!cdict__in_place_m) {                                                \
+        cdict__allocator_free(cdict__allocator(compact),                       \
+                              cdict_compact__entries(compact),                 \
+                              cdict__old_bytes_m);                             \
+      }                                                                        \
+      cdict_compact__entries(compact) = cdict__entries_m;                      \
+      for (size_t cdict__j_m = 0; cdict__j_m < cdict__live_m; cdict__j_m++) {  \
+        cdict_compact__set_slot(                                               \
+            cdict__index_m, cdict__width_m,                                    \
+            cdict_compact__free_slot(                                          \
+                cdict__index_m, cdict__width_m, cdict__new_cap_m,              \
+                cdict_compact__hash_at((compact), cdict__j_m)),                \
+            cdict__j_m + 2);                                                   \
+      }                                                                        \
+      cdict__allocator_free(cdict__allocator(compact),                         \
+                            cdict_compact__index(compact),                     \
+                            cdict_compact__index_cap(compact) *                \
+                                cdict_compact__width_of(compact));             \
+      cdict_compact__index(compact) = cdict__index_m;                          \
+      cdict_compact__index_cap(compact) = cdict__new_cap_m;                    \
+      cdict_compact__width_of(compact) = cdict__width_m;                       \
+      ((compact)->cdict_compact__used_m) = cdict__live_m;                      \
+    }                                                                          \
+    (cdict__rebuilt_m);                                                        \
+  })
+
+/* a new key is appended, an existing one keeps its position; false when a
+ * new key found no room because the arrays could not grow */
+#define cdict_compact__add(compact, key, val)                                  \
+  ({                                                                           \
+    bool cdict__room_m = true;                                                 \
+    if (cdict_compact__end(compact) >=                                         \
+        cdict_compact__usable(cdict_compact__index_cap(compact))) {            \
+      /* grows for live entries, holes alone only cost a compaction */         \
+      size_t cdict__want_m = (CDICT__INITIAL_CAP);                             \
+      while (cdict_compact__usable(cdict__want_m) <=                           \
+             2 * cdict__size(compact)) {                                       \
+        cdict__want_m *= 2;                                                    \
+      }                                                                        \
+      cdict__room_m = cdict_compact__rebuild_((compact), cdict__want_m);       \
+    }                                                                          \
+    (cdict__key(compact)) = (key);                                             \
+    cdict__u64 cdict__h1_m = cdict__h1hash(                                    \
+        (compact), cdict__key_ref(compact), cdict__key(compact));              \
+    cdict__h1_m = cdict_compact__tag(cdict__h1_m);                             \
+    size_t cdict__slot_m;                                                      \
+    size_t cdict__entry_m = cdict_compact__lookup_(                            \
+        (compact), cdict__key_ref(compact), cdict__key(compact), cdict__h1_m,  \
+        &cdict__slot_m);                                                       \
+    if (cdict__entry_m == SIZE_MAX && cdict__room_m) {                         \
+      cdict__entry_m = ((compact)->cdict_compact__used_m)++;                   \
+      cdict_compact__hash_at((compact), cdict__entry_m) = cdict__h1_m;         \
+      cdict_compact__key_at((compact), cdict__entry_m) = cdict__key(compact);  \
+      cdict_compact__set_slot(cdict_compact__index(compact),                   \
+                              cdict_compact__width_of(compact), cdict__slot_m, \
+                              cdict__entry_m + 2);                             \
+      cdict__set_size((compact), cdict__size(compact) + 1);                    \
+    }                                                                          \
+    if (cdict__entry_m != SIZE_MAX) {                                          \
+      cdict_compact__val_at((compact), cdict__entry_m) = (val);                \
+    }                                                                          \
+    (cdict__entry_m != SIZE_MAX);                                              \
+  })
+
+/* entry number of the key or SIZE_MAX */
+#define cdict_compact__find_(compact, key, slot)                               \
+  ({                                                                           \
+    (cdict__key(compact)) = (key);                                             \
+    cdict__u64 cdict__h1_m = cdict__h1hash(                                    \
+        (compact), cdict__key_ref(compact), cdict__key(compact));              \
+    cdict__h1_m = cdict_compact__tag(cdict__h1_m);                             \
+    cdict_compact__lookup_((compact), cdict__key_ref(compact),                 \
+                           cdict__key(compact), cdict__h1_m, (slot));          \
+  })
+
+#define cdict_compact__get(compact, key, buffer)                               \
+  ({                                                                           \
+    size_t cdict__slot_m;                                                      \
+    size_t cdict__entry_m =                                                    \
+        cdict_compact__find_((compact), (key), &cdict__slot_m);                \
+    if (cdict__entry_m != SIZE_MAX) {                                          \
+      (*(buffer)) = cdict_compact__val_at((compact), cdict__entry_m);          \
+    }                                                                          \
+    (cdict__entry_m != SIZE_MAX);                                              \
+  })
+
+#define cdict_compact__contains(compact, key)                                  \
+  ({                                                                           \
+    size_t cdict__slot_m;                                                      \
+    (cdict_compact__find_((compact), (key), &cdict__slot_m) != SIZE_MAX);      \
+  })
+
+/* leaves a hole in the entries, the order of the others is kept */
+#define cdict_compact__remove(compact, key)                                    \
+  ({                                                                           \
+    size_t cdict__slot_m;                                                      \
+    size_t cdict__entry_m =                                                    \
+        cdict_compact__find_((compact), (key), &cdict__slot_m);                \
+    if (cdict__entry_m != SIZE_MAX) {                                          \
+      cdict_compact__set_slot(cdict_compact__index(compact),                   \
+                              cdict_compact__width_of(compact), cdict__slot_m, \
+                              CDICT_COMPACT__DUMMY);                           \
+      cdict_compact__hash_at((compact), cdict__entry_m) = 0;                   \
+      cdict__set_size((compact), cdict__size(compact) - 1);                    \
+    }                                                                          \
+    (cdict__entry_m != SIZE_MAX);                                              \
+  })
+
+#define cdict_compact__free(compact)                                           \
+  do {                                                                         \
+    cdict__allocator_free(                                                     \
+        cdict__allocator(compact), cdict_compact__entries(compact),            \
+        cdict_compact__usable(cdict_compact__index_cap(compact)) *             \
+            cdict_compact__entry_size(compact));                               \
+    cdict__allocator_free(                                                     \
+        cdict__allocator(compact), cdict_compact__index(compact),              \
+        cdict_compact__index_cap(compact) * cdict_compact__width_of(compact)); \
+    cdict_compact__init_with_allocator((compact), cdict__allocator(compact));  \
+  } while (0)
+
+/* Snapshot: the bucket array written as is after a fixed size header, so that
+ * `cdict__mmap_open` can use it straight from the page cache without rehashing
+ * or copying. Keys and values must not hold pointers, and a dict using a
+ * custom hash must set the same hash after opening. Mapped dicts are read
+ * only; `cdict__free` unmaps them. */
+
+#define CDICT__SNAPSHOT_MAGIC "CDICTSNP"
+#define CDICT__SNAPSHOT_VERSION 1
+#define CDICT__SNAPSHOT_ENDIAN 0x01020304
+/* buckets start on their own page */
+#define CDICT__SNAPSHOT_OFFSET 4096
+
+#ifndef CDICT__SNAPSHOT_VERIFY
+#define CDICT__SNAPSHOT_VERIFY 1
+#endif
+
+typedef struct cdict_Snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t seed;
+  uint64_t cap;
+  uint64_t size;
+  uint64_t key_size;
+  uint64_t value_size;
+  uint64_t elem_size;
+  uint64_t checksum;
+  uint64_t header_checksum;
+} cdict_Snapshot_header;
+
+#define cdict__snapshot_header_checksum(header)                                \
+  cdict__XXH64((header), offsetof(cdict_Snapshot_header, header_checksum),     \
+               CDICT__DEFAULT_SEED)
+
+#if CDICT__HAS_MMAP
+
+static inline void *cdict__snapshot_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  (void)size;
+  return NULL;
+}
+
+static inline void cdict__snapshot_unmap(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  munmap(((char *)ptr) - CDICT__SNAPSHOT_OFFSET,
+         size + CDICT__SNAPSHOT_OFFSET);
+}
+
+static const cdict_Allocator cdict__snapshot_allocator = {
+    .alloc = cdict__snapshot_alloc,
+    .free = cdict__snapshot_unmap,
+    .realloc = NULL,
+    .zalloc = NULL,
+    .ctx = NULL};
+
+static inline bool cdict__snapshot_write(int fd, const void *buffer,
+                                         size_t size) {
+  const char *ptr = (const char *)buffer;
+  while (size > 0) {
+    ssize_t written = write(fd, ptr, size);
+    if (written < 0) {
+      return false;
+    }
+    ptr += written;
+    size -= (size_t)written;
+  }
+  return true;
+}
+
+/* written to `path`.tmp then renamed, so readers never see a partial file */
+static inline bool cdict__snapshot_save(const char *path, const void *buckets,
+                                        size_t cap, size_t size, uint64_t seed,
+                                        size_t key_size, size_t value_size,
+                                        size_t elem_size) {
+  cdict_Snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CDICT__SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = CDICT__SNAPSHOT_VERSION;
+  header.endian = CDICT__SNAPSHOT_ENDIAN;
+  header.seed = seed;
+  header.cap = cap;
+  header.size = size;
+  header.key_size = key_size;
+  header.value_size = value_size;
+  header.elem_size = elem_size;
+  header.checksum = cdict__XXH64(buckets, cap * elem_size, CDICT__DEFAULT_SEED);
+  header.header_checksum = cdict__snapshot_header_checksum(&header);
+
+  size_t path_len = strlen(path);
+  char *tmp_path = (char *)malloc(path_len + sizeof(".tmp"));
+  if (tmp_path == NULL) {
+    return false;
+  }
+  memcpy(tmp_path, path, path_len);
+  memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+
+  bool ok = false;
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    char page[CDICT__SNAPSHOT_OFFSET];
+    memset(page, 0, sizeof(page));
+    memcpy(page, &header, sizeof(header));
+    ok = cdict__snapshot_write(fd, page, sizeof(page)) &&
+         cdict__snapshot_write(fd, buckets, cap * elem_size) && fsync(fd) == 0;
+    ok = (close(fd) == 0) && ok;
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok) {
+      unlink(tmp_path);
+    }
+  }
+  free(tmp_path);
+  return ok;
+}
+
+static inline bool cdict__snapshot_map(const char *path, size_t key_size,
+                                       size_t value_size, size_t elem_size,
+                                       uint64_t *seed, size_t *cap,
+                                       size_t *size, void **buckets) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  cdict_Snapshot_header header;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < CDICT__SNAPSHOT_OFFSET ||
+      pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    close(fd);
+    return false;
+  }
+  if (memcmp(header.magic, CDICT__SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != CDICT__SNAPSHOT_VERSION ||
+      header.endian != CDICT__SNAPSHOT_ENDIAN ||
+      header.header_checksum != cdict__snapshot_header_checksum(&header) ||
+      header.key_size != key_size || header.value_size != value_size ||
+      header.elem_size != elem_size ||
+      (header.cap & (header.cap - 1)) != 0 ||
+      (size_t)st.st_size != CDICT__SNAPSHOT_OFFSET + header.cap * elem_size) {
+    close(fd);
+    return false;
+  }
+  *buckets = NULL;
+  if (header.cap > 0) {
+    char *base = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+                              fd, 0);
+    if (base == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    *buckets = base + CDICT__SNAPSHOT_OFFSET;
+    if (CDICT__SNAPSHOT_VERIFY &&
+        cdict__XXH64(*buckets, header.cap * elem_size, CDICT__DEFAULT_SEED) !=
+            header.checksum) {
+      munmap(base, (size_t)st.st_size);
+      close(fd);
+      return false;
+    }
+  }
+  close(fd);
+  *seed = header.seed;
+  *cap = header.cap;
+  *size = header.size;
+  return true;
+}
+
+#define cdict__save(cdict, path)                                               \
+  cdict__snapshot_save(                                                        \
+      (path), cdict_vector__elem(cdict__vector_buckets_ref(cdict)),            \
+      cdict__cap(cdict), cdict__size(cdict), cdict__seed(cdict),               \
+      sizeof(cdict__key(cdict)), sizeof((cdict)->cdict__value_m),              \
+      sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))))
+
+/* `cdict` must not hold buckets; on success it reads from the mapping */
+#define cdict__mmap_open(cdict, path)                                          \
+  ({                                                                           \
+    uint64_t cdict__seed_m = 0;                                                \
+    size_t cdict__cap_m = 0;                                                   \
+    size_t cdict__size_m = 0;                                                  \
+    void *cdict__buckets_m = NULL;                                             \
+    cdict__init(cdict);                                                        \
+    bool cdict__ok_m = cdict__snapshot_map(                                    \
+        (path), sizeof(cdict__key(cdict)), sizeof((cdict)->cdict__value_m),    \
+        sizeof(*cdict_vector__elem(cdict__vector_buckets_ref(cdict))),         \
+        &cdict__seed_m, &cdict__cap_m, &cdict__size_m, &cdict__buckets_m);     \
+    if (cdict__ok_m) {                                                         \
+      cdict__set_seed((cdict), cdict__seed_m);                                 \
+      cdict__set_size((cdict), cdict__size_m);                                 \
+      cdict_vector__set_elem(cdict__vector_buckets_ref(cdict),                 \
+                             cdict__buckets_m);                                \
+      (cdict_vector__cap(cdict__vector_buckets_ref(cdict))) = cdict__cap_m;    \
+      (cdict__allocator(cdict)) = &cdict__snapshot_allocator;                  \
+    }                                                                          \
+    (cdict__ok_m);                                                             \
+  })
+
+
+/* Wal: append-only write-ahead log for durable dicts. Every add/remove is
+ * appended as a compact binary record (op, key, value, checksum) to a user
+ * space buffer; records are written and fsynced together once
+ * `max_records` are pending or `max_delay_ms` passed since the last sync
+ * (group commit). The delay is checked on append and by `cdict_wal__tick`. */
+
+#define CDICT__WAL_MAGIC "CDICTWAL"
+#define CDICT__WAL_VERSION 1
+#define CDICT__WAL_ADD 1
+#define CDICT__WAL_REMOVE 2
+
+#ifndef CDICT__WAL_BUFFER_SIZE
+#define CDICT__WAL_BUFFER_SIZE (64 * 1024)
+#endif
+
+#ifndef CDICT__WAL_GROUP_COMMIT_RECORDS
+#define CDICT__WAL_GROUP_COMMIT_RECORDS 256
+#endif
+
+#ifndef CDICT__WAL_GROUP_COMMIT_MS
+#define CDICT__WAL_GROUP_COMMIT_MS 10
+#endif
+
+typedef struct cdict_Wal_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t key_size;
+  uint64_t value_size;
+} cdict_Wal_header;
+
+typedef struct cdict_Wal {
+  int cdict_wal__fd_m;
+  int cdict_wal__old_fd_m;
+  char *cdict_wal__path_m;
+  size_t cdict_wal__key_size_m;
+  size_t cdict_wal__value_size_m;
+  char *cdict_wal__buffer_m;
+  size_t cdict_wal__used_m;
+  size_t cdict_wal__cap_m;
+  size_t cdict_wal__pending_m;
+  size_t cdict_wal__max_pending_m;
+  uint64_t cdict_wal__max_delay_ms_m;
+  uint64_t cdict_wal__last_sync_ms_m;
+  bool cdict_wal__ok_m;
+} cdict_Wal;
+
+#define cdict_wal__ok(wal) ((wal)->cdict_wal__ok_m)
+
+#define cdict_wal__record_size(wal, op)                                        \
+  (1 + (wal)->cdict_wal__key_size_m +                                          \
+   (((op) == CDICT__WAL_ADD) ? (wal)->cdict_wal__value_size_m : 0) +           \
+   sizeof(uint32_t))
+
+static inline bool cdict_wal__flush(cdict_Wal *wal) {
+  bool ok = cdict__snapshot_write(wal->cdict_wal__fd_m,
+                                  wal->cdict_wal__buffer_m,
+                                  wal->cdict_wal__used_m);
+  wal->cdict_wal__used_m = 0;
+  wal->cdict_wal__ok_m = wal->cdict_wal__ok_m && ok;
+  return ok;
+}
+
+static inline bool cdict_wal__sync(cdict_Wal *wal) {
+  bool ok = cdict_wal__flush(wal);
+#if defined(__APPLE__)
+  ok = ok && fsync(wal->cdict_wal__fd_m) == 0;
+#else
+  ok = ok && fdatasync(wal->cdict_wal__fd_m) == 0;
+#endif
+  wal->cdict_wal__pending_m = 0;
+  wal->cdict_wal__last_sync_ms_m = cdict__now_ms();
+  wal->cdict_wal__ok_m = wal->cdict_wal__ok_m && ok;
+  return ok;
+}
+
+/* syncs when records are pending for longer than the group commit delay */
+static inline bool cdict_wal__tick(cdict_Wal *wal) {
+  if (wal->cdict_wal__pending_m > 0 &&
+      (cdict__now_ms() - wal->cdict_wal__last_sync_ms_m) >=
+          wal->cdict_wal__max_delay_ms_m) {
+    return cdict_wal__sync(wal);
+  }
+  return wal->cdict_wal__ok_m;
+}
+
+static inline void cdict_wal__set_group_commit(cdict_Wal *wal,
+                                               size_t max_records,
+                                               uint64_t max_delay_ms) {
+  wal->cdict_wal__max_pending_m = max_records ? max_records : 1;
+  wal->cdict_wal__max_delay_ms_m = max_delay_ms;
+}
+
+static inline void cdict_wal__put_header(cdict_Wal *wal) {
+  cdict_Wal_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CDICT__WAL_MAGIC, sizeof(header.magic));
+  header.version = CDICT__WAL_VERSION;
+  header.endian = CDICT__SNAPSHOT_ENDIAN;
+  header.key_size = wal->cdict_wal__key_size_m;
+  header.value_size = wal->cdict_wal__value_size_m;
+  memcpy(wal->cdict_wal__buffer_m, &header, sizeof(header));
+  wal->cdict_wal__used_m = sizeof(header);
+}
+
+/* buffers one record, no group commit */
+static inline void cdict_wal__put(cdict_Wal *wal, int op, const void *key,
+                                  const void *value) {
+  size_t record_size = cdict_wal__record_size(wal, op);
+  if (wal->cdict_wal__cap_m - wal->cdict_wal__used_m < record_size) {
+    cdict_wal__flush(wal);
+  }
+  char *record = wal->cdict_wal__buffer_m + wal->cdict_wal__used_m;
+  record[0] = (char)op;
+  memcpy(record + 1, key, wal->cdict_wal__key_size_m);
+  if (op == CDICT__WAL_ADD) {
+    memcpy(record + 1 + wal->cdict_wal__key_size_m, value,
+           wal->cdict_wal__value_size_m);
+  }
+  uint32_t checksum = (uint32_t)cdict__XXH64(
+      record, record_size - sizeof(uint32_t), CDICT__DEFAULT_SEED);
+  memcpy(record + record_size - sizeof(uint32_t), &checksum, sizeof(checksum));
+  wal->cdict_wal__used_m += record_size;
+}
+
+static inline bool cdict_wal__append(cdict_Wal *wal, int op, const void *key,
+                                     const void *value) {
+  cdict_wal__put(wal, op, key, value);
+  (wal->cdict_wal__pending_m)++;
+  if (wal->cdict_wal__pending_m >= wal->cdict_wal__max_pending_m) {
+    return cdict_wal__sync(wal);
+  }
+  return cdict_wal__tick(wal);
+}
+
+static inline bool cdict_wal__open_(cdict_Wal *wal, const char *path,
+                                    size_t key_size, size_t value_size) {
+  memset(wal, 0, sizeof(*wal));
+  wal->cdict_wal__old_fd_m = -1;
+  wal->cdict_wal__key_size_m = key_size;
+  wal->cdict_wal__value_size_m = value_size;
+  wal->cdict_wal__cap_m = CDICT__WAL_BUFFER_SIZE;
+  if (wal->cdict_wal__cap_m < sizeof(cdict_Wal_header) + 1 + key_size +
+                                  value_size + sizeof(uint32_t)) {
+    wal->cdict_wal__cap_m =
+        sizeof(cdict_Wal_header) + 1 + key_size + value_size + sizeof(uint32_t);
+  }
+  wal->cdict_wal__buffer_m = (char *)malloc(wal->cdict_wal__cap_m);
+  wal->cdict_wal__path_m = strdup(path);
+  wal->cdict_wal__fd_m = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  wal->cdict_wal__ok_m = true;
+  cdict_wal__set_group_commit(wal, CDICT__WAL_GROUP_COMMIT_RECORDS,
+                              CDICT__WAL_GROUP_COMMIT_MS);
+  wal->cdict_wal__last_sync_ms_m = cdict__now_ms();
+  struct stat st;
+  if (wal->cdict_wal__buffer_m == NULL || wal->cdict_wal__path_m == NULL ||
+      wal->cdict_wal__fd_m < 0 || fstat(wal->cdict_wal__fd_m, &st) != 0) {
+    wal->cdict_wal__ok_m = false;
+    return false;
+  }
+  if (st.st_size == 0) {
+    cdict_wal__put_header(wal);
+    return cdict_wal__sync(wal);
+  }
+  cdict_Wal_header header;
+  if (pread(wal->cdict_wal__fd_m, &header, sizeof(header), 0) !=
+          (ssize_t)sizeof(header) ||
+      memcmp(header.magic, CDICT__WAL_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != CDICT__WAL_VERSION ||
+      header.endian != CDICT__SNAPSHOT_ENDIAN ||
+      header.key_size != key_size || header.value_size != value_size) {
+    wal->cdict_wal__ok_m = false;
+  }
+  return wal->cdict_wal__ok_m;
+}
+
+/* Returns the next valid record at `*cursor` (advancing it) or NULL at the end
+ * of the log or at a torn / corrupted tail. */
+static inline const char *cdict_wal__next(cdict_Wal *wal, const char **cursor,
+                                          const char *end) {
+  const char *record = *cursor;
+  if (record >= end) {
+    return NULL;
+  }
+  int op = record[0];
+  if (op != CDICT__WAL_ADD && op != CDICT__WAL_REMOVE) {
+    return NULL;
+  }
+  size_t record_size = cdict_wal__record_size(wal, op);
+  if ((size_t)(end - record) < record_size) {
+    return NULL;
+  }
+  uint32_t checksum;
+  memcpy(&checksum, record + record_size - sizeof(uint32_t), sizeof(checksum));
+  if (checksum != (uint32_t)cdict__XXH64(record, record_size - sizeof(uint32_t),
+                                         CDICT__DEFAULT_SEED)) {
+    return NULL;
+  }
+  *cursor = record + record_size;
+  return record;
+}
+
+/* Maps the log for replay; `*begin` points at the first record */
+static inline bool cdict_wal__map(cdict_Wal *wal, const char **begin,
+                                  const char **end, size_t *len) {
+  struct stat st;
+  *begin = *end = NULL;
+  *len = 0;
+  if (!cdict_wal__sync(wal) || fstat(wal->cdict_wal__fd_m, &st) != 0) {
+    return false;
+  }
+  if ((size_t)st.st_size <= sizeof(cdict_Wal_header)) {
+    return true;
+  }
+  char *base = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                            wal->cdict_wal__fd_m, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  *len = (size_t)st.st_size;
+  *begin = base + sizeof(cdict_Wal_header);
+  *end = base + *len;
+  return true;
+}
+
+/* Drops a torn tail after replay so that new records follow valid ones */
+static inline void cdict_wal__unmap(cdict_Wal *wal, const char *begin,
+                                    const char *cursor, const char *end,
+                                    size_t len) {
+  if (begin == NULL) {
+    return;
+  }
+  if (cursor < end) {
+    wal->cdict_wal__ok_m =
+        wal->cdict_wal__ok_m &&
+        ftruncate(wal->cdict_wal__fd_m,
+                  (off_t)(sizeof(cdict_Wal_header) + (cursor - begin))) == 0;
+  }
+  munmap((void *)(begin - sizeof(cdict_Wal_header)), len);
+}
+
+static inline bool cdict_wal__compact_begin(cdict_Wal *wal) {
+  size_t path_len = strlen(wal->cdict_wal__path_m);
+  char *tmp_path = (char *)malloc(path_len + sizeof(".tmp"));
+  if (tmp_path == NULL || !cdict_wal__sync(wal)) {
+    free(tmp_path);
+    return false;
+  }
+  memcpy(tmp_path, wal->cdict_wal__path_m, path_len);
+  memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+  int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  free(tmp_path);
+  if (fd < 0) {
+    return false;
+  }
+  wal->cdict_wal__old_fd_m = wal->cdict_wal__fd_m;
+  wal->cdict_wal__fd_m = fd;
+  cdict_wal__put_header(wal);
+  return true;
+}
+
+static inline bool cdict_wal__compact_end(cdict_Wal *wal) {
+  size_t path_len = strlen(wal->cdict_wal__path_m);
+  char *tmp_path = (char *)malloc(path_len + sizeof(".tmp"));
+  bool ok = tmp_path != NULL && cdict_wal__sync(wal);
+  if (tmp_path) {
+    memcpy(tmp_path, wal->cdict_wal__path_m, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+    ok = ok && rename(tmp_path, wal->cdict_wal__path_m) == 0;
+  }
+  if (ok) {
+    close(wal->cdict_wal__old_fd_m);
+  } else {
+    /* keep appending to the old log */
+    close(wal->cdict_wal__fd_m);
+    if (tmp_path) {
+      unlink(tmp_path);
+    }
+    wal->cdict_wal__fd_m = wal->cdict_wal__old_fd_m;
+    wal->cdict_wal__used_m = 0;
+    wal->cdict_wal__ok_m = true;
+  }
+  wal->cdict_wal__old_fd_m = -1;
+  free(tmp_path);
+  return ok;
+}
+
+static inline bool cdict_wal__close(cdict_Wal *wal) {
+  bool ok = wal->cdict_wal__fd_m >= 0 && cdict_wal__sync(wal);
+  if (wal->cdict_wal__fd_m >= 0) {
+    ok = (close(wal->cdict_wal__fd_m) == 0) && ok;
+  }
+  free(wal->cdict_wal__buffer_m);
+  free(wal->cdict_wal__path_m);
+  wal->cdict_wal__buffer_m = NULL;
+  wal->cdict_wal__path_m = NULL;
+  wal->cdict_wal__fd_m = -1;
+  return ok;
+}
+
+#define cdict_wal__open(wal, cdict, path)                                      \
+  cdict_wal__open_((wal), (path), sizeof(cdict__key(cdict)),                   \
+                   sizeof((cdict)->cdict__value_m))
+
+/* returns whether the record was logged and added; nothing is logged when
+ * the dict could not grow */
+#define cdict_wal__add(wal, cdict, key, val)                                   \
+  ({                                                                           \
+    (cdict__key(cdict)) = (key);                                               \
+    ((cdict)->cdict__value_m) = (val);                                         \
+    bool cdict__logged_m =                                                     \
+        cdict__add((cdict), cdict__key(cdict), ((cdict)->cdict__value_m)) &&   \
+        cdict_wal__append((wal), CDICT__WAL_ADD, cdict__key_ref(cdict),        \
+                          &((cdict)->cdict__value_m));                         \
+    (cdict__logged_m);                                                         \
+  })
+
+/* only effective removals are logged; see `cdict_wal__ok` for log errors */
+#define cdict_wal__remove(wal, cdict, key)                                     \
+  ({                                                                           \
+    (cdict__key(cdict)) = (key);                                               \
+    bool cdict__removed_m = cdict__remove((cdict), cdict__key(cdict));         \
+    if (cdict__removed_m) {                                                    \
+      cdict_wal__append((wal), CDICT__WAL_REMOVE, cdict__key_ref(cdict),       \
+                        NULL);                                                 \
+    }                                                                          \
+    (cdict__removed_m);                                                        \
+  })
+
+/* Rebuilds `cdict` (initialized) by replaying the log onto a table presized
+ * for the logged adds. */
+#define cdict_wal__recover(wal, cdict)                                         \
+  ({                                                                           \
+    const char *cdict__begin_m;                                                \
+    const char *cdict__end_m;                                                  \
+    size_t cdict__len_m;                                                       \
+    bool cdict__ok_m = cdict_wal__map((wal), &cdict__begin_m, &cdict__end_m,   \
+                                      &cdict__len_m);                          \
+    const char *cdict__cursor_m = cdict__begin_m;                              \
+    const char *cdict__record_m;                                               \
+    size_t cdict__adds_m = 0;                                                  \
+    while (cdict__ok_m && (cdict__record_m = cdict_wal__next(                  \
+                               (wal), &cdict__cursor_m, cdict__end_m))) {      \
+      cdict__adds_m += (cdict__record_m[0] == CDICT__WAL_ADD);                 \
+    }                                                                          \
+    cdict__reserve((cdict), cdict__adds_m);                                    \
+    cdict__cursor_m = cdict__begin_m;                                          \
+    while (cdict__ok_m && (cdict__record_m = cdict_wal__next(                  \
+                               (wal), &cdict__cursor_m, cdict__end_m))) {      \
+      memcpy(cdict__key_ref(cdict), cdict__record_m + 1,                       \
+             sizeof(cdict__key(cdict)));                                       \
+      if (cdict__record_m[0] == CDICT__WAL_ADD) {                              \
+        memcpy(&((cdict)->cdict__value_m),                                     \
+               cdict__record_m + 1 + sizeof(cdict__key(cdict)),                \
+               sizeof((cdict)->cdict__value_m));                               \
+        cdict__ok_m = cdict__add((cdict), cdict__key(cdict),                   \
+                                 ((cdict)->cdict__value_m));                   \
+      } else {                                                                 \
+        cdict__remove((cdict), cdict__key(cdict));                             \
+      }                                                                        \
+    }                                                                          \
+    cdict_wal__unmap((wal), cdict__begin_m, cdict__cursor_m, cdict__end_m,     \
+                     cdict__len_m);                                            \
+    (cdict__ok_m && cdict_wal__ok(wal));                                       \
+  })
+
+/* Rewrites the log with one add record per live entry */
+#define cdict_wal__compact(wal, cdict)                                         \
+  ({                                                                           \
+    bool cdict__ok_m = cdict_wal__compact_begin(wal);                          \
+    for (size_t cdict__i_m = 0; cdict__ok_m && cdict__i_m < cdict__cap(cdict); \
+         cdict__i_m++) {                                                       \
+      if (cdict__elem_psl(cdict_vector__index(                                 \
+              cdict__vector_buckets_ref(cdict), cdict__i_m)) > 0) {            \
+        cdict_wal__put(                                                        \
+            (wal), CDICT__WAL_ADD,                                             \
+            cdict__elem_key_ref(cdict_vector__index(                           \
+                cdict__vector_buckets_ref(cdict), cdict__i_m)),                \
+            cdict__elem_val_ref(cdict_vector__index(                           \
+                cdict__vector_buckets_ref(cdict), cdict__i_m)));               \
+      }                                                                        \
+    }                                                                          \
+    (cdict__ok_m && cdict_wal__compact_end(wal));                              \
+  })
+
+#endif /* CDICT__HAS_MMAP */
 
 /* Vector required by cdict */
 
@@ -760,22 +4903,42 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
   }
 
 #define cdict_vector__init_with_cap(tv, ncap)                                  \
+  cdict_vector__init_with_cap_((tv), (ncap), NULL)
+
+#define cdict_vector__init_with_cap_(tv, ncap, allocator)                      \
+  do {                                                                         \
+    ((tv)->cdict_vector__size_m) = 0;                                          \
+    ((tv)->cdict_vector__elem_m) = NULL;                                       \
+    ((tv)->cdict_vector__cap_m) = 0;                                           \
+    cdict_vector__grow_((tv), (ncap), (allocator));                            \
+    ((tv)->cdict_vector__initialized_m) = true;                                \
+  } while (0)
+
+#define cdict_vector__init(tv)                                                 \
   do {                                                                         \
     ((tv)->cdict_vector__size_m) = 0;                                          \
     ((tv)->cdict_vector__elem_m) = NULL;                                       \
     ((tv)->cdict_vector__cap_m) = 0;                                           \
-    cdict_vector__grow((tv), (ncap));                                          \
     ((tv)->cdict_vector__initialized_m) = true;                                \
   } while (0)
 
-#define cdict_vector__grow(tv, ncap)                                           \
+#define cdict_vector__init_zeroed_(tv, ncap, allocator)                        \
+  do {                                                                         \
+    cdict_vector__init(tv);                                                    \
+    ((tv)->cdict_vector__elem_m) = cdict__allocator_zalloc(                    \
+        (allocator), sizeof(*((tv)->cdict_vector__elem_m)) * (ncap));          \
+    ((tv)->cdict_vector__cap_m) = (ncap);                                      \
+  } while (0)
+
+#define cdict_vector__grow(tv, ncap) cdict_vector__grow_((tv), (ncap), NULL)
+
+#define cdict_vector__grow_(tv, ncap, allocator)                               \
   do {                                                                         \
     size_t cdict__cap_m = ((tv)->cdict_vector__cap_m);                         \
-    void *cdict__mem_m =                                                       \
-        malloc(sizeof(*((tv)->cdict_vector__elem_m)) * (ncap));                \
-    memcpy((cdict__mem_m), ((tv)->cdict_vector__elem_m),                       \
-           sizeof(*((tv)->cdict_vector__elem_m)) * (cdict__cap_m));            \
-    free((tv)->cdict_vector__elem_m);                                          \
+    void *cdict__mem_m = cdict__allocator_realloc(                             \
+        (allocator), ((tv)->cdict_vector__elem_m),                             \
+        sizeof(*((tv)->cdict_vector__elem_m)) * (cdict__cap_m),                \
+        sizeof(*((tv)->cdict_vector__elem_m)) * (ncap));                       \
     ((tv)->cdict_vector__elem_m) = (cdict__mem_m);                             \
     ((tv)->cdict_vector__cap_m) = (ncap);                                      \
   } while (0)
@@ -801,10 +4964,15 @@ static cdict__u64 cdict__hash2_callback(void *memptr, size_t size) {
 
 #define cdict_vector__set_elem(vec, value) ((cdict_vector__elem(vec)) = (value))
 
-#define cdict_vector__free(vec)                                                \
+#define cdict_vector__free(vec) cdict_vector__free_((vec), NULL)
+
+#define cdict_vector__free_(vec, allocator)                                    \
   do {                                                                         \
-    free(cdict_vector__elem(vec));                                             \
+    cdict__allocator_free(                                                     \
+        (allocator), cdict_vector__elem(vec),                                  \
+        sizeof(*(cdict_vector__elem(vec))) * cdict_vector__cap(vec));          \
     cdict_vector__set_elem((vec), NULL);                                       \
+    ((vec)->cdict_vector__cap_m) = 0;                                          \
   } while (0)
 
 #endif /* CDICT_H */
@@ -0,0 +1,464 @@
+/* C++ front end: `cdict::map<K, V, Hash, Eq>` runs the probing scheme of
+ * cdict.h (double hashing with XXH64, buckets of psl + key + value where psl
+ * 0 is empty and -1 a tombstone, the same load factors, growth and seeding)
+ * on keys and values that are constructed, moved and destroyed in place, so
+ * `std::string` and move-only types need no indirection. Requires C++17. */
+#ifndef CDICT_HPP
+#define CDICT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "cdict.h"
+
+namespace cdict {
+
+/* Byte hashers handed to `Hash`: the first and second hash of the double
+ * hashing probe, under the map's seed, as in `cdict__h1hash` and
+ * `cdict__h2hash` */
+struct hash1 {
+  uint64_t seed;
+  uint64_t operator()(const void *bytes, size_t size) const {
+    return cdict__XXH64(bytes, size, seed);
+  }
+};
+
+struct hash2 {
+  uint64_t seed;
+  uint64_t operator()(const void *bytes, size_t size) const {
+    return cdict__XXH64_h(bytes, size, seed) | 1;
+  }
+};
+
+/* `Hash` is called as `hash(key, bytes)` with `bytes` one of the hashers
+ * above, like a C custom hasher with its callback; being a template it is
+ * inlined for every key type. The default hashes the key's bytes, so it is
+ * only defined for keys without padding; strings hash their characters and
+ * take `std::string_view` for lookups. */
+template <typename K, typename = void> struct hash {
+  static_assert(std::has_unique_object_representations<K>::value,
+                "keys with padding or float members need a custom Hash");
+  template <typename Bytes>
+  uint64_t operator()(const K &key, Bytes bytes) const {
+    return bytes(&key, sizeof(key));
+  }
+};
+
+template <> struct hash<std::string_view> {
+  using is_transparent = void;
+  template <typename Bytes>
+  uint64_t operator()(std::string_view key, Bytes bytes) const {
+    return bytes(key.data(), key.size());
+  }
+};
+
+template <> struct hash<std::string> : hash<std::string_view> {};
+
+template <typename T, typename = void>
+struct is_transparent : std::false_type {};
+template <typename T>
+struct is_transparent<T, std::void_t<typename T::is_transparent>>
+    : std::true_type {};
+
+/* `Eq` defaults to the transparent `std::equal_to<>`: `std::string` keys
+ * compare against `std::string_view` and `const char *` without a copy */
+template <typename K, typename V, typename Hash = cdict::hash<K>,
+          typename Eq = std::equal_to<>>
+class map {
+  struct bucket {
+    /* 0 empty, -1 tombstone, otherwise probe length */
+    int psl;
+    alignas(K) unsigned char key_bytes[sizeof(K)];
+    alignas(V) unsigned char val_bytes[sizeof(V)];
+
+    K &key() { return *std::launder(reinterpret_cast<K *>(key_bytes)); }
+    V &val() { return *std::launder(reinterpret_cast<V *>(val_bytes)); }
+  };
+
+  /* heterogeneous lookup needs both functors to opt in */
+  template <typename H, typename E>
+  using if_transparent =
+      std::enable_if_t<is_transparent<H>::value && is_transparent<E>::value>;
+
+public:
+  /* by value: `auto [key, val] = *it` binds the entry itself */
+  using reference = std::pair<const K &, V &>;
+
+  class iterator {
+  public:
+    reference operator*() const { return {at_->key(), at_->val()}; }
+    iterator &operator++() {
+      at_ = map::next_live(at_ + 1, end_);
+      return *this;
+    }
+    bool operator==(const iterator &other) const { return at_ == other.at_; }
+    bool operator!=(const iterator &other) const { return at_ != other.at_; }
+    const K &key() const { return at_->key(); }
+    V &val() const { return at_->val(); }
+
+  private:
+    friend class map;
+    iterator(bucket *at, bucket *end) : at_(at), end_(end) {}
+    bucket *at_;
+    bucket *end_;
+  };
+
+  map() : seed_(cdict__random_seed()) {}
+  explicit map(Hash hash, Eq eq = Eq())
+      : hash_(std::move(hash)), eq_(std::move(eq)),
+        seed_(cdict__random_seed()) {}
+
+  map(const map &other)
+      : hash_(other.hash_), eq_(other.eq_), seed_(cdict__random_seed()),
+        max_load_factor_(other.max_load_factor_) {
+    reserve(other.size_);
+    for (bucket *b = other.buckets_; b != other.buckets_ + other.cap_; b++) {
+      if (b->psl > 0) {
+        try_emplace(b->key(), b->val());
+      }
+    }
+  }
+
+  map(map &&other) noexcept
+      : hash_(std::move(other.hash_)), eq_(std::move(other.eq_)),
+        buckets_(std::exchange(other.buckets_, nullptr)),
+        cap_(std::exchange(other.cap_, 0)),
+        size_(std::exchange(other.size_, 0)), seed_(other.seed_),
+        reseeds_(other.reseeds_), max_load_factor_(other.max_load_factor_) {}
+
+  map &operator=(map other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  ~map() { release(); }
+
+  void swap(map &other) noexcept {
+    std::swap(hash_, other.hash_);
+    std::swap(eq_, other.eq_);
+    std::swap(buckets_, other.buckets_);
+    std::swap(cap_, other.cap_);
+    std::swap(size_, other.size_);
+    std::swap(seed_, other.seed_);
+    std::swap(reseeds_, other.reseeds_);
+    std::swap(max_load_factor_, other.max_load_factor_);
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return cap_; }
+  uint64_t seed() const { return seed_; }
+  double max_load_factor() const { return max_load_factor_; }
+  void max_load_factor(double factor) { max_load_factor_ = factor; }
+
+  /* Presizes buckets so that `n` entries fit without a resize */
+  void reserve(size_t n) {
+    size_t want = CDICT__INITIAL_CAP;
+    while ((double)n / want >= max_load_factor_) {
+      want *= 2;
+    }
+    if (want > cap_) {
+      resize(want);
+    }
+  }
+
+  /* Adds `key` with a value built from `args` unless it is present, in which
+   * case nothing is constructed or moved from. Iterators and references are
+   * valid until the next insert or erase. */
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const K &key, Args &&...args) {
+    return emplace_key(key, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(K &&key, Args &&...args) {
+    return emplace_key(std::move(key), std::forward<Args>(args)...);
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const K &key, M &&val) {
+    auto result = try_emplace(key, std::forward<M>(val));
+    if (!result.second) {
+      result.first.val() = std::forward<M>(val);
+    }
+    return result;
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(K &&key, M &&val) {
+    auto result = try_emplace(std::move(key), std::forward<M>(val));
+    if (!result.second) {
+      result.first.val() = std::forward<M>(val);
+    }
+    return result;
+  }
+
+  V &operator[](const K &key) { return try_emplace(key).first.val(); }
+  V &operator[](K &&key) { return try_emplace(std::move(key)).first.val(); }
+
+  /* Pointer to the value of `key`, NULL when missing */
+  V *get(const K &key) { return lookup(key); }
+  template <typename Q, typename H = Hash, typename E = Eq,
+            typename = if_transparent<H, E>>
+  V *get(const Q &key) {
+    return lookup(key);
+  }
+
+  iterator find(const K &key) { return iterator_of(lookup_bucket(key)); }
+  template <typename Q, typename H = Hash, typename E = Eq,
+            typename = if_transparent<H, E>>
+  iterator find(const Q &key) {
+    return iterator_of(lookup_bucket(key));
+  }
+
+  bool contains(const K &key) const { return lookup_bucket(key) != nullptr; }
+  template <typename Q, typename H = Hash, typename E = Eq,
+            typename = if_transparent<H, E>>
+  bool contains(const Q &key) const {
+    return lookup_bucket(key) != nullptr;
+  }
+
+  /* leaves a tombstone, like `cdict__remove`; returns the number erased */
+  size_t erase(const K &key) { return erase_bucket(lookup_bucket(key)); }
+  template <typename Q, typename H = Hash, typename E = Eq,
+            typename = if_transparent<H, E>>
+  size_t erase(const Q &key) {
+    return erase_bucket(lookup_bucket(key));
+  }
+
+  /* buckets are released, the next insert allocates again */
+  void clear() {
+    release();
+    buckets_ = nullptr;
+    cap_ = 0;
+    size_ = 0;
+  }
+
+  iterator begin() {
+    return iterator(next_live(buckets_, buckets_ + cap_), buckets_ + cap_);
+  }
+  iterator end() { return iterator(buckets_ + cap_, buckets_ + cap_); }
+
+private:
+  static bucket *next_live(bucket *at, bucket *end) {
+    while (at != end && at->psl <= 0) {
+      at++;
+    }
+    return at;
+  }
+
+  iterator iterator_of(bucket *b) {
+    return b ? iterator(b, buckets_ + cap_) : end();
+  }
+
+  template <typename Q> uint64_t h1(const Q &key) const {
+    return hash_(key, hash1{seed_});
+  }
+  /* odd even when a custom hash combines several odd hashes, so that the
+   * probe sequence visits every bucket */
+  template <typename Q> uint64_t h2(const Q &key) const {
+    return hash_(key, hash2{seed_}) | 1;
+  }
+
+  /* probes past tombstones up to the first empty bucket, as `cdict__get_` */
+  template <typename Q> bucket *lookup_bucket(const Q &key) const {
+    if (size_ == 0) {
+      return nullptr;
+    }
+    /* the first probe does not need the second hash */
+    uint64_t first = h1(key), second = 0;
+    for (size_t i = 0; i < cap_; i++) {
+      if (i == 1) {
+        second = h2(key);
+      }
+      bucket *b = &buckets_[cdict__double_hash_index(first, second, i, cap_)];
+      if (b->psl == 0) {
+        break;
+      }
+      if (b->psl > 0 && eq_(b->key(), key)) {
+        return b;
+      }
+    }
+    return nullptr;
+  }
+
+  template <typename Q> V *lookup(const Q &key) {
+    bucket *b = lookup_bucket(key);
+    return b ? &b->val() : nullptr;
+  }
+
+  /* the bucket holding `key`, otherwise the first tombstone or empty bucket
+   * of its sequence, as `cdict__slot_` */
+  bucket *slot(const K &key, bool *found, size_t *psl) const {
+    /* the first probe does not need the second hash */
+    uint64_t first = h1(key), second = 0;
+    bucket *free_slot = nullptr;
+    *found = false;
+    for (size_t i = 0; i < cap_; i++) {
+      if (i == 1) {
+        second = h2(key);
+      }
+      bucket *b = &buckets_[cdict__double_hash_index(first, second, i, cap_)];
+      if (b->psl <= 0) {
+        if (free_slot == nullptr) {
+          free_slot = b;
+          *psl = i + 1;
+        }
+        if (b->psl == 0) {
+          break;
+        }
+        continue;
+      }
+      if (eq_(b->key(), key)) {
+        *found = true;
+        *psl = i + 1;
+        return b;
+      }
+    }
+    return free_slot;
+  }
+
+  template <typename KeyArg, typename... Args>
+  std::pair<iterator, bool> emplace_key(KeyArg &&key, Args &&...args) {
+    if (cap_ == 0 || (double)size_ / cap_ >= max_load_factor_) {
+      resize(cap_ ? cap_ * 2 : CDICT__INITIAL_CAP);
+    }
+    bool found;
+    size_t psl = 0;
+    bucket *b = slot(key, &found, &psl);
+    if (found) {
+      return {iterator(b, buckets_ + cap_), false};
+    }
+    if (psl > CDICT__RESEED_PSL && reseeds_ < CDICT__MAX_RESEEDS) {
+      /* new seed and an in place rehash before the insert, see
+       * CDICT__RESEED_PSL */
+      reseeds_++;
+      seed_ = cdict__random_seed();
+      resize(cap_);
+      b = slot(key, &found, &psl);
+    }
+    K *new_key = ::new (b->key_bytes) K(std::forward<KeyArg>(key));
+    try {
+      ::new (b->val_bytes) V(std::forward<Args>(args)...);
+    } catch (...) {
+      new_key->~K();
+      throw;
+    }
+    b->psl = (int)psl;
+    size_++;
+    return {iterator(b, buckets_ + cap_), true};
+  }
+
+  size_t erase_bucket(bucket *b) {
+    if (b == nullptr) {
+      return 0;
+    }
+    b->key().~K();
+    b->val().~V();
+    b->psl = -1;
+    size_--;
+    return 1;
+  }
+
+  static bucket *allocate(size_t cap) {
+    void *bytes = ::operator new(cap * sizeof(bucket),
+                                 std::align_val_t(alignof(bucket)));
+    /* zero filled buckets are empty (psl 0) */
+    memset(bytes, 0, cap * sizeof(bucket));
+    return static_cast<bucket *>(bytes);
+  }
+
+  static void deallocate(bucket *buckets) {
+    ::operator delete(buckets, std::align_val_t(alignof(bucket)));
+  }
+
+  /* Entries are moved into the new buckets, or copied when the move of the
+   * key or of the value may throw and both can be copied; keys are unique
+   * there, so each one takes the first empty bucket of its sequence without
+   * comparisons. The old entries are only destroyed once all of them made
+   * it, so a throwing copy leaves the map as it was. */
+  void resize(size_t cap) {
+    bucket *buckets = allocate(cap);
+    try {
+      for (bucket *b = buckets_; b != buckets_ + cap_; b++) {
+        if (b->psl > 0) {
+          move_into(buckets, cap, b);
+        }
+      }
+    } catch (...) {
+      destroy(buckets, cap);
+      throw;
+    }
+    destroy(buckets_, cap_);
+    buckets_ = buckets;
+    cap_ = cap;
+  }
+
+  /* key and value are moved or copied together: moving only the half whose
+   * move cannot throw would leave a moved-from key or value behind in an old
+   * entry when the other half's copy throws */
+  static constexpr bool move_entries =
+      (std::is_nothrow_move_constructible_v<K> &&
+       std::is_nothrow_move_constructible_v<V>) ||
+      !std::is_copy_constructible_v<K> || !std::is_copy_constructible_v<V>;
+
+  template <typename T> static decltype(auto) relocate(T &value) {
+    if constexpr (move_entries) {
+      return std::move(value);
+    } else {
+      return static_cast<const T &>(value);
+    }
+  }
+
+  void move_into(bucket *buckets, size_t cap, bucket *from) {
+    uint64_t first = h1(from->key()), second = h2(from->key());
+    for (size_t i = 0; i < cap; i++) {
+      bucket *to = &buckets[cdict__double_hash_index(first, second, i, cap)];
+      if (to->psl == 0) {
+        K *key = ::new (to->key_bytes) K(relocate(from->key()));
+        try {
+          ::new (to->val_bytes) V(relocate(from->val()));
+        } catch (...) {
+          key->~K();
+          throw;
+        }
+        to->psl = (int)(i + 1);
+        return;
+      }
+    }
+  }
+
+  static void destroy(bucket *buckets, size_t cap) {
+    for (bucket *b = buckets; b != buckets + cap; b++) {
+      if (b->psl > 0) {
+        b->key().~K();
+        b->val().~V();
+      }
+    }
+    if (buckets) {
+      deallocate(buckets);
+    }
+  }
+
+  void release() { destroy(buckets_, cap_); }
+
+  Hash hash_;
+  Eq eq_;
+  bucket *buckets_ = nullptr;
+  size_t cap_ = 0;
+  size_t size_ = 0;
+  uint64_t seed_;
+  int reseeds_ = 0;
+  double max_load_factor_ = CDICT__MAX_LOAD_FACTOR;
+};
+
+} // namespace cdict
+
+#endif
@@ -1,6 +1,12 @@
 #include <assert.h>
 #include <stdio.h>
 
+/* hit and miss counters for test__cdict_stats; `make test` also builds the
+ * suite with CDICT_TEST_NO_STATS to cover the default layout */
+#ifndef CDICT_TEST_NO_STATS
+#define CDICT__STATS
+#endif
+
 #include "deps/cset/cset.h"
 #include "deps/cvector/cvector.h"
 #include "src/cdict.h"
@@ -55,20 +61,38 @@ void test__cdict_remove() {
 
 void test__cdict_init() {
   CDict(int, int) cdict_t;
-  cdict_t cdict;
+  cdict_t cdict, other;
 
   cdict__init(&cdict);
+  cdict__init(&other);
 
   assert(cdict__size(&cdict) == 0);
-  assert(cdict__vector_buckets_ref(&cdict) != NULL);
-  assert(cdict_vector__cap(cdict__vector_buckets_ref(&cdict)) ==
-         CDICT__INITIAL_CAP);
-  assert(cdict__seed(&cdict) == CDICT__DEFAULT_SEED);
+  /* nothing is allocated until the first add */
+  assert(cdict_vector__elem(cdict__vector_buckets_ref(&cdict)) == NULL);
+  assert(cdict_vector__cap(cdict__vector_buckets_ref(&cdict)) == 0);
+  /* every dict draws its own seed */
+  assert(cdict__seed(&cdict) != cdict__seed(&other));
   assert(cdict__max_load_factor(&cdict) == CDICT__MAX_LOAD_FACTOR);
   assert(cdict__min_load_factor(&cdict) == CDICT__MIN_LOAD_FACTOR);
   assert(cdict.cdict__hash_m == NULL);
   assert(cdict.cdict__compare_m == NULL);
 
+  /* one config overrides the load factors of every dict pointing at it */
+  cdict_Config config = {.max_load_factor = 0.9, .min_load_factor = 0.1};
+  cdict__set_config(&cdict, &config);
+  cdict__set_config(&other, &config);
+  assert(cdict__max_load_factor(&other) == 0.9);
+  assert(cdict__min_load_factor(&other) == 0.1);
+  assert(cdict__reserve(&cdict, 100) && cdict__cap(&cdict) == 128);
+  assert(cdict__reserve(&other, 100) && cdict__cap(&other) == 128);
+  cdict_t like;
+  cdict__init_like(&like, &cdict);
+  assert(cdict__config(&like) == &config);
+  cdict__set_config(&cdict, NULL);
+  assert(cdict__reserve(&cdict, 100) && cdict__cap(&cdict) == 256);
+
+  cdict__free(&like);
+  cdict__free(&other);
   cdict__free(&cdict);
 }
 
@@ -94,6 +118,7 @@ void test__cdict_free() {
   cdict_t cdict;
 
   cdict__init(&cdict);
+  cdict__add(&cdict, 1, 1);
 
   assert((cdict_vector__elem((cdict__vector_buckets_ref(&cdict)))) != NULL);
   cdict__free(&cdict);
@@ -288,6 +313,138 @@ void test__cdict_values_iteration() {
   cdict__free(&cdict);
 }
 
+Cset(int) cset_algebra_t;
+
+/* the set of [from, to) */
+void cset_fill(cset_algebra_t *set, int from, int to) {
+  cset__init(set);
+  for (int i = from; i < to; i++) {
+    cset__add(set, i);
+  }
+}
+
+bool cset_has(cset_algebra_t *set, int value) {
+  bool contains = false;
+  cset__contains(set, value, &contains);
+  return contains;
+}
+
+void test__cset_algebra() {
+  cset_algebra_t big, small, far, empty, res;
+  cset_fill(&big, 0, 1000);
+  cset_fill(&small, 990, 1010);
+  cset_fill(&far, 5000, 5010);
+  cset_fill(&empty, 0, 0);
+
+  /* reserve grows once and keeps the elements */
+  cset_fill(&res, 0, 3);
+  cset__reserve(&res, 500);
+  size_t cap = cset__cap(&res);
+  assert(cap * cset__MAX_LOAD_FACTOR > 500);
+  assert(cset_has(&res, 0) && cset_has(&res, 2) && cset__size(&res) == 3);
+  cset__reserve(&res, 10);
+  assert(cset__cap(&res) == cap);
+  cset__free(&res);
+
+  /* intersect_count: overlapping, disjoint and empty, both orders */
+  size_t count = 99;
+  cset__intersect_count(&big, &small, &count);
+  assert(count == 10);
+  cset__intersect_count(&small, &big, &count);
+  assert(count == 10);
+  cset__intersect_count(&big, &far, &count);
+  assert(count == 0);
+  cset__intersect_count(&empty, &big, &count);
+  assert(count == 0);
+  cset__intersect_count(&big, &empty, &count);
+  assert(count == 0);
+
+  /* intersect walks the smaller side whichever order */
+  cset_fill(&res, 0, 0);
+  cset__intersect(&res, &big, &small);
+  assert(cset__size(&res) == 10 && cset_has(&res, 995) && !cset_has(&res, 5));
+  cset__free(&res);
+  cset_fill(&res, 0, 0);
+  cset__intersect(&res, &small, &big);
+  assert(cset__size(&res) == 10 && cset_has(&res, 999) &&
+         !cset_has(&res, 1005));
+  cset__free(&res);
+  cset_fill(&res, 0, 0);
+  cset__intersect(&res, &big, &far);
+  assert(cset__size(&res) == 0);
+  cset__intersect(&res, &empty, &big);
+  assert(cset__size(&res) == 0);
+  cset__free(&res);
+
+  /* is_disjoint */
+  bool disjoint = true;
+  cset__is_disjoint(&big, &small, &disjoint);
+  assert(!disjoint);
+  cset__is_disjoint(&small, &big, &disjoint);
+  assert(!disjoint);
+  cset__is_disjoint(&big, &far, &disjoint);
+  assert(disjoint);
+  cset__is_disjoint(&far, &big, &disjoint);
+  assert(disjoint);
+  cset__is_disjoint(&empty, &big, &disjoint);
+  assert(disjoint);
+  cset__is_disjoint(&big, &empty, &disjoint);
+  assert(disjoint);
+
+  /* update: in place union */
+  cset_fill(&res, 0, 10);
+  cset__update(&res, &small);
+  assert(cset__size(&res) == 30 && cset_has(&res, 5) && cset_has(&res, 1009));
+  cset__update(&res, &empty);
+  assert(cset__size(&res) == 30);
+  cset__free(&res);
+  cset_fill(&res, 0, 0);
+  cset__update(&res, &far);
+  assert(cset__size(&res) == 10 && cset_has(&res, 5003));
+  cset__free(&res);
+
+  /* intersect_update, both size orders */
+  cset_fill(&res, 0, 1000);
+  cset__intersect_update(&res, &small);
+  assert(cset__size(&res) == 10 && cset_has(&res, 990) && !cset_has(&res, 0));
+  cset__free(&res);
+  cset_fill(&res, 985, 1005);
+  cset__intersect_update(&res, &big);
+  assert(cset__size(&res) == 15 && cset_has(&res, 985) &&
+         !cset_has(&res, 1000));
+  cset__intersect_update(&res, &far);
+  assert(cset__size(&res) == 0 && !cset_has(&res, 990));
+  cset__free(&res);
+  cset_fill(&res, 0, 10);
+  cset__intersect_update(&res, &empty);
+  assert(cset__size(&res) == 0);
+  cset__free(&res);
+
+  /* difference_update walks b when it is smaller, a otherwise */
+  cset_fill(&res, 0, 1000);
+  cset__difference_update(&res, &small);
+  assert(cset__size(&res) == 990 && !cset_has(&res, 995) && cset_has(&res, 0));
+  cset__free(&res);
+  cset_fill(&res, 985, 1005);
+  cset__difference_update(&res, &big);
+  assert(cset__size(&res) == 5 && cset_has(&res, 1000) &&
+         !cset_has(&res, 999));
+  cset__difference_update(&res, &far);
+  assert(cset__size(&res) == 5);
+  cset__difference_update(&res, &empty);
+  assert(cset__size(&res) == 5);
+  cset__free(&res);
+  cset_fill(&res, 0, 0);
+  cset__difference_update(&res, &big);
+  assert(cset__size(&res) == 0);
+  cset__free(&res);
+
+  cset__free(&big);
+  cset__free(&small);
+  cset__free(&far);
+  cset__free(&empty);
+}
+
 void test__copy_keys_to_vector() {
 
   CDict(int, int) cdict_t;
@@ -509,6 +666,1459 @@ void test__cdict_nested_cdict() {
   }
 }
 
+typedef struct {
+  size_t allocs;
+  size_t frees;
+  size_t live_bytes;
+  /* the allocation with this number fails, 0 for none */
+  size_t fail_at;
+} CountingAllocator;
+
+void *counting_alloc(void *ctx, size_t size) {
+  CountingAllocator *counter = ctx;
+  counter->allocs++;
+  if (counter->allocs == counter->fail_at) {
+    return NULL;
+  }
+  counter->live_bytes += size;
+  return malloc(size);
+}
+
+void counting_free(void *ctx, void *ptr, size_t size) {
+  CountingAllocator *counter = ctx;
+  counter->frees++;
+  counter->live_bytes -= size;
+  free(ptr);
+}
+
+void test__cdict_allocator() {
+  CountingAllocator counter = {0};
+  cdict_Allocator allocator = {
+      .alloc = counting_alloc, .free = counting_free, .ctx = &counter};
+
+  CDict(int, int) cdict_t;
+  cdict_t cdict;
+  cdict__init_with_allocator(&cdict, &allocator);
+
+  for (int i = 0; i < 1000; i++) {
+    cdict__add(&cdict, i, i * 2);
+  }
+  assert(cdict__size(&cdict) == 1000);
+  assert(counter.allocs > 1);
+
+  int value;
+  bool ok = cdict__get(&cdict, 999, &value);
+  assert(ok && value == 1998);
+
+  cdict__free(&cdict);
+  assert(counter.allocs == counter.frees);
+  assert(counter.live_bytes == 0);
+
+  /* a failed resize, of the buckets or of the occupancy bitmap, leaves the
+   * dict as it was */
+  cdict__init_with_allocator(&cdict, &allocator);
+  counter.fail_at = counter.allocs + 1;
+  assert(!cdict__add(&cdict, 0, 0));
+  counter.fail_at = counter.allocs + 2;
+  assert(cdict__entry(&cdict, 0) == NULL);
+  assert(cdict__size(&cdict) == 0 && cdict__cap(&cdict) == 0);
+  assert(counter.live_bytes == 0);
+
+  int key = 0;
+  while (cdict__cap(&cdict) == 0 ||
+         (double)cdict__size(&cdict) / cdict__cap(&cdict) <
+             cdict__max_load_factor(&cdict)) {
+    assert(cdict__add(&cdict, key, key));
+    key++;
+  }
+  /* past the max load factor while a bucket is free */
+  size_t cap = cdict__cap(&cdict);
+  counter.fail_at = counter.allocs + 1;
+  assert(cdict__add(&cdict, key, key));
+  key++;
+  counter.fail_at = counter.allocs + 2;
+  assert(cdict__add(&cdict, key, key));
+  key++;
+  assert(cdict__cap(&cdict) == cap && cdict__size(&cdict) == (size_t)key);
+  counter.fail_at = 0;
+  assert(cdict__add(&cdict, key, key));
+  key++;
+  assert(cdict__cap(&cdict) == 2 * cap);
+  for (int i = 0; i < key; i++) {
+    assert(cdict__get(&cdict, i, &value) && value == i);
+  }
+  cdict__free(&cdict);
+  assert(counter.live_bytes == 0);
+}
+
+void test__cdict_arena() {
+  cdict_Arena arena;
+  cdict_arena__init(&arena, 0);
+
+  CDict(int, int) cdict_t;
+
+  for (int n = 0; n < 10; n++) {
+    cdict_t cdict;
+    cdict__init_with_allocator(&cdict, cdict_arena__allocator(&arena));
+    for (int i = 0; i < 100; i++) {
+      cdict__add(&cdict, i, n + i);
+    }
+    assert(cdict__size(&cdict) == 100);
+
+    int value;
+    bool ok = cdict__get(&cdict, 42, &value);
+    assert(ok && value == n + 42);
+  }
+
+  /* everything is released at once */
+  cdict_arena__free(&arena);
+  assert(arena.cdict_arena__head_m == NULL);
+}
+
+void test__cdict_hugepage() {
+  cdict_Hugepage hugepage;
+  /* small threshold so that the mmap path is exercised */
+  cdict_hugepage__init(&hugepage, 4096, false);
+
+  CDict(int, int) cdict_t;
+  cdict_t cdict;
+  cdict__init_with_allocator(&cdict, cdict_hugepage__allocator(&hugepage));
+
+  for (int i = 0; i < 10000; i++) {
+    cdict__add(&cdict, i, -i);
+  }
+  assert(cdict__size(&cdict) == 10000);
+  assert(((uintptr_t)cdict_vector__elem(cdict__vector_buckets_ref(&cdict)) %
+          CDICT__CACHE_LINE_SIZE) == 0);
+
+  for (int i = 0; i < 10000; i++) {
+    int value;
+    bool ok = cdict__get(&cdict, i, &value);
+    assert(ok && value == -i);
+  }
+
+  cdict__free(&cdict);
+}
+
+void test__cdict_lazy_allocation() {
+  CountingAllocator counter = {0};
+  cdict_Allocator allocator = {
+      .alloc = counting_alloc, .free = counting_free, .ctx = &counter};
+
+  CDict(int, int) cdict_t;
+  cdict_t cdict;
+  cdict__init_with_allocator(&cdict, &allocator);
+
+  assert(counter.allocs == 0);
+  assert(cdict__contains(&cdict, 1) == false);
+  assert(cdict__remove(&cdict, 1) == false);
+
+  /* the buckets and their occupancy bitmap */
+  cdict__add(&cdict, 1, 10);
+  assert(counter.allocs == 2);
+  assert(cdict__cap(&cdict) == CDICT__INITIAL_CAP);
+
+  cdict__clear(&cdict);
+  assert(counter.live_bytes == 0);
+  assert(cdict__size(&cdict) == 0);
+  assert(cdict__contains(&cdict, 1) == false);
+
+  cdict__add(&cdict, 2, 20);
+  int value;
+  bool ok = cdict__get(&cdict, 2, &value);
+  assert(ok && value == 20);
+
+  cdict__free(&cdict);
+  assert(counter.allocs == counter.frees);
+}
+
+void test__cdict_snapshot() {
+  const char *path = "cdict_snapshot_test.bin";
+
+  CDict(int, double) cdict_t;
+  cdict_t cdict;
+  cdict__init(&cdict);
+
+  for (int i = 0; i < 1000; i++) {
+    cdict__add(&cdict, i, i * 0.5);
+  }
+  cdict__remove(&cdict, 10);
+
+  bool ok = cdict__save(&cdict, path);
+  assert(ok);
+
+  cdict_t mapped;
+  ok = cdict__mmap_open(&mapped, path);
+  assert(ok);
+  assert(cdict__size(&mapped) == 999);
+  assert(cdict__cap(&mapped) == cdict__cap(&cdict));
+  assert(cdict__contains(&mapped, 10) == false);
+
+  for (int i = 11; i < 1000; i++) {
+    double value;
+    bool found = cdict__get(&mapped, i, &value);
+    assert(found && value == i * 0.5);
+  }
+
+  CDict_iterator(cdict_t) iterator_t;
+  iterator_t iterator;
+  cdict_iterator__init(&iterator, &mapped);
+  size_t count = 0;
+  while (!cdict_iterator__done(&iterator)) {
+    cdict_iterator__next(&iterator);
+    count++;
+  }
+  assert(count == 999);
+  cdict__free(&mapped);
+
+  /* layout mismatch is rejected */
+  {
+    CDict(int, int) cdict_int_t;
+    cdict_int_t other;
+    bool ok = cdict__mmap_open(&other, path);
+    assert(!ok);
+  }
+
+  cdict__free(&cdict);
+  remove(path);
+}
+
+void test__cdict_wal() {
+  const char *path = "cdict_wal_test.log";
+  remove(path);
+
+  CDict(int, int) cdict_t;
+
+  {
+    cdict_t cdict;
+    cdict__init(&cdict);
+    cdict_Wal wal;
+    bool ok = cdict_wal__open(&wal, &cdict, path);
+    assert(ok);
+    cdict_wal__set_group_commit(&wal, 64, 1000);
+
+    for (int i = 0; i < 1000; i++) {
+      ok = cdict_wal__add(&wal, &cdict, i, i * 3);
+      assert(ok);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+      bool removed = cdict_wal__remove(&wal, &cdict, i);
+      assert(removed);
+    }
+    assert(cdict_wal__remove(&wal, &cdict, 0) == false);
+    cdict_wal__add(&wal, &cdict, 1, 42);
+    assert(cdict__size(&cdict) == 500);
+
+    ok = cdict_wal__close(&wal);
+    assert(ok);
+    cdict__free(&cdict);
+  }
+
+  /* torn tail from a crash in the middle of a write */
+  {
+    FILE *file = fopen(path, "ab");
+    fputc(CDICT__WAL_ADD, file);
+    fputc(7, file);
+    fclose(file);
+  }
+
+  {
+    cdict_t cdict;
+    cdict__init(&cdict);
+    cdict_Wal wal;
+    bool ok = cdict_wal__open(&wal, &cdict, path);
+    assert(ok);
+    ok = cdict_wal__recover(&wal, &cdict);
+    assert(ok);
+    assert(cdict__size(&cdict) == 500);
+
+    int value;
+    assert(cdict__get(&cdict, 1, &value) && value == 42);
+    assert(cdict__get(&cdict, 999, &value) && value == 2997);
+    assert(cdict__contains(&cdict, 998) == false);
+
+    ok = cdict_wal__compact(&wal, &cdict);
+    assert(ok);
+    cdict_wal__add(&wal, &cdict, 2000, 1);
+    cdict_wal__close(&wal);
+    cdict__free(&cdict);
+  }
+
+  {
+    cdict_t cdict;
+    cdict__init(&cdict);
+    cdict_Wal wal;
+    cdict_wal__open(&wal, &cdict, path);
+    bool ok = cdict_wal__recover(&wal, &cdict);
+    assert(ok);
+    assert(cdict__size(&cdict) == 501);
+
+    int value;
+    assert(cdict__get(&cdict, 1, &value) && value == 42);
+    assert(cdict__get(&cdict, 2000, &value) && value == 1);
+    cdict_wal__close(&wal);
+    cdict__free(&cdict);
+  }
+
+  remove(path);
+}
+
+void test__cdict_freeze() {
+  CDict(int, int) cdict_t;
+  CDict_frozen(cdict_t) frozen_t;
+
+  cdict_t cdict;
+  cdict__init(&cdict);
+  for (int i = 0; i < 10000; i++) {
+    cdict__add(&cdict, i * 7, i);
+  }
+  cdict__remove(&cdict, 0);
+
+  frozen_t frozen;
+  bool ok = cdict__freeze(&cdict, &frozen);
+  assert(ok);
+  assert(cdict_frozen__size(&frozen) == 9999);
+
+  for (int i = 1; i < 10000; i++) {
+    int value;
+    bool found = cdict_frozen__get(&frozen, i * 7, &value);
+    assert(found && value == i);
+    assert(cdict_frozen__contains(&frozen, i * 7 + 1) == false);
+  }
+  assert(cdict_frozen__contains(&frozen, 0) == false);
+
+  long sum = 0;
+  for (size_t i = 0; i < cdict_frozen__size(&frozen); i++) {
+    assert(cdict_frozen__key_at(&frozen, i) ==
+           cdict_frozen__val_at(&frozen, i) * 7);
+    sum += cdict_frozen__val_at(&frozen, i);
+  }
+  assert(sum == 9999L * 10000 / 2);
+
+  cdict_frozen__free(&frozen);
+  cdict__free(&cdict);
+
+  /* empty dict and custom hash */
+  {
+    CDict(Node_t, int) cdict_node_t;
+    CDict_frozen(cdict_node_t) frozen_node_t;
+
+    cdict_node_t cdict_node;
+    cdict__init(&cdict_node);
+    cdict__set_comparator(&cdict_node, node_comparator);
+    cdict__set_hash(&cdict_node, node_hasher);
+
+    frozen_node_t frozen_node;
+    bool ok = cdict__freeze(&cdict_node, &frozen_node);
+    assert(ok && cdict_frozen__size(&frozen_node) == 0);
+    assert(!cdict_frozen__contains(&frozen_node, ((Node_t){.x = 1})));
+    cdict_frozen__free(&frozen_node);
+
+    for (int i = 0; i < 100; i++) {
+      cdict__add(&cdict_node, ((Node_t){.x = i, .y = i}), i);
+    }
+    ok = cdict__freeze(&cdict_node, &frozen_node);
+    assert(ok);
+
+    int value;
+    bool found =
+        cdict_frozen__get(&frozen_node, ((Node_t){.x = 42, .y = -1}), &value);
+    assert(found && value == 42);
+    cdict_frozen__free(&frozen_node);
+    cdict__free(&cdict_node);
+  }
+}
+
+void test__cdict_small() {
+  CDict(int, int) cdict_t;
+  CDict_small(cdict_t, 8) small_t;
+
+  assert(sizeof(small_t) < sizeof(cdict_t) + 8 * 2 * sizeof(int));
+
+  small_t small;
+  cdict_small__init(&small);
+
+  for (int i = 0; i < 8; i++) {
+    cdict_small__add(&small, i, i * i);
+  }
+  cdict_small__add(&small, 3, 10);
+  assert(cdict_small__size(&small) == 8);
+  assert(cdict_small__table(&small) == NULL);
+
+  int value;
+  assert(cdict_small__get(&small, 3, &value) && value == 10);
+  assert(cdict_small__remove(&small, 0));
+  assert(!cdict_small__contains(&small, 0));
+  assert(cdict_small__get(&small, 7, &value) && value == 49);
+  assert(cdict_small__size(&small) == 7);
+
+  /* upgrades to the hashed table past the inline capacity */
+  for (int i = 100; i < 200; i++) {
+    cdict_small__add(&small, i, i);
+  }
+  assert(cdict_small__table(&small) != NULL);
+  assert(cdict_small__size(&small) == 107);
+  assert(cdict_small__get(&small, 3, &value) && value == 10);
+  assert(cdict_small__get(&small, 150, &value) && value == 150);
+  assert(cdict_small__remove(&small, 150));
+  assert(!cdict_small__contains(&small, 150));
+
+  cdict_small__free(&small);
+  assert(cdict_small__size(&small) == 0);
+
+  /* the upgrade allocates through the allocator and keeps the entries
+   * inline when it fails */
+  CountingAllocator counter = {0};
+  cdict_Allocator allocator = {
+      .alloc = counting_alloc, .free = counting_free, .ctx = &counter};
+  cdict_small__init_with_allocator(&small, &allocator);
+  for (int i = 0; i < 8; i++) {
+    assert(cdict_small__add(&small, i, i));
+  }
+  assert(counter.allocs == 0);
+  /* the dict, then its buckets */
+  for (size_t fail = 1; fail <= 2; fail++) {
+    counter.fail_at = counter.allocs + fail;
+    assert(!cdict_small__add(&small, 8, 8));
+    assert(cdict_small__table(&small) == NULL);
+    assert(cdict_small__size(&small) == 8 && counter.live_bytes == 0);
+  }
+  assert(cdict_small__get(&small, 7, &value) && value == 7);
+  counter.fail_at = 0;
+  assert(cdict_small__add(&small, 8, 8));
+  assert(cdict_small__table(&small) != NULL && cdict_small__size(&small) == 9);
+  for (int i = 0; i < 9; i++) {
+    assert(cdict_small__get(&small, i, &value) && value == i);
+  }
+  cdict_small__free(&small);
+  assert(counter.live_bytes == 0 && counter.allocs == counter.frees + 2);
+}
+
+void test__cdict_bloom() {
+  CDict(int, int) cdict_t;
+  cdict_t cdict;
+  cdict__init(&cdict);
+  for (int i = 0; i < 100; i++) {
+    cdict__add(&cdict, i, i);
+  }
+  assert(cdict__enable_bloom(&cdict));
+
+  /* grows past the initial filter, which is rebuilt on resize */
+  for (int i = 100; i < 5000; i++) {
+    cdict__add(&cdict, i, i);
+  }
+  int value;
+  for (int i = 0; i < 5000; i++) {
+    assert(cdict__get(&cdict, i, &value) && value == i);
+  }
+  size_t false_positives = 0;
+  for (int i = 5000; i < 15000; i++) {
+    assert(!cdict__contains(&cdict, i));
+    false_positives += cdict_bloom__maybe(cdict__bloom(&cdict), ({
+                                            int key = i;
+                                            cdict__XXH64(&key, sizeof(key),
+                                                         cdict__seed(&cdict));
+                                          }));
+  }
+  assert(false_positives < 1000);
+
+  assert(cdict__remove(&cdict, 42));
+  assert(!cdict__contains(&cdict, 42));
+  assert(!cdict__remove(&cdict, 42));
+  assert(cdict__bloom_rebuild(&cdict));
+  assert(!cdict__contains(&cdict, 42));
+
+  cdict__clear(&cdict);
+  assert(cdict_bloom__enabled(cdict__bloom(&cdict)));
+  assert(!cdict__contains(&cdict, 1));
+  cdict__add(&cdict, 1, 1);
+  assert(cdict__get(&cdict, 1, &value) && value == 1);
+
+  cdict__free(&cdict);
+  assert(!cdict_bloom__enabled(cdict__bloom(&cdict)));
+}
+
+typedef struct {
+  size_t count;
+  int last_key;
+} EvictLog;
+
+void record_evict(int *key, int *val, void *ctx) {
+  EvictLog *log = ctx;
+  log->count++;
+  log->last_key = *key;
+  (void)val;
+}
+
+void test__cdict_lru() {
+  CDict_lru(int, int, 4) lru_t;
+  lru_t lru;
+  EvictLog log = {0};
+  cdict_lru__init(&lru);
+  cdict_lru__set_evict(&lru, record_evict, &log);
+  assert(cdict_lru__capacity(&lru) == 4);
+
+  for (int i = 0; i < 4; i++) {
+    cdict_lru__add(&lru, i, i * 10);
+  }
+  int value;
+  /* 0 becomes the most recently used, 1 is next in line */
+  assert(cdict_lru__get(&lru, 0, &value) && value == 0);
+  cdict_lru__add(&lru, 4, 40);
+  assert(log.count == 1 && log.last_key == 1);
+  assert(!cdict_lru__contains(&lru, 1));
+  assert(cdict_lru__size(&lru) == 4);
+
+  /* peek does not promote, so 2 is evicted next */
+  assert(cdict_lru__peek(&lru, 2, &value) && value == 20);
+  cdict_lru__add(&lru, 5, 50);
+  assert(log.last_key == 2);
+
+  /* updates promote without evicting */
+  cdict_lru__add(&lru, 3, 31);
+  assert(log.count == 2);
+  assert(cdict_lru__key_at(&lru, cdict_lru__head(&lru)) == 3);
+  assert(cdict_lru__remove(&lru, 3));
+  assert(!cdict_lru__remove(&lru, 3));
+  assert(cdict_lru__size(&lru) == 3);
+
+  /* churn through tombstones and rehashes, recency order survives */
+  for (int i = 100; i < 10000; i++) {
+    cdict_lru__add(&lru, i, i);
+    assert(cdict_lru__get(&lru, i, &value) && value == i);
+  }
+  assert(cdict_lru__size(&lru) == 4);
+  int expected = 9999;
+  for (uint32_t i = cdict_lru__head(&lru); i != CDICT_LRU__NONE;
+       i = cdict_lru__next(&lru, i)) {
+    assert(cdict_lru__key_at(&lru, i) == expected--);
+  }
+  assert(expected == 9995);
+
+  cdict_lru__free(&lru);
+  assert(cdict_lru__size(&lru) == 0);
+}
+
+void test__cdict_ttl() {
+  CDict_ttl(int, int) ttl_t;
+  ttl_t ttl;
+  cdict_ttl__init(&ttl);
+
+  for (int i = 0; i < 1000; i++) {
+    cdict_ttl__add(&ttl, i, i, (i % 2) ? 20 : 0);
+  }
+  assert(cdict_ttl__size(&ttl) == 1000);
+  int value;
+  assert(cdict_ttl__get(&ttl, 1, &value) && value == 1);
+  /* re-adding replaces the value and the deadline */
+  cdict_ttl__add(&ttl, 3, 30, 0);
+
+  usleep(40 * 1000);
+  /* expired entries read as absent and are reclaimed on sight */
+  assert(!cdict_ttl__get(&ttl, 1, &value));
+  assert(!cdict_ttl__contains(&ttl, 5));
+  assert(cdict_ttl__size(&ttl) == 998);
+  assert(cdict_ttl__get(&ttl, 2, &value) && value == 2);
+  assert(cdict_ttl__get(&ttl, 3, &value) && value == 30);
+
+  /* the rest is reaped a bounded number of buckets at a time */
+  size_t reaped = 0;
+  for (size_t i = 0; i < ttl.cdict_ttl__cap_m; i += 64) {
+    size_t step = cdict_ttl__expire_step(&ttl, 64);
+    assert(step <= 64);
+    reaped += step;
+  }
+  assert(reaped == 497);
+  assert(cdict_ttl__size(&ttl) == 501);
+  assert(cdict_ttl__expire_step(&ttl, 1 << 20) == 0);
+
+  /* tombstones are recycled by later adds */
+  for (int i = 1000; i < 3000; i++) {
+    cdict_ttl__add(&ttl, i, i, 0);
+    int old = i - 1000;
+    assert(cdict_ttl__remove(&ttl, old) ==
+           (old >= 1000 || old % 2 == 0 || old == 3));
+  }
+  assert(cdict_ttl__size(&ttl) == 1000);
+  assert(cdict_ttl__get(&ttl, 2999, &value) && value == 2999);
+
+  cdict_ttl__free(&ttl);
+  assert(cdict_ttl__size(&ttl) == 0);
+}
+
+void test__cdict_compact() {
+  CDict_compact(int, int) compact_t;
+  compact_t compact;
+  cdict_compact__init(&compact);
+
+  for (int i = 0; i < 1000; i++) {
+    cdict_compact__add(&compact, 999 - i, i);
+  }
+  /* updates keep the position, the index widened past one byte */
+  cdict_compact__add(&compact, 999, -1);
+  assert(cdict_compact__size(&compact) == 1000);
+  assert(compact.cdict_compact__width_m == 2);
+  int value;
+  assert(cdict_compact__get(&compact, 999, &value) && value == -1);
+  assert(cdict_compact__key_at(&compact, 0) == 999);
+
+  for (int i = 0; i < 1000; i += 2) {
+    assert(cdict_compact__remove(&compact, i));
+  }
+  assert(!cdict_compact__remove(&compact, 0));
+  assert(!cdict_compact__contains(&compact, 500));
+  assert(cdict_compact__contains(&compact, 501));
+  cdict_compact__add(&compact, 0, 7);
+
+  /* iteration follows insertion order and skips the holes */
+  int expected = 999;
+  size_t seen = 0;
+  for (size_t i = cdict_compact__next(&compact, 0);
+       i < cdict_compact__end(&compact);
+       i = cdict_compact__next(&compact, i + 1)) {
+    int key = cdict_compact__key_at(&compact, i);
+    if (expected > 0) {
+      assert(key == expected);
+      expected -= 2;
+    } else {
+      assert(key == 0 && cdict_compact__val_at(&compact, i) == 7);
+    }
+    seen++;
+  }
+  assert(seen == 501 && seen == cdict_compact__size(&compact));
+
+  /* churn compacts the holes away instead of growing */
+  size_t index_cap = compact.cdict_compact__index_cap_m;
+  for (int i = 1000; i < 20000; i++) {
+    cdict_compact__add(&compact, i, i);
+    assert(cdict_compact__remove(&compact, i));
+  }
+  assert(compact.cdict_compact__index_cap_m == index_cap);
+  assert(cdict_compact__get(&compact, 1, &value) && value == 998);
+
+  cdict_compact__free(&compact);
+  assert(cdict_compact__size(&compact) == 0);
+
+  /* a rebuild that cannot allocate leaves the dict as it was, whether it
+   * grows the entries in place or compacts them into a new array */
+  CountingAllocator counter = {0};
+  cdict_Allocator allocator = {
+      .alloc = counting_alloc, .free = counting_free, .ctx = &counter};
+  cdict_compact__init_with_allocator(&compact, &allocator);
+  int key = 0;
+  while (cdict_compact__end(&compact) <
+             cdict_compact__usable(compact.cdict_compact__index_cap_m) ||
+         key == 0) {
+    assert(cdict_compact__add(&compact, key, key));
+    key++;
+  }
+  for (int removed = 0; removed < 2; removed++) {
+    if (removed) {
+      for (int i = 1; i < key; i++) {
+        cdict_compact__remove(&compact, i);
+      }
+      /* holes up to the end of the entries */
+      while (cdict_compact__end(&compact) <
+             cdict_compact__usable(compact.cdict_compact__index_cap_m)) {
+        assert(cdict_compact__add(&compact, key, key));
+        assert(cdict_compact__remove(&compact, key));
+        key++;
+      }
+    }
+    size_t size = cdict_compact__size(&compact);
+    size_t live_bytes = counter.live_bytes;
+    for (size_t fail = 1; fail <= 2; fail++) {
+      counter.fail_at = counter.allocs + fail;
+      assert(!cdict_compact__add(&compact, -1, -1));
+      assert(cdict_compact__size(&compact) == size);
+      assert(counter.live_bytes == live_bytes);
+    }
+    /* an existing key needs no room */
+    assert(cdict_compact__add(&compact, 0, 100));
+    assert(cdict_compact__key_at(&compact, cdict_compact__next(&compact, 0)) ==
+           0);
+    counter.fail_at = 0;
+    assert(cdict_compact__add(&compact, -1, -1));
+    assert(cdict_compact__get(&compact, 0, &value) && value == 100);
+    assert(cdict_compact__remove(&compact, -1));
+  }
+  assert(cdict_compact__size(&compact) == 1);
+  cdict_compact__free(&compact);
+  assert(counter.live_bytes == 0);
+}
+
+void test__cdict_batch_iteration() {
+  CDict(int, int) cdict_t;
+  CDict_iterator(cdict_t) iterator_t;
+  cdict_t cdict;
+  cdict__init(&cdict);
+  for (int i = 0; i < 10000; i++) {
+    cdict__add(&cdict, i, i * 2);
+  }
+  /* sparse table: only every 100th key survives */
+  for (int i = 0; i < 10000; i++) {
+    if (i % 100) {
+      cdict__remove(&cdict, i);
+    }
+  }
+  assert(cdict__size(&cdict) == 100);
+
+  iterator_t iterator;
+  cdict_iterator__init(&iterator, &cdict);
+  int keys[32], vals[32];
+  size_t total = 0, batches = 0, n;
+  long sum = 0;
+  while ((n = cdict_iterator__next_batch(&iterator, keys, vals, 32)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      assert(keys[i] % 100 == 0 && vals[i] == keys[i] * 2);
+      sum += keys[i];
+    }
+    total += n;
+    batches++;
+  }
+  assert(total == 100 && batches == 4);
+  assert(sum == 495000);
+  assert(cdict_iterator__done(&iterator));
+
+  /* the single entry iterators skip the same holes */
+  cdict_iterator__init(&iterator, &cdict);
+  sum = 0;
+  while (!cdict_iterator__done(&iterator)) {
+    int value;
+    int key = cdict_iterator__next_keyval(&iterator, &value);
+    assert(value == key * 2);
+    sum += key;
+  }
+  assert(sum == 495000);
+
+  cdict__free(&cdict);
+}
+
+void sum_entry(void *key, void *val, void *ctx) {
+  (void)key;
+  __atomic_fetch_add((long *)ctx, *(int *)val, __ATOMIC_RELAXED);
+}
+
+typedef struct {
+  long sum;
+  int max_key;
+} Totals;
+
+void fold_totals(void *acc, void *key, void *val, void *ctx) {
+  Totals *totals = acc;
+  (void)ctx;
+  totals->sum += *(int *)val;
+  if (*(int *)key > totals->max_key) {
+    totals->max_key = *(int *)key;
+  }
+}
+
+void combine_totals(void *acc, void *other, void *ctx) {
+  Totals *totals = acc;
+  Totals *partial = other;
+  (void)ctx;
+  totals->sum += partial->sum;
+  if (partial->max_key > totals->max_key) {
+    totals->max_key = partial->max_key;
+  }
+}
+
+void test__cdict_parallel() {
+  CDict(int, int) cdict_t;
+  cdict_t cdict;
+  cdict__init(&cdict);
+  for (int i = 1; i <= 100000; i++) {
+    cdict__add(&cdict, i, i);
+  }
+
+  /* the cursors cover every entry exactly once */
+  cdict_Cursor cursors[7];
+  cdict__partition(&cdict, cursors, 7);
+  long sum = 0;
+  size_t count = 0;
+  for (int c = 0; c < 7; c++) {
+    int key, value;
+    while (cdict_cursor__next(&cdict, &cursors[c], &key, &value)) {
+      assert(key == value);
+      sum += value;
+      count++;
+    }
+  }
+  assert(count == 100000 && sum == 5000050000L);
+
+  sum = 0;
+  assert(cdict__parallel_for_each(&cdict, 8, sum_entry, &sum));
+  assert(sum == 5000050000L);
+
+  Totals totals = {0, 0};
+  assert(cdict__parallel_reduce(&cdict, 4, fold_totals, combine_totals,
+                                &totals, NULL));
+  assert(totals.sum == 5000050000L && totals.max_key == 100000);
+
+  /* more threads than bitmap words */
+  cdict_t small;
+  cdict__init(&small);
+  cdict__add(&small, 1, 41);
+  sum = 1;
+  assert(cdict__parallel_for_each(&small, 64, sum_entry, &sum));
+  assert(sum == 42);
+
+  cdict__free(&small);
+  cdict__free(&cdict);
+}
+
+void add_counts(int *dst, int *src, void *ctx) {
+  (void)ctx;
+  *dst += *src;
+}
+
+void test__cdict_update() {
+  CDict(int, int) cdict_t;
+  cdict_t a, b, c;
+  cdict__init(&a);
+  cdict__init(&b);
+  for (int i = 0; i < 1000; i++) {
+    cdict__add(&a, i, 1);
+  }
+  for (int i = 500; i < 2000; i++) {
+    cdict__add(&b, i, 2);
+  }
+
+  /* an empty destination takes the buckets as they are */
+  cdict__init(&c);
+  cdict__update(&c, &a, CDICT_UPDATE_OVERWRITE);
+  assert(cdict__size(&c) == 1000 && cdict__cap(&c) == cdict__cap(&a));
+
+  int value;
+  cdict__update(&c, &b, CDICT_UPDATE_KEEP);
+  assert(cdict__size(&c) == 2000);
+  assert(cdict__get(&c, 700, &value) && value == 1);
+  assert(cdict__get(&c, 1500, &value) && value == 2);
+
+  cdict__update(&c, &b, CDICT_UPDATE_OVERWRITE);
+  assert(cdict__get(&c, 700, &value) && value == 2);
+  assert(cdict__get(&c, 10, &value) && value == 1);
+
+  cdict__update_with(&a, &b, add_counts, NULL);
+  assert(cdict__size(&a) == 2000);
+  assert(cdict__get(&a, 700, &value) && value == 3);
+  assert(cdict__get(&a, 1700, &value) && value == 2);
+
+  /* a key re-added behind a tombstone in its probe sequence is not stored
+   * twice */
+  for (int i = 0; i < 2000; i += 3) {
+    cdict__remove(&a, i);
+  }
+  size_t size = cdict__size(&a);
+  for (int i = 0; i < 2000; i++) {
+    if (i % 3) {
+      cdict__add(&a, i, 0);
+    }
+  }
+  assert(cdict__size(&a) == size);
+
+  /* the bucket copy fails: the keys are inserted one by one instead */
+  CountingAllocator counter = {0};
+  cdict_Allocator allocator = {
+      .alloc = counting_alloc, .free = counting_free, .ctx = &counter};
+  cdict_t d;
+  cdict__init_with_allocator(&d, &allocator);
+  counter.fail_at = 1;
+  cdict__update(&d, &b, CDICT_UPDATE_OVERWRITE);
+  assert(counter.allocs > 2 && cdict__size(&d) == 1500);
+  assert(cdict__get(&d, 1999, &value) && value == 2);
+  cdict__free(&d);
+  assert(counter.live_bytes == 0);
+
+  cdict__free(&a);
+  cdict__free(&b);
+  cdict__free(&c);
+}
+
+typedef struct {
+  int added, removed, changed;
+} DiffLog;
+
+void on_added(int *key, int *val, void *ctx) {
+  assert(*key >= 1000 && *val == *key);
+  ((DiffLog *)ctx)->added++;
+}
+
+void on_removed(int *key, int *val, void *ctx) {
+  assert(*key < 10 && *val == *key);
+  ((DiffLog *)ctx)->removed++;
+}
+
+void on_changed(int *key, int *old, int *new, void *ctx) {
+  assert(*key == 500 && *old == 500 && *new == -1);
+  ((DiffLog *)ctx)->changed++;
+}
+
+size_t hash_calls = 0;
+
+cdict__u64 counting_hasher(int *key, cdict__u64 (*hash)(void *, size_t)) {
+  hash_calls++;
+  return hash(key, sizeof(*key));
+}
+
+void test__cdict_update_like() {
+  CDict(int, int) cdict_t;
+  cdict_t global, partial;
+  cdict__init(&global);
+  cdict__set_hash(&global, counting_hasher);
+  for (int i = 0; i < 1000; i++) {
+    cdict__add(&global, i, 1);
+  }
+  /* same seed, hasher and capacity: keys in their home bucket of the partial
+   * dict go to the same bucket of the global one without being hashed */
+  cdict__init_like(&partial, &global);
+  assert(cdict__seed(&partial) == cdict__seed(&global));
+  assert(cdict__reserve(&partial, 1000));
+  assert(cdict__cap(&partial) == cdict__cap(&global));
+  for (int i = 0; i < 100; i++) {
+    cdict__add(&partial, i, 5);
+  }
+  for (int i = 1000; i < 1300; i++) {
+    cdict__add(&partial, i, 2);
+  }
+  /* a plain merge hashes twice per key; about half of the home buckets are
+   * free at this load */
+  hash_calls = 0;
+  assert(cdict__update_with(&global, &partial, add_counts, NULL));
+  assert(hash_calls + 50 < 2 * cdict__size(&partial));
+  assert(cdict__size(&global) == 1300);
+  int value;
+  for (int i = 0; i < 1300; i++) {
+    assert(cdict__get(&global, i, &value));
+    assert(value == (i < 100 ? 6 : i < 1000 ? 1 : 2));
+  }
+
+  /* a destination with more buckets than the source hashes every key */
+  cdict__clear(&partial);
+  for (int i = 2000; i < 2010; i++) {
+    cdict__add(&partial, i, 3);
+  }
+  assert(cdict__cap(&partial) < cdict__cap(&global));
+  hash_calls = 0;
+  assert(cdict__update(&global, &partial, CDICT_UPDATE_KEEP));
+  assert(hash_calls >= 2 * 10);
+  assert(cdict__get(&global, 2009, &value) && value == 3);
+
+  cdict__free(&global);
+  cdict__free(&partial);
+}
+
+void test__cdict_equals_diff() {
+  CDict(int, int) cdict_t;
+  cdict_t a, b;
+  cdict__init(&a);
+  cdict__init(&b);
+  /* seeds are random per dict: the bucket by bucket path needs them shared */
+  cdict__set_seed(&b, cdict__seed(&a));
+  cdict__set_hash(&a, counting_hasher);
+  cdict__set_hash(&b, counting_hasher);
+  for (int i = 0; i < 1000; i++) {
+    cdict__add(&a, i, i);
+    cdict__add(&b, 999 - i, 999 - i);
+  }
+  assert(cdict__same_layout_(&a, &b));
+  assert(cdict__equals(&a, &b) && cdict__equals(&b, &a));
+  /* most keys are found in the hinted bucket, without hashing; probing
+   * hashes twice per key */
+  hash_calls = 0;
+  assert(cdict__equals(&a, &b));
+  assert(hash_calls < 1000);
+
+  /* with another seed every key is hashed to be found */
+  cdict_t d;
+  cdict__init(&d);
+  cdict__set_hash(&d, counting_hasher);
+  cdict__set_seed(&d, cdict__seed(&a) + 1);
+  for (int i = 0; i < 1000; i++) {
+    cdict__add(&d, i, i);
+  }
+  assert(!cdict__same_layout_(&a, &d));
+  hash_calls = 0;
+  assert(cdict__equals(&a, &d));
+  assert(hash_calls >= 2000);
+  cdict__free(&d);
+
+  cdict__add(&b, 500, -1);
+  assert(!cdict__equals(&a, &b));
+  for (int i = 0; i < 10; i++) {
+    cdict__remove(&b, i);
+  }
+  assert(!cdict__equals(&a, &b));
+  for (int i = 1000; i < 1005; i++) {
+    cdict__add(&b, i, i);
+  }
+
+  DiffLog log = {0, 0, 0};
+  assert(cdict__diff(&a, &b, on_added, on_removed, on_changed, &log) == 16);
+  assert(log.added == 5 && log.removed == 10 && log.changed == 1);
+
+  /* different layouts still compare by key */
+  cdict_t c;
+  cdict__init(&c);
+  cdict__reserve(&c, 100000);
+  cdict__add(&c, 0, 0);
+  cdict__update(&c, &a, CDICT_UPDATE_OVERWRITE);
+  assert(cdict__cap(&c) != cdict__cap(&a));
+  assert(cdict__equals(&a, &c));
+
+  cdict__free(&a);
+  cdict__free(&b);
+  cdict__free(&c);
+}
+
+void test__cdict_set() {
+  CDict_set(int) set_t;
+  set_t a, b, res;
+  cdict_set__init(&a);
+  cdict_set__init(&b);
+  cdict_set__init(&res);
+
+  /* a bucket holds only the probe length and the key */
+  assert(sizeof(*cdict_vector__index(cdict__vector_buckets_ref(&a), 0)) ==
+         sizeof(int) * 2);
+  /* the same for a wider key: the psl, padded to the key's alignment, then
+   * the key, with nothing stored for the unit value */
+  CDict_set(uint64_t) wide_t;
+  wide_t wide;
+  assert(sizeof(*cdict_vector__index(cdict__vector_buckets_ref(&wide), 0)) ==
+         offsetof(cdict_elem_uint64_tcdict_Unit, key) + sizeof(uint64_t));
+  assert(offsetof(cdict_elem_uint64_tcdict_Unit, key) == sizeof(uint64_t));
+
+  for (int i = 0; i < 1000; i++) {
+    cdict_set__add(&a, i);
+    cdict_set__add(&a, i);
+  }
+  for (int i = 500; i < 600; i++) {
+    cdict_set__add(&b, i);
+  }
+  assert(cdict_set__size(&a) == 1000);
+  assert(cdict_set__contains(&a, 999) && !cdict_set__contains(&a, 1000));
+  assert(cdict_set__intersect_count(&a, &b) == 100);
+  assert(cdict_set__intersect_count(&b, &a) == 100);
+  assert(!cdict_set__is_disjoint(&a, &b));
+
+  cdict_set__intersect(&res, &a, &b);
+  assert(cdict_set__size(&res) == 100 && cdict_set__contains(&res, 550));
+  cdict_set__clear(&res);
+  cdict_set__difference(&res, &a, &b);
+  assert(cdict_set__size(&res) == 900 && !cdict_set__contains(&res, 550));
+  assert(cdict_set__is_disjoint(&res, &b));
+  cdict_set__clear(&res);
+  cdict_set__union(&res, &b, &a);
+  assert(cdict_set__size(&res) == 1000);
+
+  cdict_set__difference_update(&res, &b);
+  assert(cdict_set__size(&res) == 900 && !cdict_set__contains(&res, 599));
+  cdict_set__difference_update(&b, &res);
+  assert(cdict_set__size(&b) == 100);
+  cdict_set__intersect_update(&a, &b);
+  assert(cdict_set__size(&a) == 100);
+  assert(cdict_set__contains(&a, 500) && !cdict_set__contains(&a, 499));
+  cdict_set__update(&a, &res);
+  assert(cdict_set__size(&a) == 1000);
+
+  CDict_iterator(set_t) iter_t;
+  iter_t iter;
+  cdict_iterator__init(&iter, &a);
+  int count = 0;
+  while (!cdict_iterator__done(&iter)) {
+    int key = cdict_iterator__next(&iter);
+    assert(key >= 0 && key < 1000);
+    count++;
+  }
+  assert(count == 1000);
+
+  assert(cdict_set__remove(&a, 10) && !cdict_set__contains(&a, 10));
+  cdict_set__free(&a);
+  cdict_set__free(&b);
+  cdict_set__free(&res);
+}
+
+void test__cdict_stats() {
+  CDict(int, int) cdict_t;
+  cdict_t cdict;
+  cdict__init(&cdict);
+  cdict_Stats stats;
+  cdict__stats(&cdict, &stats);
+  assert(stats.size == 0 && stats.cap == 0 && stats.max_psl == 0);
+
+  for (int i = 0; i < 1000; i++) {
+    cdict__add(&cdict, i, i);
+  }
+  for (int i = 0; i < 100; i++) {
+    cdict__remove(&cdict, i);
+  }
+  int value;
+  for (int i = 0; i < 300; i++) {
+    cdict__get(&cdict, i, &value);
+  }
+
+  cdict__stats(&cdict, &stats);
+  assert(stats.size == 900 && stats.cap == cdict__cap(&cdict));
+  assert(stats.tombstones == 100);
+  size_t entries = 0;
+  for (int i = 0; i < CDICT__PSL_HISTOGRAM_SIZE; i++) {
+    entries += stats.psl_histogram[i];
+  }
+  assert(entries == 900 && stats.psl_histogram[0] > 0);
+  assert(stats.max_psl >= 1 && stats.mean_psl >= 1);
+  assert(stats.mean_psl <= stats.max_psl);
+  /* growing from the initial capacity, every resize reinserts the live
+   * entries of the smaller table */
+  assert(stats.resizes > 1 && stats.rehashes > 0);
+#ifdef CDICT__STATS
+  assert(stats.hits == 200 && stats.misses == 100);
+#else
+  assert(stats.hits == 0 && stats.misses == 0);
+#endif
+
+  cdict__reset_stats(&cdict);
+  cdict__stats(&cdict, &stats);
+  assert(stats.resizes == 0 && stats.hits == 0 && stats.size == 900);
+
+  cdict__free(&cdict);
+}
+
+void test__cdict_memory_usage() {
+  CDict(char, double) cdict_t;
+  cdict_t cdict;
+  cdict__init(&cdict);
+  cdict_Memory memory = cdict__memory_usage(&cdict);
+  assert(memory.allocated == 0 && memory.live == 0);
+  /* the first add allocates the initial buckets */
+  assert(memory.resize_peak >= CDICT__INITIAL_CAP * memory.elem_size);
+
+  for (char c = 'a'; c <= 'z'; c++) {
+    cdict__add(&cdict, c, 1.0);
+  }
+  memory = cdict__memory_usage(&cdict);
+  size_t cap = cdict__cap(&cdict);
+  /* {int psl; char key; double val} pads the key up to the double */
+  assert(memory.elem_size == 16 && memory.elem_padding == 3);
+  assert(memory.buckets == cap * 16 && memory.padding == cap * 3);
+  assert(memory.live == 26 * 9 && memory.unused == (cap - 26) * 16);
+  assert(memory.allocated == memory.buckets + cdict__occupied_bytes(cap));
+  assert(memory.resize_peak > memory.allocated + memory.buckets);
+
+  cdict__enable_bloom(&cdict);
+  assert(cdict__memory_usage(&cdict).allocated > memory.allocated);
+
+  cdict__free(&cdict);
+}
+
+#define ATTACKED_SEED 42
+
+/* keys collide under ATTACKED_SEED only, like keys crafted against a known
+ * seed */
+cdict__u64 attacked_hasher(int *key, cdict__u64 (*hash)(void *, size_t)) {
+  int zero = 0;
+  return cdict__callback_seed == ATTACKED_SEED ? hash(&zero, sizeof(zero))
+                                               : hash(key, sizeof(*key));
+}
+
+/* collides under every seed */
+cdict__u64 constant_hasher(int *key, cdict__u64 (*hash)(void *, size_t)) {
+  (void)key;
+  int zero = 0;
+  return hash(&zero, sizeof(zero));
+}
+
+void test__cdict_reseed() {
+  CDict(int, int) cdict_t;
+  cdict_t a, b;
+  cdict__init(&a);
+  cdict__init(&b);
+
+  /* custom hashers see the seed of their dict */
+  cdict__set_hash(&a, attacked_hasher);
+  cdict__set_hash(&b, attacked_hasher);
+  int key = 7;
+  cdict__u64 a_hash = cdict__h1hash(&a, &key, key);
+  cdict__u64 b_hash = cdict__h1hash(&b, &key, key);
+  assert(a_hash != b_hash);
+
+  cdict__set_seed(&a, ATTACKED_SEED);
+  for (int i = 0; i < 500; i++) {
+    cdict__add(&a, i, i);
+  }
+  cdict_Stats stats;
+  cdict__stats(&a, &stats);
+  assert(stats.reseeds == 1 && cdict__seed(&a) != ATTACKED_SEED);
+  assert(stats.max_psl <= CDICT__RESEED_PSL);
+  for (int i = 0; i < 500; i++) {
+    int value;
+    assert(cdict__get(&a, i, &value) && value == i);
+  }
+
+  /* a hasher ignoring the seed gives up after CDICT__MAX_RESEEDS */
+  cdict__set_hash(&b, constant_hasher);
+  for (int i = 0; i < 300; i++) {
+    cdict__add(&b, i, i);
+  }
+  cdict__stats(&b, &stats);
+  assert(stats.reseeds == CDICT__MAX_RESEEDS && stats.size == 300);
+  assert(cdict__contains(&b, 299) && !cdict__contains(&b, 300));
+
+  cdict__free(&a);
+  cdict__free(&b);
+}
+
+void test__cdict_entry() {
+  CDict(int, long) cdict_t;
+  cdict_t cdict;
+  cdict__init(&cdict);
+  for (int i = 0; i < 10000; i++) {
+    *cdict__entry(&cdict, i % 100) += 1;
+  }
+  assert(cdict__size(&cdict) == 100);
+  long value;
+  assert(cdict__get(&cdict, 42, &value) && value == 100);
+  cdict__free(&cdict);
+}
+
+void test__cdict_multi() {
+  CDict_multi(int, int) multi_t;
+  multi_t multi;
+  cdict_multi__init(&multi);
+
+  for (int i = 0; i < 1000; i++) {
+    for (int j = 0; j <= i % 10; j++) {
+      cdict_multi__add(&multi, i, i * 10 + j);
+    }
+  }
+  assert(cdict_multi__size(&multi) == 1000);
+
+  /* inline and spilled arrays are both contiguous */
+  for (int i = 0; i < 1000; i++) {
+    size_t count;
+    const int *values = cdict_multi__values(&multi, i, &count);
+    assert(values && count == (size_t)(i % 10 + 1));
+    for (size_t j = 0; j < count; j++) {
+      assert(values[j] == i * 10 + (int)j);
+    }
+  }
+  size_t count;
+  assert(cdict_multi__values(&multi, 1000, &count) == NULL && count == 0);
+  assert(cdict_multi__count(&multi, 9) == 10);
+
+  assert(cdict_multi__remove(&multi, 9) && !cdict_multi__remove(&multi, 9));
+  assert(cdict_multi__count(&multi, 9) == 0);
+  cdict_multi__add(&multi, 9, 1);
+  assert(cdict_multi__count(&multi, 9) == 1);
+
+  CDict_iterator(multi_t) iterator_t;
+  iterator_t iterator;
+  cdict_iterator__init(&iterator, &multi);
+  size_t total = 0;
+  while (!cdict_iterator__done(&iterator)) {
+    __typeof__(multi.cdict__value_m) values;
+    cdict_iterator__next_keyval(&iterator, &values);
+    total += cdict_multi__len(&values);
+  }
+  assert(total == 5500 - 10 + 1);
+
+  /* update copies the value arrays, equals compares their contents */
+  multi_t copy, other;
+  cdict_multi__init(&copy);
+  cdict_multi__init(&other);
+  assert(cdict_multi__update(&copy, &multi));
+  assert(cdict_multi__equals(&copy, &multi) &&
+         cdict_multi__equals(&multi, &copy));
+  for (int i = 0; i < 1000; i++) {
+    for (int j = 0; j <= i % 10; j++) {
+      cdict_multi__add(&other, i, i * 10 + j);
+    }
+  }
+  assert(!cdict_multi__equals(&other, &multi));
+  cdict_multi__remove(&other, 9);
+  cdict_multi__add(&other, 9, 1);
+  assert(cdict_multi__equals(&other, &multi));
+  cdict_multi__add(&other, 9, 2);
+  assert(!cdict_multi__equals(&other, &multi));
+  /* conflicting keys get the values of both */
+  assert(cdict_multi__update(&copy, &other));
+  assert(cdict_multi__count(&copy, 999) == 20);
+  assert(cdict_multi__count(&copy, 9) == 3);
+  assert(cdict_multi__size(&copy) == 1000);
+  cdict_multi__free(&other);
+  assert(cdict_multi__count(&multi, 999) == 10);
+  cdict_multi__free(&copy);
+
+  cdict_multi__clear(&multi);
+  assert(cdict_multi__size(&multi) == 0);
+  assert(cdict_multi__add(&multi, 1, 1));
+  cdict_multi__free(&multi);
+
+  /* a value array that cannot grow reports the value as not added */
+  CountingAllocator counter = {0};
+  cdict_Allocator allocator = {
+      .alloc = counting_alloc, .free = counting_free, .ctx = &counter};
+  cdict_multi__init_with_allocator(&multi, &allocator);
+  for (int j = 0; j < CDICT__MULTI_INLINE; j++) {
+    assert(cdict_multi__add(&multi, 5, j));
+  }
+  counter.fail_at = counter.allocs + 1;
+  assert(!cdict_multi__add(&multi, 5, 100));
+  assert(cdict_multi__count(&multi, 5) == CDICT__MULTI_INLINE);
+  assert(cdict_multi__add(&multi, 5, 100));
+  const int *values = cdict_multi__values(&multi, 5, &count);
+  assert(count == CDICT__MULTI_INLINE + 1 && values[count - 1] == 100);
+  cdict_multi__free(&multi);
+  assert(counter.live_bytes == 0);
+}
+
+void test__cdict_aggregation() {
+  CDict(int, long) cdict_t;
+  cdict_t counts, lows, highs;
+  cdict__init(&counts);
+  cdict__init(&lows);
+  cdict__init(&highs);
+
+  for (int i = 0; i < 5000; i++) {
+    int key = i % 50;
+    cdict__incr(&counts, key, key);
+    cdict__min(&lows, key, (long)(i - 2500));
+    cdict__max(&highs, key, (long)(i - 2500));
+  }
+  assert(cdict__sum(&counts, 3, 0) == 300);
+  assert(cdict__incr(&counts, 1000, -1) == -1);
+  long value;
+  assert(cdict__get(&lows, 7, &value) && value == 7 - 2500);
+  assert(cdict__get(&highs, 7, &value) && value == 4950 + 7 - 2500);
+
+  int keys[100];
+  long vals[100];
+  assert(cdict__top_k(&counts, 5, keys, vals) == 5);
+  for (int i = 0; i < 5; i++) {
+    assert(keys[i] == 49 - i && vals[i] == (49 - i) * 100);
+  }
+  /* fewer entries than k */
+  assert(cdict__top_k(&lows, 100, keys, NULL) == 50);
+  assert(cdict__top_k(&lows, 0, keys, vals) == 0);
+
+  /* a heap that cannot be allocated is not mistaken for an empty result */
+  CountingAllocator counter = {0};
+  cdict_Allocator allocator = {
+      .alloc = counting_alloc, .free = counting_free, .ctx = &counter};
+  cdict_t limited;
+  cdict__init_with_allocator(&limited, &allocator);
+  cdict__incr(&limited, 1, 1);
+  counter.fail_at = counter.allocs + 1;
+  assert(cdict__top_k(&limited, 5, keys, vals) == SIZE_MAX);
+  assert(cdict__top_k(&limited, 5, keys, vals) == 1 && keys[0] == 1);
+  cdict__free(&limited);
+  assert(counter.live_bytes == 0);
+
+  cdict__free(&counts);
+  cdict__free(&lows);
+  cdict__free(&highs);
+}
+
+CDict(int, int) group_dict_t;
+CDict_group(group_dict_t) group_t;
+
+typedef struct {
+  group_t *group;
+  size_t worker;
+} Group_worker;
+
+void *count_into_group(void *arg) {
+  Group_worker *w = arg;
+  /* every worker sees every key, with a count of 1 per occurrence */
+  for (int i = 0; i < 20000; i++) {
+    *cdict_group__entry(w->group, w->worker, i % 5000) += 1;
+  }
+  return NULL;
+}
+
+void add_group_counts(void *dst, void *src, void *ctx) {
+  (void)ctx;
+  *(int *)dst += *(int *)src;
+}
+
+void test__cdict_group() {
+  group_t group;
+  assert(cdict_group__init(&group, 4, 8));
+  assert(cdict_group__workers(&group) == 4 && cdict_group__parts(&group) == 8);
+
+  pthread_t threads[4];
+  Group_worker workers[4];
+  for (size_t w = 0; w < 4; w++) {
+    workers[w] = (Group_worker){&group, w};
+    assert(pthread_create(&threads[w], NULL, count_into_group, &workers[w]) ==
+           0);
+  }
+  for (size_t w = 0; w < 4; w++) {
+    pthread_join(threads[w], NULL);
+  }
+  assert(cdict_group__merge(&group, add_group_counts, NULL));
+
+  /* each key sits in exactly one partition, with the total of all workers */
+  size_t total = 0;
+  for (size_t p = 0; p < 8; p++) {
+    group_dict_t *part = cdict_group__result(&group, p);
+    total += cdict__size(part);
+    assert(cdict__size(part) < 5000);
+  }
+  assert(total == 5000);
+  for (int key = 0; key < 5000; key++) {
+    size_t found = 0;
+    for (size_t p = 0; p < 8; p++) {
+      int count = 0;
+      if (cdict__get(cdict_group__result(&group, p), key, &count)) {
+        assert(count == 16);
+        found++;
+      }
+    }
+    assert(found == 1);
+  }
+  /* the other rows were emptied */
+  for (size_t w = 1; w < 4; w++) {
+    for (size_t p = 0; p < 8; p++) {
+      assert(cdict__size(cdict_group__dict_(&group, w, p)) == 0);
+    }
+  }
+  cdict_group__free(&group);
+
+  /* without combine the first value is kept */
+  assert(cdict_group__init(&group, 2, 3));
+  *cdict_group__entry(&group, 0, 7) = 1;
+  *cdict_group__entry(&group, 1, 7) = 2;
+  *cdict_group__entry(&group, 1, 8) = 3;
+  assert(cdict_group__merge(&group, NULL, NULL));
+  int seven = 0, eight = 0;
+  for (size_t p = 0; p < 3; p++) {
+    cdict__get(cdict_group__result(&group, p), 7, &seven);
+    cdict__get(cdict_group__result(&group, p), 8, &eight);
+  }
+  assert((seven == 1 || seven == 2) && eight == 3);
+  cdict_group__free(&group);
+
+  /* long probes while merging reseed the merged dict */
+  assert(cdict_group__init(&group, 2, 1));
+  cdict_group__set_hash(&group, attacked_hasher);
+  for (int i = 0; i < 400; i++) {
+    *cdict_group__entry(&group, (size_t)i % 2, i) = i;
+  }
+  cdict__set_seed(cdict_group__dict_(&group, 0, 0), ATTACKED_SEED);
+  cdict__set_seed(cdict_group__dict_(&group, 1, 0), ATTACKED_SEED);
+  assert(cdict_group__merge(&group, NULL, NULL));
+  group_dict_t *merged = cdict_group__result(&group, 0);
+  cdict_Stats stats;
+  cdict__stats(merged, &stats);
+  assert(stats.reseeds == 1 && cdict__seed(merged) != ATTACKED_SEED);
+  for (int i = 0; i < 400; i++) {
+    int value = -1;
+    assert(cdict__get(merged, i, &value) && value == i);
+  }
+  cdict_group__free(&group);
+}
+
 int main() {
   test__cdict_init();
   test__cdict_add();
@@ -518,6 +2128,7 @@ int main() {
   test__cdict_size();
   test__cdict_iteration();
   test__cdict_values_iteration();
+  test__cset_algebra();
   test__cdict_keyval_iteration();
   test__cdict_struct_iteration();
   test__cdict_nested_cdict();
@@ -527,4 +2138,29 @@ int main() {
   test__cdict_pop();
   test__copy_keys_to_vector();
   test__custom_comparator_hasher();
+  test__cdict_allocator();
+  test__cdict_arena();
+  test__cdict_hugepage();
+  test__cdict_lazy_allocation();
+  test__cdict_snapshot();
+  test__cdict_wal();
+  test__cdict_freeze();
+  test__cdict_small();
+  test__cdict_bloom();
+  test__cdict_lru();
+  test__cdict_ttl();
+  test__cdict_compact();
+  test__cdict_batch_iteration();
+  test__cdict_parallel();
+  test__cdict_update();
+  test__cdict_equals_diff();
+  test__cdict_update_like();
+  test__cdict_set();
+  test__cdict_stats();
+  test__cdict_memory_usage();
+  test__cdict_reseed();
+  test__cdict_entry();
+  test__cdict_multi();
+  test__cdict_aggregation();
+  test__cdict_group();
 }
@@ -0,0 +1,227 @@
+#include <assert.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "src/cdict.hpp"
+
+/* counts copies and moves, to check that resize only moves */
+struct Tracked {
+  static int copies;
+  static int moves;
+  static int live;
+  int value;
+
+  Tracked(int value) : value(value) { live++; }
+  Tracked(const Tracked &other) : value(other.value) {
+    copies++;
+    live++;
+  }
+  Tracked(Tracked &&other) noexcept : value(other.value) {
+    moves++;
+    live++;
+  }
+  Tracked &operator=(const Tracked &) = default;
+  ~Tracked() { live--; }
+};
+
+int Tracked::copies = 0;
+int Tracked::moves = 0;
+int Tracked::live = 0;
+
+void test__map_basic() {
+  cdict::map<int, int> map;
+  assert(map.empty() && map.capacity() == 0);
+  for (int i = 0; i < 1000; i++) {
+    assert(map.try_emplace(i, i * 2).second);
+  }
+  assert(map.size() == 1000);
+  /* present keys keep their value */
+  auto result = map.try_emplace(7, 0);
+  assert(!result.second && result.first.val() == 14);
+  assert(map.insert_or_assign(7, 1).second == false && *map.get(7) == 1);
+  map[7] = 14;
+
+  for (int i = 0; i < 1000; i++) {
+    assert(map.contains(i) && *map.get(i) == i * 2);
+  }
+  assert(!map.contains(1000) && map.get(1000) == nullptr);
+  assert(map.find(1000) == map.end());
+
+  long sum = 0;
+  size_t count = 0;
+  for (auto [key, val] : map) {
+    assert(val == key * 2);
+    sum += val;
+    count++;
+  }
+  assert(count == 1000 && sum == 999000);
+
+  /* tombstones are skipped by lookups and reused by inserts */
+  for (int i = 0; i < 1000; i += 2) {
+    assert(map.erase(i) == 1);
+  }
+  assert(map.erase(0) == 0 && map.size() == 500);
+  for (int i = 1; i < 1000; i += 2) {
+    assert(*map.get(i) == i * 2);
+  }
+  size_t cap = map.capacity();
+  for (int i = 0; i < 1000; i += 2) {
+    map[i] = i * 2;
+  }
+  assert(map.size() == 1000 && map.capacity() == cap);
+
+  cdict::map<int, int> copy = map;
+  assert(copy.size() == 1000 && *copy.get(999) == 1998);
+  cdict::map<int, int> moved = std::move(copy);
+  assert(moved.size() == 1000 && copy.size() == 0);
+
+  map.clear();
+  assert(map.size() == 0 && map.capacity() == 0 && !map.contains(1));
+  map[1] = 2;
+  assert(*map.get(1) == 2);
+}
+
+void test__map_strings() {
+  cdict::map<std::string, int> map;
+  for (int i = 0; i < 500; i++) {
+    map["key" + std::to_string(i)] = i;
+  }
+  /* heterogeneous lookup, no std::string is built */
+  std::string_view view = "key42";
+  assert(*map.get(view) == 42);
+  assert(map.contains("key499") && !map.contains("key500"));
+  assert(map.find(std::string_view("key7")).val() == 7);
+  assert(map.erase(std::string_view("key7")) == 1 && !map.contains("key7"));
+
+  /* long strings survive resizes without copies of their buffers */
+  std::string big(1000, 'x');
+  const char *data = nullptr;
+  {
+    cdict::map<std::string, std::string> owners;
+    owners.try_emplace("big", std::move(big));
+    data = owners.get("big")->data();
+    for (int i = 0; i < 1000; i++) {
+      owners.try_emplace(std::to_string(i), "v");
+    }
+    assert(owners.get("big")->data() == data);
+    assert(owners.get("big")->size() == 1000);
+  }
+}
+
+void test__map_move_only() {
+  cdict::map<int, std::unique_ptr<int>> map;
+  for (int i = 0; i < 1000; i++) {
+    map.try_emplace(i, std::make_unique<int>(i));
+  }
+  for (int i = 0; i < 1000; i++) {
+    assert(**map.get(i) == i);
+  }
+  /* the argument is left alone when the key exists */
+  std::unique_ptr<int> other = std::make_unique<int>(-1);
+  assert(!map.try_emplace(5, std::move(other)).second);
+  assert(other && *other == -1);
+
+  Tracked::copies = Tracked::moves = 0;
+  {
+    cdict::map<int, Tracked> tracked;
+    for (int i = 0; i < 1000; i++) {
+      tracked.try_emplace(i, i);
+    }
+    assert(Tracked::copies == 0 && Tracked::moves > 0);
+    assert(Tracked::live == 1000);
+    tracked.erase(3);
+    assert(Tracked::live == 999);
+  }
+  assert(Tracked::live == 0);
+}
+
+/* a value whose move may throw: resize copies it, and the key with it */
+struct ThrowingMove {
+  int value;
+
+  ThrowingMove(int value) : value(value) {}
+  ThrowingMove(const ThrowingMove &) = default;
+  ThrowingMove(ThrowingMove &&other) : value(other.value) {}
+};
+
+struct TrackedHash {
+  template <typename Bytes>
+  uint64_t operator()(const Tracked &key, Bytes bytes) const {
+    return bytes(&key.value, sizeof(key.value));
+  }
+};
+
+struct TrackedEqual {
+  bool operator()(const Tracked &a, const Tracked &b) const {
+    return a.value == b.value;
+  }
+};
+
+void test__map_resize_copies_pairs() {
+  {
+    cdict::map<Tracked, ThrowingMove, TrackedHash, TrackedEqual> map;
+    for (int i = 0; i < 100; i++) {
+      map.try_emplace(Tracked(i), i);
+    }
+    Tracked::copies = Tracked::moves = 0;
+    map.reserve(10000);
+    /* the key's move is noexcept, but it is copied along with the value */
+    assert(Tracked::moves == 0 && Tracked::copies == 100);
+    for (int i = 0; i < 100; i++) {
+      assert(map.get(Tracked(i))->value == i);
+    }
+  }
+  assert(Tracked::live == 0);
+}
+
+struct Point {
+  int x, y;
+  bool operator==(const Point &other) const {
+    return x == other.x && y == other.y;
+  }
+};
+
+struct PointHash {
+  template <typename Bytes>
+  uint64_t operator()(const Point &point, Bytes bytes) const {
+    return bytes(&point.x, sizeof(point.x)) ^ bytes(&point.y, sizeof(point.y));
+  }
+};
+
+/* every key collides */
+struct ConstantHash {
+  template <typename Bytes> uint64_t operator()(int, Bytes) const { return 1; }
+};
+
+void test__map_custom_hash() {
+  cdict::map<Point, int, PointHash> points;
+  for (int i = 0; i < 100; i++) {
+    points[Point{i, -i}] = i;
+  }
+  for (int i = 0; i < 100; i++) {
+    assert(*points.get(Point{i, -i}) == i);
+  }
+  assert(!points.contains(Point{1, 1}));
+
+  /* long probes reseed and rehash, a constant hash gives up after the limit
+   * but keeps working */
+  cdict::map<int, int, ConstantHash> collisions;
+  uint64_t seed = collisions.seed();
+  for (int i = 0; i < 300; i++) {
+    collisions[i] = i;
+  }
+  assert(collisions.seed() != seed);
+  for (int i = 0; i < 300; i++) {
+    assert(*collisions.get(i) == i);
+  }
+}
+
+int main() {
+  test__map_basic();
+  test__map_strings();
+  test__map_move_only();
+  test__map_resize_copies_pairs();
+  test__map_custom_hash();
+}